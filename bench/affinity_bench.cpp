@@ -0,0 +1,65 @@
+// SPDX-License-Identifier: GNU General Public License v3.0 or later
+
+// Thread scaling of directory-affinity scheduling: the engine renames a flat directory and a
+// wide tree lower, then upper, with 1 to --max-threads threads, once with one worker per
+// directory and once with a directory's renames shared between the threads.
+// Usage: affinity_bench [--dir PATH] [--files N] [--max-threads N] [--rounds N]
+
+#include "bench_tree.h"
+
+#include <cstdlib>
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+
+
+// Function to time one tree with a thread count and scheduling, in renames per second
+static double renames_per_second(const fs::path& root, unsigned threads, bool affinity, size_t rounds) {
+    RenameOptions options;
+    options.threads = threads;
+    options.directory_affinity = affinity;
+    return time_lower_upper(options, root.string(), rounds);
+}
+
+
+int main(int argc, char* argv[]) {
+    const char* tmpdir = std::getenv("TMPDIR");
+    fs::path base = tmpdir ? tmpdir : "/tmp";
+    size_t files = 20000;
+    unsigned max_threads = std::max(2u, std::thread::hardware_concurrency());
+    size_t rounds = 2;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        const std::string arg(argv[i]);
+        if (arg == "--dir") base = argv[i + 1];
+        else if (arg == "--files") files = std::strtoul(argv[i + 1], nullptr, 10);
+        else if (arg == "--max-threads") max_threads = static_cast<unsigned>(std::strtoul(argv[i + 1], nullptr, 10));
+        else if (arg == "--rounds") rounds = std::strtoul(argv[i + 1], nullptr, 10);
+    }
+
+    // Same number of files: all in one folder, or 100 per folder in folders of 10 folders each
+    const fs::path root = base / std::to_string(::getpid());
+    const fs::path flat = root / "1";
+    const fs::path wide = root / "2";
+    const size_t folders = std::max<size_t>(1, files / 100);
+    build_fixture_tree(flat, 1, files, false);
+    build_fixture_tree(wide, folders, 100, true);
+
+    std::cout << files << " files in " << base.string() << ": flat is one folder, wide is " << folders << " folders of 100\n";
+    std::cout << std::left << std::setw(10) << "threads" << std::right << std::setw(16) << "flat shared" << std::setw(16) << "flat affinity"
+              << std::setw(16) << "wide shared" << std::setw(16) << "wide affinity" << "   (renames/s)\n";
+    for (unsigned threads = 1; threads <= max_threads; threads *= 2) {
+        std::cout << std::left << std::setw(10) << threads << std::right << std::fixed << std::setprecision(0)
+                  << std::setw(16) << renames_per_second(flat, threads, false, rounds)
+                  << std::setw(16) << renames_per_second(flat, threads, true, rounds)
+                  << std::setw(16) << renames_per_second(wide, threads, false, rounds)
+                  << std::setw(16) << renames_per_second(wide, threads, true, rounds) << std::endl;
+    }
+
+    fs::remove_all(root);
+    return 0;
+}
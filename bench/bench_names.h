@@ -0,0 +1,120 @@
+// SPDX-License-Identifier: GNU General Public License v3.0 or later
+
+// Name corpora shared by the transform benchmark and the differential fuzzer
+
+#ifndef BENCH_NAMES_H
+#define BENCH_NAMES_H
+
+#include <random>
+#include <string>
+#include <vector>
+
+
+// Modes applied by transform_name(), in the order of the help text
+inline const std::vector<std::string> name_modes = {
+    "title", "upper", "lower", "reverse", "snake", "rsnake", "kebab", "rkebab", "camel", "rcamel",
+    "pascal", "rpascal", "sentence", "rsequence", "date", "rdate", "rnumeric", "rbra", "roperand",
+    "rspecial", "swap", "swapr"
+};
+
+// Reference implementation of transform_name(), frozen from the plain per-mode code so an
+// optimized transform can be checked against it byte for byte
+namespace reference {
+bool transform_name(const std::string& case_input, std::string& name, bool isFile);
+}
+
+
+// Function to pick one element of a list
+template <typename T>
+inline const T& pick(const std::vector<T>& items, std::mt19937_64& rng) {
+    return items[std::uniform_int_distribution<size_t>(0, items.size() - 1)(rng)];
+}
+
+
+// Function to build a name from words the way people and cameras name files: words and
+// separators, sometimes a 001_ prefix or a _YYYYMMDD suffix, usually an extension
+inline std::string word_name(const std::vector<std::string>& words, size_t min_words, size_t max_words, std::mt19937_64& rng) {
+    static const std::vector<std::string> separators = {" ", " ", "_", "-", ".", ""};
+    static const std::vector<std::string> extensions = {".jpg", ".JPG", ".txt", ".TXT", ".tar.gz", ".md", ".mkv", "", ""};
+
+    std::string name;
+    if (rng() % 8 == 0) {
+        name += "00" + std::to_string(rng() % 10) + "_";
+    }
+    const size_t count = std::uniform_int_distribution<size_t>(min_words, max_words)(rng);
+    for (size_t i = 0; i < count; ++i) {
+        if (i > 0) name += pick(separators, rng);
+        name += pick(words, rng);
+    }
+    if (rng() % 8 == 0) {
+        name += "_2024" + std::to_string(1000 + rng() % 1000).substr(1) + std::to_string(rng() % 10);
+    }
+    return name + pick(extensions, rng);
+}
+
+
+// Function to generate the short ASCII corpus, typical 10-30 byte names
+inline std::vector<std::string> short_ascii_names(size_t count, std::mt19937_64& rng) {
+    static const std::vector<std::string> words = {
+        "Holiday", "photo", "IMG", "report", "Final", "draft", "my", "file", "Name", "v2", "backup",
+        "Project", "notes", "2024", "data", "Scan", "camelCase", "PascalName", "x", "README"
+    };
+    std::vector<std::string> names;
+    for (size_t i = 0; i < count; ++i) names.push_back(word_name(words, 1, 4, rng));
+    return names;
+}
+
+
+// Function to generate the long name corpus, 100-250 bytes, close to NAME_MAX
+inline std::vector<std::string> long_names(size_t count, std::mt19937_64& rng) {
+    static const std::vector<std::string> words = {
+        "Holiday", "photo", "IMG", "report", "Final", "draft", "my", "file", "Name", "v2", "backup",
+        "Project", "notes", "2024", "data", "Scan", "camelCase", "PascalName", "(copy)", "[1080p]", "x264"
+    };
+    std::vector<std::string> names;
+    for (size_t i = 0; i < count; ++i) names.push_back(word_name(words, 14, 30, rng).substr(0, 250));
+    return names;
+}
+
+
+// Function to generate the UTF-8 corpus, multi-byte letters between ASCII ones
+inline std::vector<std::string> utf8_names(size_t count, std::mt19937_64& rng) {
+    static const std::vector<std::string> words = {
+        "Größe", "Übersicht", "café", "niño", "日本語", "Ελληνικά", "Привет", "naïve", "\xF0\x9F\x98\x80smile",
+        "photo", "Final", "2024"
+    };
+    std::vector<std::string> names;
+    for (size_t i = 0; i < count; ++i) names.push_back(word_name(words, 1, 5, rng));
+    return names;
+}
+
+
+// Function to generate an adversarial name for the fuzzer: random bytes from pools that hit the
+// branches of the transforms (separators, brackets, digits runs, high bytes, path delimiters)
+inline std::string fuzz_name(std::mt19937_64& rng) {
+    static const std::vector<std::string> pools = {
+        "abcdefghijklmnopqrstuvwxyz", "ABCDEFGHIJKLMNOPQRSTUVWXYZ", "0123456789", "0000_",
+        " _-.", "/\\", "[]{}()", "-+<>=*", "@!#$%^&~`';?|,", "\t\n\v\f\r"
+    };
+
+    std::string name;
+    const size_t length = rng() % 16 == 0 ? rng() % 300 : rng() % 40;
+    while (name.size() < length) {
+        const unsigned choice = static_cast<unsigned>(rng() % 24);
+        if (choice < pools.size() * 2) {
+            const std::string& pool = pools[choice % pools.size()];
+            name.push_back(pool[rng() % pool.size()]);
+        } else if (choice == 20) {
+            name.push_back(static_cast<char>(0x80 + rng() % 0x80));
+        } else if (choice == 21) {
+            name += "_" + std::to_string(10000000 + rng() % 90000000);
+        } else if (choice == 22) {
+            name += "00" + std::to_string(rng() % 100) + "_";
+        } else {
+            name += pick(std::vector<std::string>{".txt", ".tar.gz", ".", "..", ".JPG"}, rng);
+        }
+    }
+    return name;
+}
+
+#endif // BENCH_NAMES_H
@@ -0,0 +1,69 @@
+// SPDX-License-Identifier: GNU General Public License v3.0 or later
+
+// Fixture trees and the lower/upper timing loop shared by the engine benches. A tree holds
+// Photo_<n>.Jpg files, mixed case so that lower and upper both rename every entry. It is built
+// below a root named without letters (a pid, "1"), which keeps the input path itself in place.
+
+#ifndef BENCH_TREE_H
+#define BENCH_TREE_H
+
+#include "renamepp.h"
+
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+
+// Function to lay out a tree: folders of files each, directly below the root or ten to a
+// Group<N> folder. add_folder gets each folder and add_file each file, relative to the root.
+template <typename AddFolder, typename AddFile>
+inline void build_fixture_tree(size_t folders, size_t files, bool grouped, AddFolder add_folder, AddFile add_file) {
+    for (size_t d = 0; d < folders; ++d) {
+        const std::string folder = (grouped ? "Group" + std::to_string(d / 10) + "/" : std::string()) + "Folder" + std::to_string(d);
+        add_folder(folder);
+        for (size_t f = 0; f < files; ++f) {
+            add_file(folder + "/Photo_" + std::to_string(f) + ".Jpg");
+        }
+    }
+}
+
+
+// Function to build a tree on disk
+inline void build_fixture_tree(const std::filesystem::path& root, size_t folders, size_t files, bool grouped) {
+    build_fixture_tree(folders, files, grouped,
+        [&](const std::string& folder) { std::filesystem::create_directories(root / folder); },
+        [&](const std::string& file) { std::ofstream(root / file); });
+}
+
+
+// Function to run lower then upper over a tree, rounds times, with the options of the bench.
+// on_pass sees each pass's result; returns the renames per second over all passes and exits
+// on a job error.
+template <typename OnPass>
+inline double time_lower_upper(RenameOptions options, const std::string& root, size_t rounds, OnPass on_pass) {
+    double seconds = 0.0;
+    long renamed = 0;
+    for (size_t round = 0; round < rounds; ++round) {
+        for (const char* mode : {"lower", "upper"}) {
+            options.case_mode = mode;
+            const RenameResult result = RenameEngine(options).run({root});
+            if (!result.error.empty()) {
+                std::cerr << result.error << "\n";
+                std::exit(1);
+            }
+            seconds += result.elapsed_seconds;
+            renamed += result.files_renamed + result.folders_renamed;
+            on_pass(mode, result);
+        }
+    }
+    return seconds > 0.0 ? static_cast<double>(renamed) / seconds : 0.0;
+}
+
+
+inline double time_lower_upper(const RenameOptions& options, const std::string& root, size_t rounds) {
+    return time_lower_upper(options, root, rounds, [](const char*, const RenameResult&) {});
+}
+
+#endif // BENCH_TREE_H
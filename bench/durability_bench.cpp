@@ -0,0 +1,55 @@
+// SPDX-License-Identifier: GNU General Public License v3.0 or later
+
+// Throughput of each --durability level: the engine renames a generated tree lower, then upper,
+// with none, dirs and fs. Run it on the filesystem you care about, tmpfs makes every sync free.
+// Usage: durability_bench [--dir PATH] [--folders N] [--files N] [--rounds N]
+
+#include "bench_tree.h"
+
+#include <cstdlib>
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+
+
+int main(int argc, char* argv[]) {
+    const char* tmpdir = std::getenv("TMPDIR");
+    fs::path base = tmpdir ? tmpdir : "/tmp";
+    size_t folders = 200;
+    size_t files = 100;
+    size_t rounds = 3;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        const std::string arg(argv[i]);
+        if (arg == "--dir") base = argv[i + 1];
+        else if (arg == "--folders") folders = std::strtoul(argv[i + 1], nullptr, 10);
+        else if (arg == "--files") files = std::strtoul(argv[i + 1], nullptr, 10);
+        else if (arg == "--rounds") rounds = std::strtoul(argv[i + 1], nullptr, 10);
+    }
+
+    const fs::path root = base / std::to_string(::getpid());
+    build_fixture_tree(root, folders, files, false);
+
+    const std::vector<std::pair<const char*, RenameDurability>> levels = {
+        {"none", RenameDurability::None}, {"dirs", RenameDurability::Dirs}, {"fs", RenameDurability::Fs}
+    };
+    std::cout << folders << " folders x " << files << " files in " << base.string() << ", " << rounds << " lower/upper rounds\n";
+    std::cout << std::left << std::setw(12) << "durability" << std::right << std::setw(16) << "renames/s" << std::setw(12) << "syncs" << "\n";
+    for (const auto& [name, level] : levels) {
+        RenameOptions options;
+        options.durability = level;
+        long syncs = 0;
+        const double rate = time_lower_upper(options, root.string(), rounds, [&](const char*, const RenameResult& result) {
+            syncs += result.directories_synced + result.filesystems_synced;
+        });
+        std::cout << std::left << std::setw(12) << name << std::right << std::fixed << std::setprecision(0)
+                  << std::setw(16) << rate << std::setw(12) << syncs / static_cast<long>(rounds * 2) << std::endl;
+    }
+
+    fs::remove_all(root);
+    return 0;
+}
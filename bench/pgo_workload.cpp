@@ -0,0 +1,197 @@
+// SPDX-License-Identifier: GNU General Public License v3.0 or later
+
+// Training and timing workload of make pgo: runs the CLI over a generated tree once per step,
+// the main case modes, -ce, -cp, a template, hash and --archive, and prints the time of each
+// step per binary: the user CPU time, the part code layout and branch order change (the kernel's
+// rename time is the same for both, and on a busy machine wall time is mostly noise), plus the
+// wall time of all steps. Names mix camera files, documents, words with spaces, underscores and
+// dashes, numbered prefixes, date suffixes and UTF-8, so every transform takes its usual
+// branches. Each binary gets a fresh copy of the same tree per round; the best round counts.
+// Usage: pgo_workload [--dir PATH] [--folders N] [--files N] [--rounds N] BINARY [BINARY...]
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <spawn.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+
+extern char** environ;
+
+
+static const char* const file_patterns[] = {
+    "IMG_%04zu.JPG", "Holiday Photo %zu.jpeg", "my_document-final (%zu).PDF", "Meeting Notes %zu.txt",
+    "r\xc3\xa9sum\xc3\xa9_\xc3\xbcnic\xc3\xb6" "de_%zu.md", "someCamelCaseName%zu.tar.gz",
+    "A Very Long File Name With Many Words To Transform Number %zu.mkv", "track-%zu - artist_name [live].mp3",
+    "Report_%zu_20240115.xlsx", "%03zu_intro scene.mp4", "index %zu.html", "README %zu.md"
+};
+static const char* const folder_patterns[] = {"Folder %zu", "Project_%zu", "2024 Photos-%zu", "someCamelFolder%zu"};
+
+// A step is one CLI run: its label and the arguments before the path ({tar}/{out} for --archive)
+static const std::vector<std::pair<const char*, std::vector<std::string>>> steps = {
+    {"lower", {"-c", "lower"}}, {"upper", {"-c", "upper"}}, {"title", {"-c", "title"}}, {"sentence", {"-c", "sentence"}},
+    {"camel", {"-c", "camel"}}, {"rcamel", {"-c", "rcamel"}}, {"pascal", {"-c", "pascal"}}, {"rpascal", {"-c", "rpascal"}},
+    {"snake", {"-c", "snake"}}, {"rsnake", {"-c", "rsnake"}}, {"kebab", {"-c", "kebab"}}, {"rkebab", {"-c", "rkebab"}},
+    {"swap", {"-c", "swap"}}, {"swapr", {"-c", "swapr"}}, {"reverse", {"-c", "reverse"}}, {"date", {"-c", "date"}},
+    {"rdate", {"-c", "rdate"}}, {"sequence", {"-c", "sequence"}}, {"rsequence", {"-c", "rsequence"}},
+    {"-ce lower", {"-ce", "lower"}}, {"-ce upper", {"-ce", "upper"}}, {"-cp title", {"-cp", "title"}},
+    {"template", {"-t", "{parent}_{seq:04}_{stem|sentence}.{ext|lower}"}}, {"hash", {"-c", "hash"}},
+    {"--archive", {"--archive", "{tar}", "{out}", "-c", "camel"}}
+};
+
+
+// Function to format a pattern with its number
+static std::string numbered(const char* pattern, size_t n) {
+    char name[256];
+    std::snprintf(name, sizeof(name), pattern, n);
+    return name;
+}
+
+
+// Function to run a program with its output discarded, returns its exit status (-1 when it
+// could not run) and the user CPU time it took
+static int run_quietly(const std::vector<std::string>& args, double* user_ms = nullptr) {
+    std::vector<char*> argv;
+    for (const std::string& arg : args) {
+        argv.push_back(const_cast<char*>(arg.c_str()));
+    }
+    argv.push_back(nullptr);
+
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO, "/dev/null", O_WRONLY, 0);
+    posix_spawn_file_actions_addopen(&actions, STDERR_FILENO, "/dev/null", O_WRONLY, 0);
+    pid_t pid;
+    const int spawned = posix_spawnp(&pid, argv[0], &actions, nullptr, argv.data(), environ);
+    posix_spawn_file_actions_destroy(&actions);
+    if (spawned != 0) {
+        return -1;
+    }
+    int status = 0;
+    struct rusage usage{};
+    if (::wait4(pid, &status, 0, &usage) < 0 || !WIFEXITED(status)) {
+        return -1;
+    }
+    if (user_ms) {
+        *user_ms = usage.ru_utime.tv_sec * 1e3 + usage.ru_utime.tv_usec / 1e3;
+    }
+    return WEXITSTATUS(status);
+}
+
+
+// Function to create the tree: groups of ten folders, each with files of every pattern and a
+// line of content that differs per file (hash names stay unique). Returns false without tar.
+static bool build_tree(const fs::path& root, size_t folders, size_t files, const fs::path& tar) {
+    size_t serial = 0;
+    for (size_t d = 0; d < folders; ++d) {
+        const fs::path folder = root / numbered(folder_patterns[(d / 10) % std::size(folder_patterns)], d / 10) /
+                                numbered(folder_patterns[d % std::size(folder_patterns)], d);
+        fs::create_directories(folder);
+        for (size_t f = 0; f < files; ++f, ++serial) {
+            std::ofstream(folder / numbered(file_patterns[f % std::size(file_patterns)], serial)) << serial << "\n";
+        }
+    }
+    return run_quietly({"tar", "-cf", tar.string(), "-C", root.string(), "."}) == 0;
+}
+
+
+int main(int argc, char* argv[]) {
+    fs::path base = fs::is_directory("/dev/shm") ? "/dev/shm" : fs::temp_directory_path();
+    size_t folders = 200;
+    size_t files = 200;
+    size_t rounds = 3;
+    std::vector<std::string> binaries;
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg(argv[i]);
+        if (arg == "--dir" && i + 1 < argc) base = argv[++i];
+        else if (arg == "--folders" && i + 1 < argc) folders = std::strtoul(argv[++i], nullptr, 10);
+        else if (arg == "--files" && i + 1 < argc) files = std::strtoul(argv[++i], nullptr, 10);
+        else if (arg == "--rounds" && i + 1 < argc) rounds = std::max<size_t>(1, std::strtoul(argv[++i], nullptr, 10));
+        else binaries.push_back(fs::absolute(arg).string());
+    }
+    if (binaries.empty()) {
+        std::cerr << "Usage: pgo_workload [--dir PATH] [--folders N] [--files N] [--rounds N] BINARY [BINARY...]\n";
+        return 2;
+    }
+
+    // The input path is renamed too by -cp, a name without letters keeps it in place
+    const fs::path work = base / ("pgo_workload." + std::to_string(::getpid()));
+    const fs::path root = work / "1";
+    const fs::path tar = work / "tree.tar";
+    const fs::path out = work / "renamed.tar";
+    std::vector<std::vector<double>> best(binaries.size(), std::vector<double>(steps.size(), std::numeric_limits<double>::max()));
+    std::vector<double> best_wall(binaries.size(), std::numeric_limits<double>::max());
+
+    std::cout << folders << " folders x " << files << " files in " << base.string() << ", " << rounds << " round(s)\n";
+    for (size_t round = 0; round < rounds; ++round) {
+        for (size_t b = 0; b < binaries.size(); ++b) {
+            fs::remove_all(work);
+            const bool have_tar = build_tree(root, folders, files, tar);
+            double wall = 0.0;
+            for (size_t s = 0; s < steps.size(); ++s) {
+                std::vector<std::string> args = {binaries[b], "-ni"};
+                for (const std::string& arg : steps[s].second) {
+                    args.push_back(arg == "{tar}" ? tar.string() : (arg == "{out}" ? out.string() : arg));
+                }
+                if (args[2] == "--archive") {
+                    if (!have_tar) continue;
+                    fs::remove(out);
+                } else {
+                    args.push_back(root.string() + "/");
+                }
+
+                double user_ms = 0.0;
+                const auto start = std::chrono::steady_clock::now();
+                const int status = run_quietly(args, &user_ms);
+                wall += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+                if (status != 0) {
+                    std::cerr << binaries[b] << ": step " << steps[s].first << " failed (" << status << ")\n";
+                    fs::remove_all(work);
+                    return 1;
+                }
+                best[b][s] = std::min(best[b][s], user_ms);
+            }
+            best_wall[b] = std::min(best_wall[b], wall);
+        }
+    }
+    fs::remove_all(work);
+
+    for (size_t b = 0; b < binaries.size(); ++b) {
+        std::cout << "[" << b + 1 << "] " << binaries[b] << "\n";
+    }
+    std::cout << std::left << std::setw(12) << "step" << std::right;
+    for (size_t b = 0; b < binaries.size(); ++b) {
+        std::cout << std::setw(10) << "[" + std::to_string(b + 1) + "] user";
+        if (b > 0) std::cout << std::setw(10) << "vs [1]";
+    }
+    std::cout << "\n";
+
+    // Steps, the sum of their user times and the best wall time of a whole round, in ms
+    std::vector<double> totals(binaries.size(), 0.0);
+    for (size_t s = 0; s < steps.size() + 2; ++s) {
+        if (s < steps.size() && best[0][s] == std::numeric_limits<double>::max()) continue;
+        const char* label = s < steps.size() ? steps[s].first : (s == steps.size() ? "total user" : "total wall");
+        std::cout << std::left << std::setw(12) << label << std::right << std::fixed << std::setprecision(1);
+        for (size_t b = 0; b < binaries.size(); ++b) {
+            const double ms = s < steps.size() ? best[b][s] : (s == steps.size() ? totals[b] : best_wall[b]);
+            const double base_ms = s < steps.size() ? best[0][s] : (s == steps.size() ? totals[0] : best_wall[0]);
+            if (s < steps.size()) totals[b] += ms;
+            std::cout << std::setw(10) << ms;
+            if (b > 0) std::cout << std::setw(9) << std::setprecision(2) << (base_ms > 0.0 ? ms / base_ms : 0.0) << "x" << std::setprecision(1);
+        }
+        std::cout << "\n";
+    }
+    return 0;
+}
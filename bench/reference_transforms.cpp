@@ -0,0 +1,209 @@
+// SPDX-License-Identifier: GNU General Public License v3.0 or later
+
+// Reference transforms for the differential fuzzer. Written for clarity, one byte at a time,
+// with the C locale the tool runs in: only ASCII letters and digits have a case or a class.
+// An optimized transform in case_modes.cpp must produce exactly these bytes.
+
+#include "bench_names.h"
+#include "headers.h"
+
+
+namespace reference {
+
+static bool is_upper(char c) { return c >= 'A' && c <= 'Z'; }
+static bool is_lower(char c) { return c >= 'a' && c <= 'z'; }
+static bool is_alpha(char c) { return is_upper(c) || is_lower(c); }
+static bool is_digit(char c) { return c >= '0' && c <= '9'; }
+static bool is_alnum(char c) { return is_alpha(c) || is_digit(c); }
+static bool is_space(char c) { return c == ' ' || (c >= '\t' && c <= '\r'); }
+static char to_upper(char c) { return is_lower(c) ? static_cast<char>(c - 'a' + 'A') : c; }
+static char to_lower(char c) { return is_upper(c) ? static_cast<char>(c - 'A' + 'a') : c; }
+
+
+// Function to tell whether a string is exactly eight digits (a YYYYMMDD stamp)
+static bool is_date(const std::string& text) {
+    if (text.size() != 8) return false;
+    for (char c : text) {
+        if (!is_digit(c)) return false;
+    }
+    return true;
+}
+
+
+// Function to keep the bytes a predicate accepts
+template <typename Keep>
+static std::string filter(const std::string& name, Keep keep) {
+    std::string result;
+    for (char c : name) {
+        if (keep(c)) result += c;
+    }
+    return result;
+}
+
+
+// Function to split a file name at its last dot, the dot stays with the extension
+static void split_extension(const std::string& name, bool isFile, std::string& base, std::string& extension) {
+    const size_t dot = isFile ? name.rfind('.') : std::string::npos;
+    base = dot == std::string::npos ? name : name.substr(0, dot);
+    extension = dot == std::string::npos ? "" : name.substr(dot);
+}
+
+
+// camel and pascal: spaces are dropped and start a capitalized word, other non-alphanumerics
+// are kept and also start one, the extension is left alone
+static std::string join_words(const std::string& name, bool isFile, bool pascal) {
+    std::string base, extension, result;
+    split_extension(name, isFile, base, extension);
+    bool capitalize_next = pascal;
+    bool first_letter = true;
+    for (char c : base) {
+        if (is_alpha(c)) {
+            result += (first_letter && !pascal) ? to_lower(c) : (capitalize_next ? to_upper(c) : to_lower(c));
+            first_letter = false;
+            capitalize_next = false;
+        } else if (c == ' ') {
+            capitalize_next = true;
+        } else {
+            result += c;
+            capitalize_next = !is_alnum(c);
+        }
+    }
+    return result + extension;
+}
+
+
+// rcamel and rpascal: a space before every uppercase letter but the first byte, all lowercase
+static std::string split_words(const std::string& name) {
+    std::string result;
+    for (size_t i = 0; i < name.size(); ++i) {
+        if (i > 0 && is_upper(name[i])) result += ' ';
+        result += to_lower(name[i]);
+    }
+    return result;
+}
+
+
+// swap and swapr: before the last path delimiter every component starts with a forced case and
+// then alternates over its letters, the part after the delimiter is left alone
+static std::string alternate_case(const std::string& name, bool upper_first) {
+    const size_t delimiter = name.find_last_of("/\\");
+    std::string result;
+    bool component_start = true;
+    bool flip = false;
+    for (size_t i = 0; i < name.size(); ++i) {
+        const char c = name[i];
+        if (delimiter != std::string::npos && i >= delimiter) {
+            result += c;
+        } else if (component_start) {
+            result += upper_first ? to_upper(c) : to_lower(c);
+            component_start = false;
+        } else if (is_alpha(c)) {
+            result += (flip == upper_first) ? to_upper(c) : to_lower(c);
+            flip = !flip;
+        } else {
+            result += c;
+            if (c == '/' || c == '\\') {
+                component_start = true;
+                flip = false;
+            }
+        }
+    }
+    return result;
+}
+
+
+// Function to find a _YYYYMMDD stamp of a file name: right before the last dot, or at the end
+// when the last underscore comes after the last dot. Returns npos without one.
+static size_t file_date_position(const std::string& name, size_t& stamp_end) {
+    const size_t dot = name.rfind('.');
+    const size_t underscore = name.rfind('_');
+    if (underscore == std::string::npos) return std::string::npos;
+    stamp_end = (dot != std::string::npos && dot > underscore) ? dot : name.size();
+    return is_date(name.substr(underscore + 1, stamp_end - underscore - 1)) ? underscore : std::string::npos;
+}
+
+
+bool transform_name(const std::string& case_input, std::string& name, bool isFile) {
+    std::string result;
+    if (case_input == "lower") {
+        for (char c : name) result += to_lower(c);
+    } else if (case_input == "upper") {
+        for (char c : name) result += to_upper(c);
+    } else if (case_input == "reverse") {
+        for (char c : name) result += is_lower(c) ? to_upper(c) : to_lower(c);
+    } else if (case_input == "title" || case_input == "sentence") {
+        // title capitalizes the first letter of the name, sentence the first after a space or dot
+        bool capitalize = true;
+        for (char c : name) {
+            result += (capitalize && is_alpha(c)) ? to_upper(c) : to_lower(c);
+            if (is_alpha(c)) capitalize = false;
+            if (case_input == "sentence" && (is_space(c) || c == '.')) capitalize = true;
+        }
+    } else if (case_input == "snake" || case_input == "rsnake" || case_input == "kebab" || case_input == "rkebab") {
+        const char from = case_input == "snake" || case_input == "kebab" ? ' ' : (case_input == "rsnake" ? '_' : '-');
+        const char to = case_input == "snake" ? '_' : (case_input == "kebab" ? '-' : ' ');
+        for (char c : name) result += c == from ? to : c;
+    } else if (case_input == "rspecial") {
+        result = filter(name, [](char c) { return is_alnum(c) || std::string("._-()[]{}+*<> ").find(c) != std::string::npos; });
+    } else if (case_input == "rnumeric") {
+        result = filter(name, [](char c) { return !is_digit(c); });
+    } else if (case_input == "rbra") {
+        result = filter(name, [](char c) { return std::string("[]{}()").find(c) == std::string::npos; });
+    } else if (case_input == "roperand") {
+        result = filter(name, [](char c) { return std::string("-+><=*").find(c) == std::string::npos; });
+    } else if (case_input == "camel" || case_input == "pascal") {
+        result = join_words(name, isFile, case_input == "pascal");
+    } else if (case_input == "rcamel" || case_input == "rpascal") {
+        result = split_words(name);
+    } else if (case_input == "swap" || case_input == "swapr") {
+        result = alternate_case(name, case_input == "swap");
+    } else if (case_input == "rsequence") {
+        result = name;
+        if (isFile) {
+            // Files: "00" and more digits, then an underscore
+            size_t digits = 0;
+            while (digits < name.size() && is_digit(name[digits])) ++digits;
+            if (name.compare(0, 2, "00") == 0 && digits < name.size() && name[digits] == '_') {
+                result = name.substr(digits + 1);
+            }
+        } else {
+            // Folders: any zeros, digits, then an underscore (a bare leading underscore counts)
+            size_t zeros = 0;
+            while (zeros < name.size() && name[zeros] == '0') ++zeros;
+            size_t digits = zeros;
+            while (digits < name.size() && is_digit(name[digits])) ++digits;
+            if (zeros < name.size() && digits < name.size() && name[digits] == '_') {
+                result = name.substr(digits + 1);
+            }
+        }
+    } else if (case_input == "date") {
+        result = name;
+        if (isFile) {
+            size_t stamp_end = 0;
+            if (file_date_position(name, stamp_end) == std::string::npos) {
+                const size_t dot = name.rfind('.');
+                result = dot == std::string::npos ? name + "_" + run_date_stamp()
+                                                  : name.substr(0, dot) + "_" + run_date_stamp() + name.substr(dot);
+            }
+        } else if (!name.empty() && !(name.size() >= 9 && name[name.size() - 9] == '_' && is_date(name.substr(name.size() - 8)))) {
+            result = name + "_" + run_date_stamp();
+        }
+    } else if (case_input == "rdate") {
+        result = name;
+        if (isFile) {
+            size_t stamp_end = 0;
+            const size_t underscore = file_date_position(name, stamp_end);
+            if (underscore != std::string::npos) {
+                result = name.substr(0, underscore) + name.substr(stamp_end);
+            }
+        } else if (name.size() >= 9 && name[name.size() - 9] == '_' && is_date(name.substr(name.size() - 8))) {
+            result = name.substr(0, name.size() - 9);
+        }
+    } else {
+        return false;
+    }
+    name = result;
+    return true;
+}
+
+} // namespace reference
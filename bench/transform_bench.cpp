@@ -0,0 +1,74 @@
+// SPDX-License-Identifier: GNU General Public License v3.0 or later
+
+// Microbenchmark of transform_name(): ns per name for every mode over four corpora.
+// Usage: transform_bench [--min-ms N] [MODE...]
+
+#include "bench_names.h"
+#include "headers.h"
+
+
+// Names per corpus, a few hundred KiB so the corpus stays in cache like a directory batch does
+static constexpr size_t corpus_size = 4096;
+
+
+// Function to time one mode over one corpus, the name buffer is reused like rename_file() does
+static double ns_per_name(const std::string& mode, const std::vector<std::string>& corpus, std::chrono::milliseconds min_time, size_t& sink) {
+    std::string name;
+    size_t rounds = 0;
+    const auto start = std::chrono::steady_clock::now();
+    auto now = start;
+    do {
+        for (const std::string& input : corpus) {
+            name.assign(input);
+            transform_name(mode, name, true);
+            sink += name.size();
+        }
+        ++rounds;
+        now = std::chrono::steady_clock::now();
+    } while (now - start < min_time);
+    return std::chrono::duration<double, std::nano>(now - start).count() / static_cast<double>(rounds * corpus.size());
+}
+
+
+int main(int argc, char* argv[]) {
+    std::chrono::milliseconds min_time{100};
+    std::vector<std::string> modes;
+    // The date modes read today's stamp, which a run takes when it starts
+    reset_date_stamps();
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg(argv[i]);
+        if (arg == "--min-ms" && i + 1 < argc) {
+            min_time = std::chrono::milliseconds(std::strtoul(argv[++i], nullptr, 10));
+        } else {
+            modes.push_back(arg);
+        }
+    }
+    if (modes.empty()) {
+        modes = name_modes;
+    }
+
+    std::mt19937_64 rng(42);
+    const std::vector<std::string> short_corpus = short_ascii_names(corpus_size, rng);
+    const std::vector<std::string> long_corpus = long_names(corpus_size, rng);
+    const std::vector<std::string> utf8_corpus = utf8_names(corpus_size, rng);
+
+    size_t sink = 0;
+    std::cout << std::left << std::setw(12) << "mode" << std::right << std::setw(12) << "short" << std::setw(12) << "long"
+              << std::setw(12) << "utf-8" << std::setw(12) << "conforming" << "   (ns/name)\n";
+    for (const std::string& mode : modes) {
+        // Conforming names already are what the mode produces, the common case of a re-run
+        std::vector<std::string> conforming = short_corpus;
+        for (std::string& name : conforming) {
+            transform_name(mode, name, true);
+        }
+
+        std::cout << std::left << std::setw(12) << mode << std::right << std::fixed << std::setprecision(1)
+                  << std::setw(12) << ns_per_name(mode, short_corpus, min_time, sink)
+                  << std::setw(12) << ns_per_name(mode, long_corpus, min_time, sink)
+                  << std::setw(12) << ns_per_name(mode, utf8_corpus, min_time, sink)
+                  << std::setw(12) << ns_per_name(mode, conforming, min_time, sink) << std::endl;
+    }
+
+    // Keeps the transforms from being optimized away
+    return sink == 0 ? 1 : 0;
+}
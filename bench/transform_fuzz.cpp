@@ -0,0 +1,60 @@
+// SPDX-License-Identifier: GNU General Public License v3.0 or later
+
+// Differential fuzzer: transform_name() against the reference transforms, byte for byte.
+// Usage: transform_fuzz [ITERATIONS] [SEED]
+
+#include "bench_names.h"
+#include "headers.h"
+
+
+// Function to show a name with its control and non-ASCII bytes escaped
+static std::string escaped(const std::string& name) {
+    std::ostringstream out;
+    out << '"';
+    for (unsigned char c : name) {
+        if (c < 0x20 || c >= 0x7f || c == '"' || c == '\\') {
+            out << "\\x" << std::hex << std::setw(2) << std::setfill('0') << static_cast<unsigned>(c) << std::dec;
+        } else {
+            out << c;
+        }
+    }
+    out << '"';
+    return out.str();
+}
+
+
+int main(int argc, char* argv[]) {
+    const unsigned long iterations = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 200000;
+    const unsigned long seed = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 1;
+    std::mt19937_64 rng(seed);
+    // The date modes read today's stamp, which a run takes when it starts
+    reset_date_stamps();
+
+    // Modes outside transform_name() must be refused by both
+    std::vector<std::string> modes = name_modes;
+    modes.insert(modes.end(), {"sequence", "hash", "hash:sha256", "exif", "date:mtime", "date:btime", "bogus", ""});
+
+    std::string actual;
+    std::string expected;
+    for (unsigned long i = 0; i < iterations; ++i) {
+        const std::string name = fuzz_name(rng);
+        for (const std::string& mode : modes) {
+            for (bool isFile : {true, false}) {
+                actual = name;
+                expected = name;
+                const bool applied = transform_name(mode, actual, isFile);
+                const bool reference_applied = reference::transform_name(mode, expected, isFile);
+                if (applied != reference_applied || actual != expected) {
+                    std::cerr << "\033[1;91mMismatch\033[0m in " << mode << (isFile ? " (file)" : " (folder)") << " at iteration " << i << ", seed " << seed << "\n"
+                              << "  input:     " << escaped(name) << "\n"
+                              << "  expected:  " << escaped(expected) << (reference_applied ? "" : " (refused)") << "\n"
+                              << "  actual:    " << escaped(actual) << (applied ? "" : " (refused)") << "\n";
+                    return 1;
+                }
+            }
+        }
+    }
+
+    std::cout << iterations << " names x " << modes.size() << " modes x file/folder: no differences (seed " << seed << ")\n";
+    return 0;
+}
@@ -0,0 +1,184 @@
+// SPDX-License-Identifier: GNU General Public License v3.0 or later
+
+// The engine on an in-memory tree (MemoryVfs): renames a wide tree lower, then upper, and
+// prints the renames per second and the filesystem calls each pass made. No storage is
+// involved, so the numbers are the engine's own; --latency gives every call a fixed cost to
+// see how the walk overlaps them, --fail-every makes every N-th rename fail with EACCES.
+// --check runs a small fixed tree instead, one pass with a failing rename, and exits non-zero
+// when the calls of a pass, its counts or the names it left differ from the expected ones.
+// Usage: vfs_bench [--files N] [--threads N] [--latency-us N] [--fail-every N] [--rounds N]
+//        vfs_bench --check [--threads N]
+
+#include "bench_tree.h"
+#include "vfs.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cerrno>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+
+static const std::pair<VfsOp, const char*> ops[] = {
+    {VfsOp::Stat, "stat"}, {VfsOp::Rename, "rename"}, {VfsOp::List, "list"}, {VfsOp::Open, "open"},
+    {VfsOp::Read, "read"}, {VfsOp::SyncDirectory, "fsync"}, {VfsOp::SyncFilesystem, "syncfs"}
+};
+
+
+// Function to collect the paths below a directory of the tree, sorted
+static void list_tree(MemoryVfs& memory, const std::string& directory, std::vector<std::string>& paths) {
+    struct Listed {
+        std::vector<std::pair<std::string, bool>> entries;
+    } listed;
+    memory.list(directory.c_str(), [](void* context, std::string_view name, unsigned char type, uint64_t) {
+        static_cast<Listed*>(context)->entries.emplace_back(std::string(name), type == DT_DIR);
+    }, &listed);
+    for (const auto& [name, is_dir] : listed.entries) {
+        paths.push_back(directory + name);
+        if (is_dir) {
+            list_tree(memory, directory + name + "/", paths);
+        }
+    }
+    if (directory == "/1/") {
+        std::sort(paths.begin(), paths.end());
+    }
+}
+
+
+// Function to build the grouped fixture tree below /1/ in memory
+static void build_memory_tree(MemoryVfs& memory, size_t folders, size_t files) {
+    build_fixture_tree(folders, files, true,
+        [&](const std::string& folder) { memory.create_directories("/1/" + folder); },
+        [&](const std::string& file) { memory.create_file("/1/" + file); });
+}
+
+
+// Function to run the fixed tree of --check: 12 folders of 10 files in two groups, renamed lower
+// with one file's rename failing, then upper. Returns the number of mismatches.
+static int run_check(unsigned threads) {
+    struct Expected {
+        const char* mode;
+        long files_renamed;
+        long folders_renamed;
+        long stat;
+        long rename;
+        long list;
+    };
+    // Every entry is stat'ed and renamed once (the failing rename is a call too), the input path
+    // is stat'ed three times, it and each folder are listed once
+    static const Expected passes[] = {
+        {"lower", 119, 14, 137, 134, 15},
+        {"upper", 120, 14, 137, 134, 15},
+    };
+    const std::string failing = "/1/group0/folder0/Photo_7.Jpg";
+
+    MemoryVfs memory;
+    build_memory_tree(memory, 12, 10);
+    memory.set_fault([&](VfsOp op, std::string_view path) {
+        return op == VfsOp::Rename && path == failing ? EACCES : 0;
+    });
+
+    int mismatches = 0;
+    auto expect = [&](const char* mode, const char* what, long actual, long expected) {
+        if (actual != expected) {
+            std::cerr << mode << ": " << what << " " << actual << ", expected " << expected << "\n";
+            ++mismatches;
+        }
+    };
+    for (const Expected& pass : passes) {
+        RenameOptions options;
+        options.case_mode = pass.mode;
+        options.threads = threads;
+        options.vfs = &memory;
+        memory.reset_counts();
+        const RenameResult result = RenameEngine(options).run({"/1/"});
+        if (!result.error.empty()) {
+            std::cerr << pass.mode << ": " << result.error << "\n";
+            return mismatches + 1;
+        }
+        expect(pass.mode, "files renamed", result.files_renamed, pass.files_renamed);
+        expect(pass.mode, "folders renamed", result.folders_renamed, pass.folders_renamed);
+        expect(pass.mode, "stat calls", memory.count(VfsOp::Stat), pass.stat);
+        expect(pass.mode, "rename calls", memory.count(VfsOp::Rename), pass.rename);
+        expect(pass.mode, "list calls", memory.count(VfsOp::List), pass.list);
+
+        // Every name in the case of the pass, but the file whose rename failed
+        std::vector<std::string> paths;
+        list_tree(memory, "/1/", paths);
+        expect(pass.mode, "entries", static_cast<long>(paths.size()), 134);
+        const bool upper = pass.mode[0] == 'u';
+        for (const std::string& path : paths) {
+            std::string wanted = path;
+            if (path != failing) {
+                std::transform(wanted.begin(), wanted.end(), wanted.begin(), upper ? ::toupper : ::tolower);
+            }
+            if (path != wanted) {
+                std::cerr << pass.mode << ": " << path << ", expected " << wanted << "\n";
+                ++mismatches;
+            }
+        }
+        memory.set_fault(nullptr);
+    }
+    std::cout << (mismatches == 0 ? "vfs check passed" : "vfs check failed") << " (" << (threads ? std::to_string(threads) : "all") << " thread(s))\n";
+    return mismatches;
+}
+
+
+int main(int argc, char* argv[]) {
+    size_t files = 100000;
+    unsigned threads = 0;
+    long latency_us = 0;
+    long fail_every = 0;
+    size_t rounds = 2;
+    bool check = false;
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg(argv[i]);
+        if (arg == "--check") check = true;
+        else if (i + 1 == argc) break;
+        else if (arg == "--files") files = std::strtoul(argv[++i], nullptr, 10);
+        else if (arg == "--threads") threads = static_cast<unsigned>(std::strtoul(argv[++i], nullptr, 10));
+        else if (arg == "--latency-us") latency_us = std::strtol(argv[++i], nullptr, 10);
+        else if (arg == "--fail-every") fail_every = std::strtol(argv[++i], nullptr, 10);
+        else if (arg == "--rounds") rounds = std::strtoul(argv[++i], nullptr, 10);
+    }
+    if (check) {
+        return run_check(threads) == 0 ? 0 : 1;
+    }
+
+    // 100 files per folder in folders of 10 folders each
+    MemoryVfs memory;
+    const size_t folders = std::max<size_t>(1, files / 100);
+    build_memory_tree(memory, folders, 100);
+    for (const auto& [op, name] : ops) {
+        memory.set_latency(op, std::chrono::microseconds(latency_us));
+    }
+    std::atomic<long> renames{0};
+    if (fail_every > 0) {
+        memory.set_fault([&](VfsOp op, std::string_view) {
+            return op == VfsOp::Rename && ++renames % fail_every == 0 ? EACCES : 0;
+        });
+    }
+
+    std::cout << folders * 100 << " in-memory files in " << folders << " folders, latency " << latency_us << " us per call\n";
+    RenameOptions options;
+    options.threads = threads;
+    options.vfs = &memory;
+    memory.reset_counts();
+    time_lower_upper(options, "/1/", rounds, [&](const char* mode, const RenameResult& result) {
+        const long renamed = result.files_renamed + result.folders_renamed;
+        std::cout << std::left << std::setw(6) << mode << std::right << std::fixed << std::setprecision(0)
+                  << std::setw(12) << (result.elapsed_seconds > 0.0 ? renamed / result.elapsed_seconds : 0.0) << " renames/s  ";
+        for (const auto& [op, name] : ops) {
+            if (memory.count(op) > 0) {
+                std::cout << " " << name << "=" << memory.count(op);
+            }
+        }
+        std::cout << "\n";
+        memory.reset_counts();
+    });
+    return 0;
+}
@@ -0,0 +1,84 @@
+/* SPDX-License-Identifier: GNU General Public License v3.0 or later */
+
+/* Example transform plugin (make plugin-example, then --plugin obj/plugins/ascii_plugin.so):
+ *   ascii    replace bytes outside printable ASCII with '_' (e.g., Café.txt => Caf__.txt)
+ *   squeeze  collapse runs of spaces, '_' and '-' into one '_' (e.g., Te  -_st => Te_st)
+ * Both write the whole batch into the arena in one pass and keep the names they do not change.
+ */
+
+#include "renamepp_plugin.h"
+
+#include <string.h>
+
+static const char* const modes[] = {"ascii", "squeeze", NULL};
+
+enum { MODE_ASCII, MODE_SQUEEZE };
+
+
+static int is_separator(char c) {
+    return c == ' ' || c == '_' || c == '-';
+}
+
+
+static int transform(void* worker, uint32_t mode, int is_file, const renamepp_slice* names, size_t count,
+                     char* arena, size_t arena_size, renamepp_slice* out, size_t* arena_needed) {
+    (void)worker;
+    (void)is_file;
+
+    /* Neither mode makes a name longer, the input size bounds the output */
+    size_t total = 0;
+    for (size_t i = 0; i < count; ++i) {
+        total += names[i].size;
+    }
+    if (total > arena_size) {
+        *arena_needed = total;
+        return RENAMEPP_ARENA_FULL;
+    }
+
+    char* next = arena;
+    for (size_t i = 0; i < count; ++i) {
+        const unsigned char* name = (const unsigned char*)names[i].data;
+        const size_t size = names[i].size;
+        size_t length = 0;
+        if (mode == MODE_ASCII) {
+            for (size_t j = 0; j < size; ++j) {
+                next[j] = (name[j] >= 0x20 && name[j] < 0x7f) ? (char)name[j] : '_';
+            }
+            length = size;
+        } else if (mode == MODE_SQUEEZE) {
+            for (size_t j = 0; j < size; ++j) {
+                if (!is_separator((char)name[j])) {
+                    next[length++] = (char)name[j];
+                } else if (j == 0 || !is_separator((char)name[j - 1])) {
+                    next[length++] = '_';
+                }
+            }
+        } else {
+            return RENAMEPP_FAILED;
+        }
+
+        if (length == size && memcmp(next, name, size) == 0) {
+            out[i].data = NULL;
+            out[i].size = 0;
+        } else {
+            out[i].data = next;
+            out[i].size = length;
+            next += length;
+        }
+    }
+    return RENAMEPP_OK;
+}
+
+
+static const renamepp_plugin plugin = {
+    RENAMEPP_PLUGIN_ABI,
+    modes,
+    NULL,
+    NULL,
+    transform
+};
+
+
+const renamepp_plugin* renamepp_plugin_v1(void) {
+    return &plugin;
+}
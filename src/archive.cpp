@@ -0,0 +1,1053 @@
+// SPDX-License-Identifier: GNU General Public License v3.0 or later
+
+#include "headers.h"
+#include "renamepp.h"
+
+
+// Archive member renaming (--archive): the members of a tar or zip archive are written to a
+// new archive under the names a -c mode gives them. Only the headers are parsed and rebuilt,
+// member data goes from one file to the other with copy_file_range (splice for pipes), so the
+// kernel moves it without a round trip through user space and can share extents (reflinks).
+
+// Buffer of the headers and small members on either side
+static constexpr size_t archive_buffer_size = 1 << 20;
+// Member data from this size on is copied by the kernel, below it the buffers are cheaper
+static constexpr uint64_t direct_copy_min = 64 << 10;
+// Largest single copy_file_range/splice call
+static constexpr size_t direct_copy_chunk = 1 << 30;
+// Long names and pax headers are read into memory, anything larger is not a name
+static constexpr uint64_t max_name_record = 1 << 20;
+
+static constexpr size_t tar_block = 512;
+
+
+// Archive writer: headers are buffered, member data is copied from the input fd by the kernel
+class ArchiveOutput {
+public:
+    explicit ArchiveOutput(int fd) : fd_(fd) {
+        buffer_.reserve(archive_buffer_size);
+    }
+
+    uint64_t offset() const { return written_ + buffer_.size(); }
+
+    bool write(const void* data, size_t size) {
+        if (buffer_.size() + size > archive_buffer_size && !flush()) {
+            return false;
+        }
+        if (size >= archive_buffer_size) {
+            return write_all(data, size);
+        }
+        const char* bytes = static_cast<const char*>(data);
+        buffer_.insert(buffer_.end(), bytes, bytes + size);
+        return true;
+    }
+
+    bool write_zeros(size_t size) {
+        static const char zeros[tar_block] = {};
+        for (; size > 0; size -= std::min(size, sizeof(zeros))) {
+            if (!write(zeros, std::min(size, sizeof(zeros)))) return false;
+        }
+        return true;
+    }
+
+    bool flush() {
+        if (!write_all(buffer_.data(), buffer_.size())) {
+            return false;
+        }
+        buffer_.clear();
+        return true;
+    }
+
+    // Function to copy length bytes of in_fd, from *offset (advanced) or from its file position
+    // when offset is nullptr. errno is 0 when the input ended first.
+    bool copy_from(int in_fd, off64_t* offset, uint64_t length) {
+        if (length < direct_copy_min) {
+            return bounce(in_fd, offset, length);
+        }
+        if (!flush()) {
+            return false;
+        }
+        while (length > 0) {
+            const size_t chunk = static_cast<size_t>(std::min<uint64_t>(length, direct_copy_chunk));
+            ssize_t copied;
+            if (copy_file_range_ok_) {
+                copied = ::copy_file_range(in_fd, offset, fd_, nullptr, chunk, 0);
+                // Pipes, filesystems without it and cross-filesystem copies on older kernels
+                if (copied < 0 && (errno == EINVAL || errno == EXDEV || errno == ENOSYS || errno == EOPNOTSUPP || errno == EBADF)) {
+                    copy_file_range_ok_ = false;
+                    continue;
+                }
+            } else if (splice_ok_) {
+                copied = ::splice(in_fd, offset, fd_, nullptr, chunk, SPLICE_F_MOVE);
+                // Neither end is a pipe
+                if (copied < 0 && errno == EINVAL) {
+                    splice_ok_ = false;
+                    continue;
+                }
+            } else {
+                if (!bounce(in_fd, offset, std::min<uint64_t>(length, archive_buffer_size)) || !flush()) {
+                    return false;
+                }
+                length -= std::min<uint64_t>(length, archive_buffer_size);
+                continue;
+            }
+            if (copied < 0) {
+                if (errno == EINTR) continue;
+                return false;
+            }
+            if (copied == 0) {
+                errno = 0;
+                return false;
+            }
+            written_ += static_cast<uint64_t>(copied);
+            length -= static_cast<uint64_t>(copied);
+        }
+        return true;
+    }
+
+private:
+    bool write_all(const void* data, size_t size) {
+        const char* bytes = static_cast<const char*>(data);
+        while (size > 0) {
+            const ssize_t done = ::write(fd_, bytes, size);
+            if (done < 0) {
+                if (errno == EINTR) continue;
+                return false;
+            }
+            bytes += done;
+            size -= static_cast<size_t>(done);
+            written_ += static_cast<uint64_t>(done);
+        }
+        return true;
+    }
+
+    // Function to copy through the buffer, length fits in it
+    bool bounce(int in_fd, off64_t* offset, uint64_t length) {
+        if (buffer_.size() + length > archive_buffer_size && !flush()) {
+            return false;
+        }
+        const size_t start = buffer_.size();
+        buffer_.resize(start + static_cast<size_t>(length));
+        size_t have = 0;
+        while (have < length) {
+            const ssize_t got = offset ? ::pread(in_fd, buffer_.data() + start + have, length - have, *offset)
+                                       : ::read(in_fd, buffer_.data() + start + have, length - have);
+            if (got < 0 && errno == EINTR) continue;
+            if (got <= 0) {
+                buffer_.resize(start);
+                if (got == 0) errno = 0;
+                return false;
+            }
+            have += static_cast<size_t>(got);
+            if (offset) *offset += got;
+        }
+        return true;
+    }
+
+    int fd_;
+    std::vector<char> buffer_;
+    uint64_t written_ = 0;
+    bool copy_file_range_ok_ = true;
+    bool splice_ok_ = true;
+};
+
+
+// Sequential archive reader for tar, works on pipes. Headers come out of the buffer, the data
+// of large members is left to ArchiveOutput::copy_from.
+class ArchiveInput {
+public:
+    explicit ArchiveInput(int fd) : fd_(fd), buffer_(archive_buffer_size) {}
+
+    // Function to get the next size bytes without consuming them, nullptr when fewer are left
+    const unsigned char* peek(size_t size) {
+        while (end_ - pos_ < size) {
+            if (!fill()) return nullptr;
+        }
+        return reinterpret_cast<const unsigned char*>(buffer_.data() + pos_);
+    }
+
+    // Function to read size bytes, returns how many there were before the end of the input
+    size_t read(void* data, size_t size) {
+        size_t have = 0;
+        while (have < size) {
+            if (pos_ == end_ && !fill()) break;
+            const size_t take = std::min(size - have, end_ - pos_);
+            std::memcpy(static_cast<char*>(data) + have, buffer_.data() + pos_, take);
+            pos_ += take;
+            have += take;
+        }
+        return have;
+    }
+
+    // Function to pass length bytes on to the output
+    bool copy_to(ArchiveOutput& out, uint64_t length) {
+        const size_t buffered = static_cast<size_t>(std::min<uint64_t>(length, end_ - pos_));
+        if (!out.write(buffer_.data() + pos_, buffered)) {
+            return false;
+        }
+        pos_ += buffered;
+        length -= buffered;
+        if (length >= direct_copy_min) {
+            return out.copy_from(fd_, nullptr, length);
+        }
+        while (length > 0) {
+            if (pos_ == end_ && !fill()) {
+                return false;
+            }
+            const size_t take = static_cast<size_t>(std::min<uint64_t>(length, end_ - pos_));
+            if (!out.write(buffer_.data() + pos_, take)) {
+                return false;
+            }
+            pos_ += take;
+            length -= take;
+        }
+        return true;
+    }
+
+    // Function to pass everything left on to the output
+    bool copy_rest(ArchiveOutput& out) {
+        do {
+            if (!out.write(buffer_.data() + pos_, end_ - pos_)) {
+                return false;
+            }
+            pos_ = end_;
+        } while (fill());
+        return errno == 0;
+    }
+
+private:
+    // Function to read more input behind what is buffered, false at the end (errno 0) or on errors
+    bool fill() {
+        if (pos_ > 0) {
+            std::memmove(buffer_.data(), buffer_.data() + pos_, end_ - pos_);
+            end_ -= pos_;
+            pos_ = 0;
+        }
+        for (;;) {
+            const ssize_t got = ::read(fd_, buffer_.data() + end_, buffer_.size() - end_);
+            if (got < 0 && errno == EINTR) continue;
+            if (got <= 0) {
+                if (got == 0) errno = 0;
+                return false;
+            }
+            end_ += static_cast<size_t>(got);
+            return true;
+        }
+    }
+
+    int fd_;
+    std::vector<char> buffer_;
+    size_t pos_ = 0;
+    size_t end_ = 0;
+};
+
+
+// The mode of an archive job applied to member paths. Every member below a folder repeats its
+// name, so folder names are transformed once and cached.
+class MemberRenamer {
+public:
+    MemberRenamer(const RenameOptions& options, RenameResult& result) : options_(options), result_(result) {}
+
+    bool init(std::string& error) {
+        transform_ = name_transform(options_.case_mode);
+        plugin_ = transform_ ? nullptr : find_plugin_mode(options_.case_mode);
+        if (!transform_ && !plugin_) {
+            error = "Mode " + options_.case_mode + " needs the files on disk, archive members take the modes that only change names";
+            return false;
+        }
+        return true;
+    }
+
+    // Function to map a path to its new name, components of folders are folder names and the
+    // last one of anything else a file name. Returns false when it keeps its name.
+    bool map_path(std::string_view path, bool is_directory, bool is_symlink, std::string& new_path) {
+        new_path.clear();
+        size_t pos = 0;
+        while (pos < path.size()) {
+            const size_t slash = std::min(path.find('/', pos), path.size());
+            const size_t next = std::min(path.find_first_not_of('/', slash), path.size());
+            const std::string_view component = path.substr(pos, slash - pos);
+            const bool is_file = next == path.size() && !is_directory;
+            const bool renamed = is_file ? options_.rename_files && (!is_symlink || options_.follow_symlinks) : options_.rename_folders;
+            if (renamed && !component.empty() && component != "." && component != "..") {
+                append_name(component, is_file, new_path);
+            } else {
+                new_path += component;
+            }
+            new_path += path.substr(slash, next - slash);
+            pos = next;
+        }
+        return new_path != path;
+    }
+
+    // Function to rename a member, counted and reported like the entries of a directory walk
+    bool rename_member(std::string_view path, bool is_directory, bool is_symlink, std::string& new_path) {
+        const bool renamed = map_path(path, is_directory, is_symlink, new_path);
+        if (renamed) {
+            ++(is_directory ? result_.folders_renamed : result_.files_renamed);
+            if (options_.report_renamed) {
+                print_verbose_enabled(std::string(is_directory ? "\033[0m\033[92mRenamed \033[94mfolder\033[0m " : "\033[0m\033[92mRenamed\033[0m file ") +
+                                      std::string(path) + "\e[1;38;5;214m -> \033[0m" + new_path, std::cout);
+            }
+            return true;
+        }
+        ++(is_directory ? result_.folders_skipped : result_.files_skipped);
+        if (options_.report_skipped) {
+            if (is_symlink && !options_.follow_symlinks) {
+                print_verbose_enabled("\033[0m\033[93mSkipped\033[0m \033[95msymlink_file\033[0m " + std::string(path) + " (excluded)", std::cout);
+            } else {
+                print_verbose_enabled(std::string(is_directory ? "\033[0m\033[93mSkipped\033[0m\033[94m folder\033[0m " : "\033[0m\033[93mSkipped\033[0m file ") +
+                                      std::string(path) + " (name unchanged)", std::cout);
+            }
+        }
+        return false;
+    }
+
+private:
+    // Function to append the new name of one component, a name the mode empties or breaks
+    // stays as it is
+    void append_name(std::string_view component, bool is_file, std::string& out) {
+        if (!is_file) {
+            const auto cached = folder_names_.find(std::string(component));
+            if (cached != folder_names_.end()) {
+                out += cached->second;
+                return;
+            }
+        }
+        name_.assign(component);
+        if (transform_) {
+            cached_transform(transform_, name_, is_file);
+        } else {
+            plugin_transform(*plugin_, name_, is_file);
+        }
+        if (name_.empty() || name_ == "." || name_ == ".." || name_.find('/') != std::string::npos || name_.find('\0') != std::string::npos) {
+            name_.assign(component);
+        }
+        if (!is_file) {
+            folder_names_.emplace(std::string(component), name_);
+        }
+        out += name_;
+    }
+
+    const RenameOptions& options_;
+    RenameResult& result_;
+    NameTransform transform_ = nullptr;
+    const PluginMode* plugin_ = nullptr;
+    std::unordered_map<std::string, std::string> folder_names_;
+    std::string name_;
+};
+
+
+// tar
+
+enum class TarFormat { V7, Ustar, Gnu };
+
+// Header field offsets and sizes
+static constexpr size_t tar_name = 0, tar_name_size = 100;
+static constexpr size_t tar_size = 124, tar_size_size = 12;
+static constexpr size_t tar_checksum = 148, tar_checksum_size = 8;
+static constexpr size_t tar_type = 156;
+static constexpr size_t tar_link = 157, tar_link_size = 100;
+static constexpr size_t tar_magic = 257;
+static constexpr size_t tar_prefix = 345, tar_prefix_size = 155;
+
+
+// Function to read a NUL-terminated header field
+static std::string_view tar_string(const unsigned char* header, size_t offset, size_t size) {
+    const char* field = reinterpret_cast<const char*>(header) + offset;
+    return std::string_view(field, strnlen(field, size));
+}
+
+
+// Function to read a numeric header field, octal or GNU base-256 for large values
+static bool tar_number(const unsigned char* header, size_t offset, size_t size, uint64_t& value) {
+    const unsigned char* field = header + offset;
+    value = 0;
+    if (field[0] & 0x80) {
+        for (size_t i = 1; i < size; ++i) {
+            if (value >> 56) return false;
+            value = (value << 8) | field[i];
+        }
+        return (field[0] & 0x7f) == 0;
+    }
+    size_t i = 0;
+    while (i < size && field[i] == ' ') ++i;
+    for (; i < size && field[i] >= '0' && field[i] <= '7'; ++i) {
+        value = (value << 3) | static_cast<uint64_t>(field[i] - '0');
+    }
+    return i == size || field[i] == '\0' || field[i] == ' ';
+}
+
+
+// Function to write a numeric field as size - 1 octal digits and a NUL
+static void tar_set_number(unsigned char* header, size_t offset, size_t size, uint64_t value) {
+    for (size_t i = size - 1; i-- > 0; value >>= 3) {
+        header[offset + i] = static_cast<unsigned char>('0' + (value & 7));
+    }
+    header[offset + size - 1] = '\0';
+}
+
+
+// Function to check a header checksum, old writers summed signed bytes
+static bool tar_checksum_ok(const unsigned char* header) {
+    uint64_t stored;
+    if (!tar_number(header, tar_checksum, tar_checksum_size, stored)) {
+        return false;
+    }
+    uint64_t sum = 0;
+    int64_t signed_sum = 0;
+    for (size_t i = 0; i < tar_block; ++i) {
+        const bool in_field = i >= tar_checksum && i < tar_checksum + tar_checksum_size;
+        sum += in_field ? ' ' : header[i];
+        signed_sum += in_field ? ' ' : static_cast<signed char>(header[i]);
+    }
+    return stored == sum || static_cast<int64_t>(stored) == signed_sum;
+}
+
+
+// Function to seal a header after its fields changed
+static void tar_set_checksum(unsigned char* header) {
+    std::memset(header + tar_checksum, ' ', tar_checksum_size);
+    uint64_t sum = 0;
+    for (size_t i = 0; i < tar_block; ++i) {
+        sum += header[i];
+    }
+    tar_set_number(header, tar_checksum, 7, sum);
+    header[tar_checksum + 7] = ' ';
+}
+
+
+static TarFormat tar_format(const unsigned char* header) {
+    if (std::memcmp(header + tar_magic, "ustar\0", 6) == 0) return TarFormat::Ustar;
+    if (std::memcmp(header + tar_magic, "ustar  \0", 8) == 0) return TarFormat::Gnu;
+    return TarFormat::V7;
+}
+
+
+// Function to put a path into the name fields of a header, ustar splits long ones at a slash
+// into prefix and name. Returns false when it does not fit, the name field gets its start.
+static bool tar_set_path(unsigned char* header, size_t offset, size_t size, std::string_view path, TarFormat format) {
+    const bool has_prefix = offset == tar_name && format == TarFormat::Ustar;
+    std::string_view name = path;
+    std::string_view prefix;
+    if (path.size() > size && has_prefix) {
+        // The first slash leaving at most 100 bytes behind it, with something behind it
+        for (size_t slash = path.find('/', path.size() > size + 1 ? path.size() - size - 1 : 0);
+             slash != std::string_view::npos && slash <= tar_prefix_size; slash = path.find('/', slash + 1)) {
+            if (slash + 1 < path.size()) {
+                prefix = path.substr(0, slash);
+                name = path.substr(slash + 1);
+                break;
+            }
+        }
+    }
+    const bool fits = name.size() <= size;
+    std::memset(header + offset, 0, size);
+    std::memcpy(header + offset, name.data(), std::min(name.size(), size));
+    if (has_prefix) {
+        std::memset(header + tar_prefix, 0, tar_prefix_size);
+        std::memcpy(header + tar_prefix, prefix.data(), prefix.size());
+    }
+    return fits;
+}
+
+
+// Function to find a pax record, "LENGTH key=value\n"
+static bool pax_value(std::string_view data, std::string_view key, std::string& value) {
+    size_t pos = 0;
+    while (pos < data.size()) {
+        size_t length = 0;
+        const auto [end, error] = std::from_chars(data.data() + pos, data.data() + data.size(), length);
+        const size_t space = static_cast<size_t>(end - data.data());
+        if (error != std::errc() || length == 0 || pos + length > data.size() || space >= pos + length || data[space] != ' ') {
+            return false;
+        }
+        const std::string_view record = data.substr(space + 1, pos + length - space - 2);
+        const size_t equals = record.find('=');
+        if (equals != std::string_view::npos && record.substr(0, equals) == key) {
+            value.assign(record.substr(equals + 1));
+            return true;
+        }
+        pos += length;
+    }
+    return false;
+}
+
+
+// Function to set a pax record, replacing the one with the same key
+static void set_pax_value(std::string& data, std::string_view key, std::string_view value) {
+    std::string rebuilt;
+    size_t pos = 0;
+    while (pos < data.size()) {
+        size_t length = 0;
+        const auto [end, error] = std::from_chars(data.data() + pos, data.data() + data.size(), length);
+        const size_t space = static_cast<size_t>(end - data.data());
+        if (error != std::errc() || length == 0 || pos + length > data.size() || space >= pos + length) {
+            break;
+        }
+        const std::string_view record(data.data() + space + 1, pos + length - space - 1);
+        if (record.substr(0, key.size()) != key || record.size() <= key.size() || record[key.size()] != '=') {
+            rebuilt.append(data, pos, length);
+        }
+        pos += length;
+    }
+    // The length counts its own digits
+    const size_t body = key.size() + value.size() + 3;
+    size_t length = body + std::to_string(body).size();
+    length = body + std::to_string(length).size();
+    rebuilt += std::to_string(length) + ' ' + std::string(key) + '=' + std::string(value) + '\n';
+    data = std::move(rebuilt);
+}
+
+
+// Function to write a header and its data, padded to whole blocks
+static bool write_tar_record(ArchiveOutput& out, unsigned char* header, std::string_view data) {
+    tar_set_number(header, tar_size, tar_size_size, data.size());
+    tar_set_checksum(header);
+    return out.write(header, tar_block) && out.write(data.data(), data.size()) &&
+           out.write_zeros((tar_block - data.size() % tar_block) % tar_block);
+}
+
+
+// Function to make the header of a long-name record for an entry that had none: pax for
+// POSIX archives, GNU ././@LongLink for the others
+static void new_name_header(unsigned char* header, const unsigned char* entry, char type) {
+    std::memset(header, 0, tar_block);
+    if (type == 'x') {
+        std::memcpy(header + tar_name, "././@PaxHeader", 14);
+        std::memcpy(header + tar_magic, "ustar\0" "00", 8);
+        std::memcpy(header + 108, entry + 108, 16);        // uid, gid
+        std::memcpy(header + 136, entry + 136, 12);        // mtime
+    } else {
+        std::memcpy(header + tar_name, "././@LongLink", 13);
+        std::memcpy(header + tar_magic, "ustar  \0", 8);
+        tar_set_number(header, 108, 8, 0);
+        tar_set_number(header, 116, 8, 0);
+        tar_set_number(header, 136, 12, 0);
+    }
+    tar_set_number(header, 100, 8, 0644);
+    header[tar_type] = static_cast<unsigned char>(type);
+}
+
+
+// Records that describe the next entry, they are rewritten along with it
+struct TarPending {
+    bool pax = false;
+    unsigned char pax_header[tar_block];
+    std::string pax_data;
+    bool long_name = false;
+    unsigned char long_name_header[tar_block];
+    std::string long_name_data;
+    bool long_link = false;
+    unsigned char long_link_header[tar_block];
+    std::string long_link_data;
+};
+
+
+// Function to rewrite a tar archive member by member
+static bool rename_tar(ArchiveInput& in, ArchiveOutput& out, MemberRenamer& renamer, std::string& error) {
+    unsigned char header[tar_block];
+    TarPending pending;
+    std::string path;
+    std::string link;
+    std::string new_path;
+    std::string new_link;
+    uint64_t offset = 0;
+
+    for (;;) {
+        if (interrupt_requested.load(std::memory_order_relaxed)) {
+            return false;
+        }
+        const size_t got = in.read(header, tar_block);
+        if (got == 0) {
+            // No end-of-archive blocks, like tar accept it
+            return errno == 0 || (error = std::strerror(errno), false);
+        }
+        if (got < tar_block) {
+            error = "Truncated tar header at offset " + std::to_string(offset);
+            return false;
+        }
+        if (std::all_of(header, header + tar_block, [](unsigned char c) { return c == 0; })) {
+            // End of archive, the zero blocks and any padding behind them are kept
+            if (!out.write(header, tar_block) || !in.copy_rest(out)) {
+                error = std::strerror(errno);
+                return false;
+            }
+            return true;
+        }
+        uint64_t size;
+        if (!tar_checksum_ok(header) || !tar_number(header, tar_size, tar_size_size, size)) {
+            error = "Not a tar archive or a damaged header at offset " + std::to_string(offset);
+            return false;
+        }
+        const uint64_t padded = (size + tar_block - 1) / tar_block * tar_block;
+        offset += tar_block + padded;
+        const char type = static_cast<char>(header[tar_type]);
+
+        // Long names and pax headers are held until the entry they describe
+        if (type == 'x' || type == 'L' || type == 'K') {
+            if (size > max_name_record) {
+                error = "Oversized name record at offset " + std::to_string(offset - tar_block - padded);
+                return false;
+            }
+            bool& present = type == 'x' ? pending.pax : (type == 'L' ? pending.long_name : pending.long_link);
+            unsigned char* saved = type == 'x' ? pending.pax_header : (type == 'L' ? pending.long_name_header : pending.long_link_header);
+            std::string& data = type == 'x' ? pending.pax_data : (type == 'L' ? pending.long_name_data : pending.long_link_data);
+            data.resize(static_cast<size_t>(padded));
+            if (in.read(data.data(), data.size()) != data.size()) {
+                error = "Truncated tar archive at offset " + std::to_string(offset);
+                return false;
+            }
+            data.resize(static_cast<size_t>(size));
+            if (type != 'x') {
+                data.resize(strnlen(data.data(), data.size()));
+            }
+            std::memcpy(saved, header, tar_block);
+            present = true;
+            continue;
+        }
+
+        // Global pax headers and volume labels carry no member name
+        if (type == 'g' || type == 'V') {
+            if (!out.write(header, tar_block) || !in.copy_to(out, padded)) {
+                error = errno ? std::strerror(errno) : "Truncated tar archive";
+                return false;
+            }
+            continue;
+        }
+
+        const TarFormat format = tar_format(header);
+        if (!(pending.pax && pax_value(pending.pax_data, "path", path))) {
+            if (pending.long_name) {
+                path = pending.long_name_data;
+            } else {
+                path.assign(tar_string(header, tar_name, tar_name_size));
+                const std::string_view prefix = format == TarFormat::Ustar ? tar_string(header, tar_prefix, tar_prefix_size) : std::string_view();
+                if (!prefix.empty()) {
+                    path = std::string(prefix) + '/' + path;
+                }
+            }
+        }
+        const bool is_directory = type == '5' || type == 'D' || (!path.empty() && path.back() == '/');
+        const bool renamed = renamer.rename_member(path, is_directory, type == '2', new_path);
+
+        // A hard link names another member, it follows that member's new name
+        bool relinked = false;
+        if (type == '1') {
+            if (!(pending.pax && pax_value(pending.pax_data, "linkpath", link))) {
+                link.assign(pending.long_link ? std::string_view(pending.long_link_data) : tar_string(header, tar_link, tar_link_size));
+            }
+            relinked = renamer.map_path(link, false, false, new_link);
+        }
+
+        if (renamed) {
+            const bool fits = tar_set_path(header, tar_name, tar_name_size, new_path, format);
+            std::string scratch;
+            if (pending.pax && (!fits || pax_value(pending.pax_data, "path", scratch))) {
+                set_pax_value(pending.pax_data, "path", new_path);
+            } else if (pending.long_name || !fits) {
+                if (!pending.long_name && format == TarFormat::Ustar) {
+                    new_name_header(pending.pax_header, header, 'x');
+                    pending.pax_data.clear();
+                    set_pax_value(pending.pax_data, "path", new_path);
+                    pending.pax = true;
+                } else {
+                    if (!pending.long_name) new_name_header(pending.long_name_header, header, 'L');
+                    pending.long_name_data = new_path;
+                    pending.long_name = true;
+                }
+            }
+        }
+        if (relinked) {
+            const bool fits = tar_set_path(header, tar_link, tar_link_size, new_link, format);
+            std::string scratch;
+            if (pending.pax && (!fits || pax_value(pending.pax_data, "linkpath", scratch))) {
+                set_pax_value(pending.pax_data, "linkpath", new_link);
+            } else if (pending.long_link || !fits) {
+                if (!pending.long_link && format == TarFormat::Ustar) {
+                    if (!pending.pax) {
+                        new_name_header(pending.pax_header, header, 'x');
+                        pending.pax_data.clear();
+                        pending.pax = true;
+                    }
+                    set_pax_value(pending.pax_data, "linkpath", new_link);
+                } else {
+                    if (!pending.long_link) new_name_header(pending.long_link_header, header, 'K');
+                    pending.long_link_data = new_link;
+                    pending.long_link = true;
+                }
+            }
+        }
+
+        // GNU long names are stored with their NUL
+        bool written = (!pending.pax || write_tar_record(out, pending.pax_header, pending.pax_data)) &&
+                       (!pending.long_link || write_tar_record(out, pending.long_link_header, std::string_view(pending.long_link_data.c_str(), pending.long_link_data.size() + 1))) &&
+                       (!pending.long_name || write_tar_record(out, pending.long_name_header, std::string_view(pending.long_name_data.c_str(), pending.long_name_data.size() + 1)));
+        if (renamed || relinked) {
+            tar_set_checksum(header);
+        }
+        written = written && out.write(header, tar_block) && in.copy_to(out, padded);
+        if (!written) {
+            error = errno ? std::strerror(errno) : "Truncated tar archive at offset " + std::to_string(offset);
+            return false;
+        }
+        pending.pax = pending.long_name = pending.long_link = false;
+    }
+}
+
+
+// zip
+
+static uint16_t le16(const unsigned char* p) { return static_cast<uint16_t>(p[0] | (p[1] << 8)); }
+static uint32_t le32(const unsigned char* p) { return le16(p) | (static_cast<uint32_t>(le16(p + 2)) << 16); }
+static uint64_t le64(const unsigned char* p) { return le32(p) | (static_cast<uint64_t>(le32(p + 4)) << 32); }
+
+static void set_le(unsigned char* p, uint64_t value, size_t bytes) {
+    for (size_t i = 0; i < bytes; ++i, value >>= 8) {
+        p[i] = static_cast<unsigned char>(value & 0xff);
+    }
+}
+
+static constexpr uint32_t zip_local_signature = 0x04034b50;
+static constexpr uint32_t zip_central_signature = 0x02014b50;
+static constexpr uint32_t zip_end_signature = 0x06054b50;
+static constexpr uint32_t zip64_end_signature = 0x06064b50;
+static constexpr uint32_t zip64_locator_signature = 0x07064b50;
+static constexpr size_t zip_local_size = 30, zip_central_size = 46, zip_end_size = 22, zip64_locator_size = 20;
+
+
+// Function to read exactly size bytes at offset
+static bool pread_exact(int fd, void* data, size_t size, uint64_t offset) {
+    size_t have = 0;
+    while (have < size) {
+        const ssize_t got = ::pread(fd, static_cast<char*>(data) + have, size - have, static_cast<off_t>(offset + have));
+        if (got < 0 && errno == EINTR) continue;
+        if (got <= 0) return false;
+        have += static_cast<size_t>(got);
+    }
+    return true;
+}
+
+
+struct ZipEntry {
+    size_t central;          // offset of its record in the central directory
+    uint64_t local_offset;
+    size_t offset_field;     // offset of the local offset in the central record, and its width
+    size_t offset_width;
+    bool renamed;
+    std::string new_name;
+    uint64_t new_offset;
+};
+
+
+// Function to rewrite a zip archive: local headers in file order with their spans copied
+// behind them, then the central directory and end records pointing at the new offsets
+static bool rename_zip(int in_fd, uint64_t file_size, ArchiveOutput& out, MemberRenamer& renamer, std::string& error) {
+    // The end record sits in the last 64 KiB, behind it only its comment
+    const size_t tail_size = static_cast<size_t>(std::min<uint64_t>(file_size, zip_end_size + 0xffff + zip64_locator_size));
+    std::vector<unsigned char> tail(tail_size);
+    if (!pread_exact(in_fd, tail.data(), tail_size, file_size - tail_size)) {
+        error = "Cannot read the zip end record";
+        return false;
+    }
+    size_t end = std::string::npos;
+    for (size_t i = tail_size >= zip_end_size ? tail_size - zip_end_size + 1 : 0; i-- > 0;) {
+        if (le32(&tail[i]) == zip_end_signature && (end == std::string::npos || i + zip_end_size + le16(&tail[i + 20]) == tail_size)) {
+            end = i;
+            if (i + zip_end_size + le16(&tail[i + 20]) == tail_size) break;
+        }
+    }
+    if (end == std::string::npos) {
+        error = "Not a zip archive (no end of central directory record)";
+        return false;
+    }
+    const unsigned char* end_record = &tail[end];
+    const size_t end_record_size = std::min(tail_size - end, zip_end_size + le16(end_record + 20));
+    if (le16(end_record + 4) != 0 || le16(end_record + 6) != 0) {
+        error = "Multi-volume zip archives are not supported";
+        return false;
+    }
+    uint64_t entry_count = le16(end_record + 10);
+    uint64_t cd_size = le32(end_record + 12);
+    uint64_t cd_offset = le32(end_record + 16);
+
+    // ZIP64: the locator right before the end record points at the real counts and offsets
+    std::vector<unsigned char> zip64_end;
+    std::vector<unsigned char> zip64_locator;
+    if (end >= zip64_locator_size && le32(&tail[end - zip64_locator_size]) == zip64_locator_signature) {
+        zip64_locator.assign(&tail[end - zip64_locator_size], &tail[end]);
+        const uint64_t zip64_offset = le64(&zip64_locator[8]);
+        unsigned char fixed[56];
+        if (!pread_exact(in_fd, fixed, sizeof(fixed), zip64_offset) || le32(fixed) != zip64_end_signature || le64(fixed + 4) < 44 || le64(fixed + 4) > max_name_record) {
+            error = "Damaged ZIP64 end record";
+            return false;
+        }
+        zip64_end.resize(12 + le64(fixed + 4));
+        if (!pread_exact(in_fd, zip64_end.data(), zip64_end.size(), zip64_offset)) {
+            error = "Damaged ZIP64 end record";
+            return false;
+        }
+        entry_count = le64(&zip64_end[32]);
+        cd_size = le64(&zip64_end[40]);
+        cd_offset = le64(&zip64_end[48]);
+    }
+    if (cd_offset > file_size || cd_size > file_size - cd_offset) {
+        error = "Damaged zip central directory";
+        return false;
+    }
+
+    std::vector<unsigned char> central(static_cast<size_t>(cd_size));
+    if (!pread_exact(in_fd, central.data(), central.size(), cd_offset)) {
+        error = "Cannot read the zip central directory";
+        return false;
+    }
+
+    std::vector<ZipEntry> entries;
+    entries.reserve(static_cast<size_t>(std::min<uint64_t>(entry_count, cd_size / zip_central_size)));
+    size_t pos = 0;
+    for (uint64_t n = 0; n < entry_count; ++n) {
+        if (interrupt_requested.load(std::memory_order_relaxed)) {
+            return false;
+        }
+        if (pos + zip_central_size > central.size() || le32(&central[pos]) != zip_central_signature) {
+            error = "Damaged zip central directory at entry " + std::to_string(n);
+            return false;
+        }
+        const unsigned char* record = &central[pos];
+        const size_t name_length = le16(record + 28);
+        const size_t extra_length = le16(record + 30);
+        const size_t record_size = zip_central_size + name_length + extra_length + le16(record + 32);
+        if (pos + record_size > central.size()) {
+            error = "Damaged zip central directory at entry " + std::to_string(n);
+            return false;
+        }
+        if (le16(record + 8) & (1 << 13)) {
+            error = "Zip archives with an encrypted central directory are not supported";
+            return false;
+        }
+
+        ZipEntry entry{pos, le32(record + 42), pos + 42, 4, false, std::string(), 0};
+        if (entry.local_offset == 0xffffffff) {
+            // The ZIP64 extra holds, in order, the fields set to all ones in the record
+            const unsigned char* extra = record + zip_central_size + name_length;
+            for (size_t e = 0; e + 4 <= extra_length;) {
+                const size_t field_size = le16(extra + e + 2);
+                if (le16(extra + e) == 0x0001) {
+                    const size_t slot = e + 4 + (le32(record + 24) == 0xffffffff ? 8 : 0) + (le32(record + 20) == 0xffffffff ? 8 : 0);
+                    if (slot + 8 <= e + 4 + field_size && slot + 8 <= extra_length) {
+                        entry.local_offset = le64(extra + slot);
+                        entry.offset_field = pos + zip_central_size + name_length + slot;
+                        entry.offset_width = 8;
+                    }
+                    break;
+                }
+                e += 4 + field_size;
+            }
+        }
+        if (entry.local_offset >= cd_offset) {
+            error = "Damaged zip central directory at entry " + std::to_string(n);
+            return false;
+        }
+
+        const std::string_view name(reinterpret_cast<const char*>(record + zip_central_size), name_length);
+        const bool unix_symlink = (le16(record + 4) >> 8) == 3 && ((le32(record + 38) >> 16) & S_IFMT) == S_IFLNK;
+        entry.renamed = renamer.rename_member(name, !name.empty() && name.back() == '/', unix_symlink, entry.new_name);
+        if (entry.renamed && entry.new_name.size() > 0xffff) {
+            error = "Renamed member name is too long for zip: " + entry.new_name;
+            return false;
+        }
+        entries.push_back(std::move(entry));
+        pos += record_size;
+    }
+
+    // Local records in file order, each spans up to the next one (data descriptors included)
+    std::vector<size_t> order(entries.size());
+    for (size_t i = 0; i < order.size(); ++i) order[i] = i;
+    std::sort(order.begin(), order.end(), [&](size_t a, size_t b) { return entries[a].local_offset < entries[b].local_offset; });
+
+    off64_t copied = 0;
+    if (!out.copy_from(in_fd, &copied, order.empty() ? cd_offset : entries[order[0]].local_offset)) {
+        error = errno ? std::strerror(errno) : "Truncated zip archive";
+        return false;
+    }
+    for (size_t k = 0; k < order.size(); ++k) {
+        if (interrupt_requested.load(std::memory_order_relaxed)) {
+            return false;
+        }
+        ZipEntry& entry = entries[order[k]];
+        if (k > 0 && entries[order[k - 1]].local_offset == entry.local_offset) {
+            entry.new_offset = entries[order[k - 1]].new_offset;
+            continue;
+        }
+        uint64_t span_end = cd_offset;
+        for (size_t next = k + 1; next < order.size(); ++next) {
+            if (entries[order[next]].local_offset != entry.local_offset) {
+                span_end = entries[order[next]].local_offset;
+                break;
+            }
+        }
+        unsigned char local[zip_local_size];
+        if (!pread_exact(in_fd, local, sizeof(local), entry.local_offset) || le32(local) != zip_local_signature) {
+            error = "Damaged zip local header at offset " + std::to_string(entry.local_offset);
+            return false;
+        }
+        const uint64_t name_end = entry.local_offset + zip_local_size + le16(local + 26);
+        if (name_end > span_end) {
+            error = "Damaged zip local header at offset " + std::to_string(entry.local_offset);
+            return false;
+        }
+
+        entry.new_offset = out.offset();
+        copied = static_cast<off64_t>(entry.local_offset);
+        if (entry.renamed) {
+            set_le(local + 26, entry.new_name.size(), 2);
+            copied = static_cast<off64_t>(name_end);
+            if (!out.write(local, sizeof(local)) || !out.write(entry.new_name.data(), entry.new_name.size())) {
+                error = std::strerror(errno);
+                return false;
+            }
+        }
+        if (!out.copy_from(in_fd, &copied, span_end - static_cast<uint64_t>(copied))) {
+            error = errno ? std::strerror(errno) : "Truncated zip archive";
+            return false;
+        }
+    }
+
+    // Central directory in its own order, with the new names and offsets
+    const uint64_t new_cd_offset = out.offset();
+    std::vector<unsigned char> record;
+    for (ZipEntry& entry : entries) {
+        const unsigned char* old_record = &central[entry.central];
+        const size_t name_length = le16(old_record + 28);
+        const size_t record_size = zip_central_size + name_length + le16(old_record + 30) + le16(old_record + 32);
+        record.assign(old_record, old_record + record_size);
+        if (entry.offset_width == 4 && entry.new_offset >= 0xffffffff) {
+            error = "The renamed archive needs ZIP64 offsets its central directory does not have";
+            return false;
+        }
+        set_le(&record[entry.offset_field - entry.central], entry.new_offset, entry.offset_width);
+        if (entry.renamed) {
+            set_le(&record[28], entry.new_name.size(), 2);
+            record.erase(record.begin() + zip_central_size, record.begin() + zip_central_size + name_length);
+            record.insert(record.begin() + zip_central_size, entry.new_name.begin(), entry.new_name.end());
+        }
+        if (!out.write(record.data(), record.size())) {
+            error = std::strerror(errno);
+            return false;
+        }
+    }
+    const uint64_t new_cd_size = out.offset() - new_cd_offset;
+
+    if (!zip64_end.empty()) {
+        const uint64_t new_zip64_offset = out.offset();
+        set_le(&zip64_end[40], new_cd_size, 8);
+        set_le(&zip64_end[48], new_cd_offset, 8);
+        set_le(&zip64_locator[8], new_zip64_offset, 8);
+        if (!out.write(zip64_end.data(), zip64_end.size()) || !out.write(zip64_locator.data(), zip64_locator.size())) {
+            error = std::strerror(errno);
+            return false;
+        }
+    }
+    std::vector<unsigned char> new_end(end_record, end_record + end_record_size);
+    for (const auto& [field, value] : {std::pair<size_t, uint64_t>{12, new_cd_size}, {16, new_cd_offset}}) {
+        if (le32(&new_end[field]) == 0xffffffff && !zip64_end.empty()) {
+            continue;
+        }
+        if (value >= 0xffffffff) {
+            error = "The renamed archive needs ZIP64 offsets it does not have";
+            return false;
+        }
+        set_le(&new_end[field], value, 4);
+    }
+    if (!out.write(new_end.data(), new_end.size())) {
+        error = std::strerror(errno);
+        return false;
+    }
+    return true;
+}
+
+
+// Function to tell a compressed tarball by its magic bytes
+static const char* compression_name(const unsigned char* start, size_t size) {
+    if (size >= 2 && start[0] == 0x1f && start[1] == 0x8b) return "gzip";
+    if (size >= 3 && std::memcmp(start, "BZh", 3) == 0) return "bzip2";
+    if (size >= 6 && std::memcmp(start, "\xfd" "7zXZ\0", 6) == 0) return "xz";
+    if (size >= 4 && std::memcmp(start, "\x28\xb5\x2f\xfd", 4) == 0) return "zstd";
+    return nullptr;
+}
+
+
+// Function to rename the members of a tar or zip archive into a new archive. Failures and
+// interruptions remove the output, it would be a truncated archive.
+void rename_archive(const std::string& input, const std::string& output, const RenameOptions& options, RenameResult& result) {
+    if (options.scope != RenameScope::Names || !options.name_template.empty()) {
+        result.error = "--archive renames member names with -c";
+        return;
+    }
+    MemberRenamer renamer(options, result);
+    if (!renamer.init(result.error)) {
+        return;
+    }
+
+    const int in_fd = ::open(input.c_str(), O_RDONLY | O_CLOEXEC);
+    struct stat in_stat;
+    if (in_fd < 0 || ::fstat(in_fd, &in_stat) != 0) {
+        result.error = "Cannot open archive " + input + ": " + std::strerror(errno);
+        if (in_fd >= 0) ::close(in_fd);
+        return;
+    }
+    // The output is truncated when opened, it must not be the input
+    struct stat out_stat;
+    const bool output_exists = ::stat(output.c_str(), &out_stat) == 0;
+    if (output_exists && out_stat.st_dev == in_stat.st_dev && out_stat.st_ino == in_stat.st_ino) {
+        result.error = "The output archive is the input archive: " + output;
+        ::close(in_fd);
+        return;
+    }
+    if (output_exists && S_ISDIR(out_stat.st_mode)) {
+        result.error = "The output archive is a folder: " + output;
+        ::close(in_fd);
+        return;
+    }
+
+    ArchiveInput in(in_fd);
+    const unsigned char* start = in.peek(4);
+    const bool is_zip = S_ISREG(in_stat.st_mode) &&
+                        ((start && (std::memcmp(start, "PK\3\4", 4) == 0 || std::memcmp(start, "PK\5\6", 4) == 0)) ||
+                         (input.size() > 4 && input.compare(input.size() - 4, 4, ".zip") == 0));
+    if (const char* compression = start ? compression_name(start, 4) : nullptr) {
+        result.error = std::string("Compressed archives are not supported, decompress on the fly: ") +
+                       (std::strcmp(compression, "gzip") == 0 ? "zcat" : std::strcmp(compression, "bzip2") == 0 ? "bzcat" : std::strcmp(compression, "xz") == 0 ? "xzcat" : "zstdcat") +
+                       " " + input + " | bulk_rename++ --archive /dev/stdin OUT.tar -c MODE";
+        ::close(in_fd);
+        return;
+    }
+
+    const int out_fd = ::open(output.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, S_ISREG(in_stat.st_mode) ? in_stat.st_mode & 0666 : 0644);
+    if (out_fd < 0) {
+        result.error = "Cannot create archive " + output + ": " + std::strerror(errno);
+        ::close(in_fd);
+        return;
+    }
+    ArchiveOutput out(out_fd);
+
+    std::string error;
+    bool done = is_zip ? rename_zip(in_fd, static_cast<uint64_t>(in_stat.st_size), out, renamer, error)
+                       : rename_tar(in, out, renamer, error);
+    done = done && (out.flush() || (error = std::strerror(errno), false));
+    ::close(in_fd);
+    if (::close(out_fd) != 0 && done) {
+        error = std::strerror(errno);
+        done = false;
+    }
+
+    if (!done) {
+        struct stat written;
+        if (::stat(output.c_str(), &written) == 0 && S_ISREG(written.st_mode)) {
+            ::unlink(output.c_str());
+        }
+        if (!interrupt_requested.load()) {
+            result.error = (is_zip ? "zip " : "tar ") + input + ": " + error;
+        }
+    }
+}
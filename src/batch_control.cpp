@@ -0,0 +1,145 @@
+// SPDX-License-Identifier: GNU General Public License v3.0 or later
+
+#include "headers.h"
+
+#include <condition_variable>
+
+
+// Batch sizes and in-flight renames are tuned during the run by an AIMD controller fed with the
+// per-rename latency of the file batches. While the latency stays near the lowest seen, the
+// storage keeps up: batches grow by a step and one more thread goes in flight. Once it passes
+// twice that baseline, requests are queueing (a seeking disk, a congested NFS server, renames
+// contending for a directory lock): batches and in-flight threads are halved.
+//
+// Without directory_affinity the in-flight value sizes the team of a file batch. With it every
+// batch runs on the thread of its directory's task, and the value caps how many of those batches
+// rename at once: a batch takes an in-flight slot, the other directory tasks wait for one.
+
+static constexpr size_t initial_file_batch = 1000;
+static constexpr size_t min_file_batch = 64;
+static constexpr size_t max_file_batch = 8192;
+static constexpr size_t file_batch_step = 128;
+// Folder batches follow the file batches at the old 1000/100 ratio, a folder item is a subtree
+static constexpr size_t folders_per_file_batch = 10;
+// Batches this small say more about the directory than about the storage
+static constexpr size_t min_sampled_batch = 8;
+
+static std::atomic<size_t> file_batch{initial_file_batch};
+static std::atomic<size_t> folder_batch{initial_file_batch / folders_per_file_batch};
+static std::atomic<unsigned> in_flight{1};
+
+static std::mutex controller_mutex;
+static bool fixed_files = false;
+static bool fixed_folders = false;
+static bool fixed_in_flight = false;
+static unsigned in_flight_limit = 1;
+static double baseline_ns = 0.0;
+static double average_ns = 0.0;
+
+static std::mutex slots_mutex;
+static std::condition_variable slot_freed;
+static unsigned slots_busy = 0;
+
+
+// Function to start a run, a non-zero override pins that value for the whole run
+void begin_batch_control(size_t files_override, size_t folders_override, unsigned in_flight_override) {
+    std::lock_guard<std::mutex> lock(controller_mutex);
+    fixed_files = files_override > 0;
+    fixed_folders = folders_override > 0;
+    fixed_in_flight = in_flight_override > 0;
+    in_flight_limit = std::max(1u, max_threads);
+    baseline_ns = 0.0;
+    average_ns = 0.0;
+
+    const size_t files = fixed_files ? files_override : initial_file_batch;
+    file_batch.store(files);
+    folder_batch.store(fixed_folders ? folders_override : std::max<size_t>(1, files / folders_per_file_batch));
+    // Start with every thread in flight, the common case is local storage that scales with them
+    in_flight.store(fixed_in_flight ? std::min(in_flight_override, in_flight_limit) : in_flight_limit);
+}
+
+
+size_t file_batch_size() {
+    return file_batch.load(std::memory_order_relaxed);
+}
+
+
+size_t folder_batch_size() {
+    return folder_batch.load(std::memory_order_relaxed);
+}
+
+
+// Function to cap the threads of a batch, num_threads is what the caller's share of the pool allows
+unsigned batch_in_flight(unsigned num_threads) {
+    return std::max(1u, std::min(num_threads, in_flight.load(std::memory_order_relaxed)));
+}
+
+
+// Function to take an in-flight slot for a file batch, waiting while the limit is reached
+void enter_in_flight() {
+    std::unique_lock<std::mutex> lock(slots_mutex);
+    slot_freed.wait(lock, [] { return slots_busy < in_flight.load(std::memory_order_relaxed); });
+    ++slots_busy;
+}
+
+
+// Function to give the slot of a finished file batch back
+void leave_in_flight() {
+    {
+        std::lock_guard<std::mutex> lock(slots_mutex);
+        --slots_busy;
+    }
+    slot_freed.notify_one();
+}
+
+
+// Function to feed one file batch to the controller: items renames by team threads in elapsed
+void record_file_batch(size_t items, unsigned team, std::chrono::steady_clock::duration elapsed) {
+    if (items < min_sampled_batch || (fixed_files && fixed_folders && fixed_in_flight)) {
+        return;
+    }
+    // Time one rename held a thread, threads without an item of their own do not count
+    const double busy_threads = static_cast<double>(std::min<size_t>(std::max(1u, team), items));
+    const double latency_ns = std::chrono::duration<double, std::nano>(elapsed).count() * busy_threads / static_cast<double>(items);
+
+    std::lock_guard<std::mutex> lock(controller_mutex);
+    // The baseline is the lowest latency seen, drifting up slowly so a slower device is learned
+    baseline_ns = (baseline_ns == 0.0) ? latency_ns : std::min(latency_ns, baseline_ns * 1.02);
+    average_ns = (average_ns == 0.0) ? latency_ns : average_ns * 0.75 + latency_ns * 0.25;
+
+    size_t files = file_batch.load(std::memory_order_relaxed);
+    unsigned threads = in_flight.load(std::memory_order_relaxed);
+    if (average_ns > 2.0 * baseline_ns) {
+        files = std::max(min_file_batch, files / 2);
+        threads = std::max(1u, threads / 2);
+        // The average restarts so the next decrease waits for batches run with the new values
+        average_ns = 0.0;
+    } else {
+        files = std::min(max_file_batch, files + file_batch_step);
+        threads = std::min(in_flight_limit, threads + 1);
+    }
+
+    if (!fixed_files) {
+        file_batch.store(files, std::memory_order_relaxed);
+    }
+    if (!fixed_folders) {
+        folder_batch.store(std::max<size_t>(1, file_batch.load(std::memory_order_relaxed) / folders_per_file_batch), std::memory_order_relaxed);
+    }
+    if (!fixed_in_flight && threads != in_flight.load(std::memory_order_relaxed)) {
+        {
+            std::lock_guard<std::mutex> slots_lock(slots_mutex);
+            in_flight.store(threads, std::memory_order_relaxed);
+        }
+        slot_freed.notify_all();
+    }
+}
+
+
+// Function to report the values the run ended with
+void end_batch_control(size_t& files, size_t& folders, unsigned& threads, bool& adaptive) {
+    std::lock_guard<std::mutex> lock(controller_mutex);
+    files = file_batch.load();
+    folders = folder_batch.load();
+    threads = in_flight.load();
+    adaptive = !(fixed_files && fixed_folders && fixed_in_flight);
+}
@@ -1,12 +1,10 @@
 // SPDX-License-Identifier: GNU General Public License v3.0 or later
 
 #include "headers.h"
+#include "renamepp.h"
 
+#include <csignal>
 
-// General purpose stuff
-
-// Get the number of available processor cores
-unsigned int max_threads = (omp_get_num_procs() <= 0) ? 2 : static_cast<unsigned int>(omp_get_num_procs());
 
 // Terminal blocking/unblocking
 
@@ -34,25 +32,6 @@ void restoreInput() {
 }
 
 
-// Global print functions
-
-// Mutex to prevent interleaved output from concurrent threads
-static std::mutex print_mutex;
-
-// Print an error message to stderr in a thread-safe manner
-void print_error(const std::string& error, std::ostream& out) {
-    std::lock_guard<std::mutex> lock(print_mutex);
-    out << error << std::endl;
-}
-
-
-// Print a message to stdout in a thread-safe manner (used when verbose mode is enabled)
-void print_verbose_enabled(const std::string& message, std::ostream& out) {
-    std::lock_guard<std::mutex> lock(print_mutex);
-    out << message << std::endl;
-}
-
-
 // Print the version number of the program
 void printVersionNumber(const std::string& version) {
     std::cout << "\x1B[1mBulk Rename Plus v" << version << "\x1B[0m\n";
@@ -86,9 +65,30 @@ std::cout << "\nUsage: bulk_rename++ [OPTIONS] [MODE] [PATHS]\n"
           << "  -fo                      Rename folders exclusively (optional)\n"
           << "  -sym                     Handle symlinks like regular files + folders (optional)\n"
           << "  -d  [DEPTH]              Set recursive depth level (optional)\n"
+          << "  --one-file-system        Do not descend into other mounted filesystems (optional)\n"
+          << "  --max-memory [SIZE]      Cap memory for directory listings, spill to $TMPDIR past it (optional)\n"
+          << "  --progress               Show scanned/renamed/skipped counts, rate and ETA on stderr (optional)\n"
+          << "  --resume [FILE]          Checkpoint finished folders to FILE and skip them when run again (optional)\n"
+          << "  --batch-files [N]        Files per parallel batch instead of adapting to the storage (optional)\n"
+          << "  --batch-folders [N]      Folders per parallel batch instead of adapting to the storage (optional)\n"
+          << "  --in-flight [N]          Threads per batch instead of adapting to the storage (optional)\n"
+          << "  --newer [AGE|DATE]       Rename only files modified within AGE (30m, 24h, 7d) or since DATE (2024-01-15) (optional)\n"
+          << "  --older [AGE|DATE]       Rename only files last modified longer than AGE ago or before DATE (optional)\n"
+          << "  --min-size [SIZE]        Rename only files of at least SIZE bytes, e.g. 100K (optional)\n"
+          << "  --max-size [SIZE]        Rename only files of at most SIZE bytes, e.g. 2G (optional)\n"
+          << "  --uid [USER]             Rename only files owned by USER, a name or a number (optional)\n"
+          << "  --gid [GROUP]            Rename only files of GROUP, a name or a number (optional)\n"
+          << "  --durability=[LEVEL]     Sync renames to disk: none, dirs (fsync touched folders) or fs (syncfs at the end) (optional)\n"
+          << "  --serve [SOCKET]         Run as a daemon taking rename jobs on a Unix socket (only option besides --plugin)\n"
+          << "  --connect [SOCKET]       Run the job on a --serve daemon instead of in this process (optional)\n"
+          << "  --plugin [PATH]          Load transform plugin(s), a .so or a folder of them; their modes work with -c and -cp (optional)\n"
+          << "  --archive [IN] [OUT]     Rename the members of a tar or zip archive into a new archive, with -c (optional)\n"
           << "  -c  [MODE]               Set Case Mode for file + folder - parent names\n"
           << "  -cp [MODE]               Set Case Mode for file + folder + parent names\n"
           << "  -ce [MODE]               Set Case Mode for file extension names\n"
+          << "  -t  [TEMPLATE]           Build file names from a template instead of a mode, folders keep theirs\n"
+          << "                           Fields: {name} {stem} {ext} {parent} {seq[:width]} {date} {mtime} {btime}\n"
+          << "                           Each takes |MODE transforms of the name modes, e.g. {stem|lower|snake}\n"
           << "\n"
           << "Available Modes:\n"
           << "Regular CASE Modes:\n"
@@ -114,7 +114,12 @@ std::cout << "\nUsage: bulk_rename++ [OPTIONS] [MODE] [PATHS]\n"
 	  << "  sequence   Append numeric sequence to names alphabetically (e.g., Test => 001_Test)\n"
           << "  rsequence  Remove numeric sequence from names (e.g., 001_Test => Test)\n"
 	  << "  date       Append current date to names (e.g., Test => Test_20240215)\n"
+	  << "  date:mtime Append modification date to names (e.g., Test => Test_20231107)\n"
+	  << "  date:btime Append creation (birth) date to names, if the filesystem reports it\n"
 	  << "  rdate      Remove date from names (e.g., Test_20240215 => Test)\n"
+          << "  hash       Name files after their XXH64 content hash, duplicates are reported (e.g., Test.txt => ef46db3751d8e999.txt)\n"
+          << "  hash:sha256 Name files after their SHA-256 content hash, duplicates are reported\n"
+          << "  exif       Name photos after their EXIF capture time (e.g., IMG_1234.JPG => 20240215_143210.jpg)\n"
 	  << "  rnumeric   Remove numeric characters from names (e.g., 1Te0st2 => Test)\n"
           << "Custom CASE Modes:\n"
           << "  rbra       Remove [ ] { } ( ) from names (e.g., [{Test}] => Test)\n"
@@ -133,649 +138,77 @@ std::cout << "\nUsage: bulk_rename++ [OPTIONS] [MODE] [PATHS]\n"
           << "  bulk_rename++ -ce noext -v [path1]\n"
           << "  bulk_rename++ -sym -c lower -vso [path1]\n"
           << "  bulk_rename++ -sym -fi -c title -v [path1]\n"
+          << "  bulk_rename++ --one-file-system -c lower [path1]\n"
+          << "  bulk_rename++ --max-memory 256M -c sequence [path1]\n"
+          << "  bulk_rename++ --newer 24h --uid www-data -fi -c lower [path1]\n"
+          << "  bulk_rename++ --progress -ni -c lower [path1]\n"
+          << "  bulk_rename++ --resume run.ckpt -ni -c lower [path1]\n"
+          << "  bulk_rename++ --durability=dirs -c lower [path1]\n"
+          << "  bulk_rename++ -t '{parent}_{seq:04}_{stem|lower}.{ext|lower}' [path1]\n"
+          << "  bulk_rename++ --serve /run/user/1000/brpp.sock\n"
+          << "  bulk_rename++ --connect /run/user/1000/brpp.sock -ni -c lower [path1]\n"
+          << "  bulk_rename++ --archive delivery.tar delivery_lower.tar -c lower\n"
           << "\x1B[0m\n";
 }
 
 
-// Extension stuff
-
-// Global static transformations
-static const std::vector<std::string> transformation_commands = {
-    "lower",      // Convert to lowercase
-    "upper",      // Convert to uppercase
-    "reverse",    // Reverse the case of each character
-    "title",      // Convert to title case
-    "snake",      // Convert to snake_case
-    "rsnake",     // Reverse snake_case (replace _ with space)
-    "rspecial",   // Remove special characters
-    "rnumeric",   // Remove numeric characters
-    "rbra",       // Remove brackets
-    "roperand",   // Remove operands
-    "camel",      // Convert to camelCase
-    "rcamel",     // Reverse camelCase to space-separated
-    "kebab",      // Convert to kebab-case
-    "rkebab",     // Reverse kebab-case (replace - with space)
-    "sequence",   // Append numeric sequence prefix
-    "rsequence",  // Remove numeric sequence prefix
-    "date",       // Append current date
-    "rdate",      // Remove date suffix
-    "swap",       // swap_transform (capitalize first, then alternate)
-    "swapr",      // swapr_transform (lowercase first, then alternate)
-    "sentence",   // Convert to sentence case
-    "pascal",     // Convert to PascalCase
-    "rpascal",    // Reverse PascalCase to space-separated
-    "bak",        // Add .bak extension
-    "rbak",       // Remove .bak extension
-    "noext"       // Remove extension
-};
-
-
-// Function to rename file extensions
-void rename_extension(const std::vector<fs::path>& item_paths, const std::string& case_input, bool verbose_enabled, std::atomic<int>& files_count, size_t batch_size, bool symlinks, std::atomic<int>& skipped_file_count, bool skipped, bool skipped_only) {
-    // Local vector to store pairs of old and new paths for renaming
-    std::vector<std::pair<fs::path, fs::path>> rename_batch;
-    rename_batch.reserve(item_paths.size());
-
-    // Iterate through each item path
-    for (const auto& item_path : item_paths) {
-        // Skip symlinks unless explicitly included
-        if (fs::is_symlink(item_path) && !symlinks) {
-            ++skipped_file_count;
-            if (verbose_enabled && skipped) {
-                print_verbose_enabled("\033[0m\033[93mSkipped\033[0m \033[95msymlink_file\033[0m " + item_path.string() + " (excluded)", std::cout);
-            }
-            continue;
-        }
-
-        // Get the current extension of the file
-        std::string extension = item_path.extension().string();
-        std::string new_extension = extension;
-
-        // Check if the requested case transformation is valid and apply it
-        if (std::find(transformation_commands.begin(), transformation_commands.end(), case_input) != transformation_commands.end()) {
-            if (case_input == "lower") {
-                std::transform(extension.begin(), extension.end(), new_extension.begin(), ::tolower);
-            } else if (case_input == "upper") {
-                std::transform(extension.begin(), extension.end(), new_extension.begin(), ::toupper);
-            } else if (case_input == "reverse") {
-                std::transform(extension.begin(), extension.end(), new_extension.begin(), [](char c) {
-                    return std::islower(c) ? std::toupper(c) : std::tolower(c);
-                });
-            } else if (case_input == "title") {
-                new_extension = capitalizeFirstLetter(new_extension);
-            } else if (case_input == "bak") {
-                if (extension.length() < 4 || extension.substr(extension.length() - 4) != ".bak") {
-                    new_extension = extension + ".bak";
-                } else {
-                    new_extension = extension; // Already has .bak
-                }
-            } else if (case_input == "rbak") {
-                if (extension.length() >= 4 && extension.substr(extension.length() - 4) == ".bak") {
-                    new_extension = extension.substr(0, extension.length() - 4);
-                }
-            } else if (case_input == "noext") {
-                new_extension.clear();
-            } else if (case_input == "swap") {
-                new_extension = swap_transform(extension);
-            } else if (case_input == "swapr") {
-                new_extension = swapr_transform(extension);
-            }
-
-            if (extension == new_extension) {
-                ++skipped_file_count;
-            }
-
-            // If extension changed, create new path and add to rename batch
-            if (extension != new_extension) {
-                fs::path new_path = item_path.parent_path() / (item_path.stem().string() + new_extension);
-                rename_batch.emplace_back(item_path, new_path);
-            } else {
-                // Print skipped messages
-                if (skipped && verbose_enabled && ((!fs::is_regular_file(item_path) && !fs::is_symlink(item_path)) || (fs::is_symlink(item_path) && symlinks))) {
-                    print_verbose_enabled("\033[0m\033[93mSkipped\033[0m \033[95msymlink_file\033[0m " + item_path.string() + (extension.empty() ? " (no name change)" : " (name unchanged)"), std::cout);
-                }
-                if (verbose_enabled && skipped) {
-                    print_verbose_enabled("\033[0m\033[93mSkipped\033[0m file " + item_path.string() + (extension.empty() ? " (no extension)" : " (extension unchanged)"), std::cout);
-                }
-            }
-        }
-
-        // Batch processing: if batch size reached, rename batch and clear
-        if (rename_batch.size() >= batch_size) {
-            batch_rename_extension(rename_batch, verbose_enabled, files_count, skipped_only);
-            rename_batch.clear();
-        }
-    }
-
-    // Process remaining items in the batch if any
-    if (!rename_batch.empty()) {
-        batch_rename_extension(rename_batch, verbose_enabled, files_count, skipped_only);
-    }
-}
-
-
-
-// Function to rename a batch of file extensions using multiple threads for parallel execution
-void batch_rename_extension(const std::vector<std::pair<fs::path, fs::path>>& data, bool verbose_enabled, std::atomic<int>& files_count, bool skipped_only) {
-    int num_threads = std::min(static_cast<int>(data.size()), static_cast<int>(max_threads));
-    #pragma omp parallel for schedule(dynamic) num_threads(num_threads)
-    for (std::size_t i = 0; i < data.size(); ++i) {
-        const auto& [old_path, new_path] = data[i];
-
-        try {
-            fs::rename(old_path, new_path);
-
-            files_count.fetch_add(1, std::memory_order_relaxed);
-
-            if (verbose_enabled && !skipped_only) {
-                if (fs::is_symlink(old_path) || fs::is_symlink(new_path)) {
-                    print_verbose_enabled("\033[0m\033[92mRenamed\033[0m \033[95msymlink_file\033[0m " + old_path.string() + "\e[1;38;5;214m -> \033[0m" + new_path.string(), std::cout);
-                } else {
-                    fs::file_status status = fs::status(new_path);
-                    if (fs::is_regular_file(status)) {
-                        print_verbose_enabled("\033[0m\033[92mRenamed\033[0m file " + old_path.string() + "\e[1;38;5;214m -> \033[0m" + new_path.string(), std::cout);
-                    }
-                }
-            }
-        } catch (const fs::filesystem_error& e) {
-            if (e.code() == std::errc::permission_denied) {
-                if (verbose_enabled) {
-                    print_error("\033[1;91mError\033[0m: " + std::string(e.what()) + "\n", std::cerr);
-                }
-            }
-        }
-    }
-}
-
-
-// Function to search subdirs for file extensions recursively for multiple paths in parallel
-void rename_extension_path(const std::vector<std::string>& paths, const std::string& case_input, bool verbose_enabled, int depth, std::atomic<int>& files_count, size_t batch_size_files, bool symlinks, std::atomic<int>& skipped_file_count, bool skipped, bool skipped_only, bool non_interactive) {
-    // If depth is negative, set it to a very large number to effectively disable the depth limit
-    if (depth < 0) {
-        depth = std::numeric_limits<int>::max();
-    }
-
-    auto start_time = std::chrono::steady_clock::now();
-
-    int num_paths = static_cast<int>(paths.size());
-    #pragma omp parallel for schedule(dynamic) num_threads(max_threads)
-    for (int i = 0; i < num_paths; ++i) {
-        const auto& current_fs_path = paths[i];
-        std::queue<std::pair<fs::path, int>> directories;
-        directories.push({fs::path(current_fs_path), 0});
-
-        while (!directories.empty()) {
-            auto [current_path, current_depth] = directories.front();
-            directories.pop();
-
-            if (current_depth >= depth) {
-                continue;
-            }
-
-            try {
-                if (fs::is_directory(current_path)) {
-                    for (const auto& entry : fs::directory_iterator(current_path)) {
-                        if (fs::is_symlink(entry) && !symlinks) {
-                            if (verbose_enabled && skipped) {
-                                if (fs::is_directory(entry)) {
-                                    print_verbose_enabled("\033[0m\033[93mSkipped\033[0m processing \033[95msymlink_folder\033[0m " + entry.path().string() + " (excluded)", std::cout);
-                                } else {
-                                    print_verbose_enabled("\033[0m\033[93mSkipped\033[0m \033[95msymlink_file\033[0m " + entry.path().string() + " (excluded)", std::cout);
-                                }
-                            }
-                            continue;
-                        }
-
-                        if (fs::is_directory(entry)) {
-                            directories.push({entry.path(), current_depth + 1});
-                        } else if (fs::is_regular_file(entry)) {
-                            rename_extension({entry.path()}, case_input, verbose_enabled, files_count, batch_size_files, symlinks, skipped_file_count, skipped, skipped_only);
-                        }
-                    }
-                } else if (fs::is_regular_file(current_path)) {
-                    rename_extension({current_path}, case_input, verbose_enabled, files_count, batch_size_files, symlinks, skipped_file_count, skipped, skipped_only);
-                }
-            } catch (const std::exception& ex) {
-                if (verbose_enabled) {
-                    print_error("\033[1;91mError processing path\033[0m: " + current_path.string() + " - " + ex.what(), std::cerr);
-                }
-            }
-        }
-    }
-
-    auto end_time = std::chrono::steady_clock::now();
-    std::chrono::duration<double> elapsed_seconds = end_time - start_time;
-
+// Function to print the summary of a finished run
+void print_summary(const RenameResult& result, bool rename_extensions, bool one_file_system, bool verbose_enabled) {
     if (verbose_enabled) {
         std::cout << "\n";
     }
-    if (!non_interactive || verbose_enabled) {
-        std::cout << "\n\033[1A\033[K\033[1mRenamed: \033[1;92m" << files_count << " file(s) \033[0;1m | Skipped: \033[1;93m" << skipped_file_count << " file(s)\033[0;1m | \033[1mFrom: \033[1;95m" << paths.size()
-                  << " input path(s) \033[0;1m" << "\n\n\033[0;1mTime Elapsed: " << std::setprecision(1)
-                  << std::fixed << elapsed_seconds.count() << "\033[1m second(s)\n\n";
-    }
-}
-
-
-// Rename file&directory stuff
-
-// Function to rename files
-void rename_file(const fs::path& item_path, const std::string& case_input, bool is_directory, bool verbose_enabled, bool transform_dirs, bool transform_files, std::atomic<int>& files_count, std::atomic<int>& dirs_count, size_t batch_size_files, bool symlinks, std::atomic<int>& skipped_file_count, std::atomic<int>& skipped_folder_count, bool skipped, bool skipped_only) {
-    if (!is_directory) {
-        if ((fs::is_symlink(item_path) && !symlinks) || !fs::is_regular_file(item_path)) {
-            // Non-regular, non-directory item (e.g. device file, socket): skip as file
-            ++skipped_file_count;
-            if (verbose_enabled && transform_files && !symlinks && skipped) {
-                print_verbose_enabled("\033[0m\033[93mSkipped\033[0m \033[95msymlink_file\033[0m " + item_path.string() + " (excluded)", std::cout);
-            }
-            return;
+    if (rename_extensions) {
+        std::cout << "\n\033[1A\033[K\033[1mRenamed: \033[1;92m" << result.files_renamed << " file(s) \033[0;1m | Skipped: \033[1;93m" << result.files_skipped << " file(s)\033[0;1m | \033[1mFrom: \033[1;95m" << result.input_paths
+                  << " input path(s) \033[0;1m";
+        if (one_file_system) {
+            std::cout << "| Not crossed: \033[1;93m" << result.mounts_not_crossed << " mount point(s) \033[0;1m";
         }
-    }
+    } else {
+        std::cout << "\n\033[1A\033[K\033[0;1mRenamed: \033[1;92m" << result.files_renamed << " file(s) \033[0;1m&& \033[1;94m"
+                  << result.folders_renamed << " folder(s) \033[1m\033[0;1m| Skipped: \033[1;93m" << result.files_skipped << " file(s) \033[0;1m&& \033[1;93m"
+                  << result.folders_skipped << " folder(s) ";
 
-    // Thread-local vector for renaming data
-    std::vector<std::pair<fs::path, std::string>> rename_data;
-    rename_data.reserve(batch_size_files);
+        std::cout << "\033[0m\033[0;1m| From: \033[1;95m" << result.input_paths << " input path(s)";
 
-    // Check if the item is a directory
-    if (is_directory) {
-        for (const auto& entry : fs::directory_iterator(item_path)) {
-            rename_file(entry.path(), case_input, entry.is_directory(), verbose_enabled, transform_dirs, transform_files, files_count, dirs_count, batch_size_files, symlinks, skipped_file_count, skipped_folder_count, skipped, skipped_only);
+        if (one_file_system) {
+            std::cout << " \033[0;1m| Not crossed: \033[1;93m" << result.mounts_not_crossed << " mount point(s)";
         }
-        dirs_count.fetch_add(1, std::memory_order_relaxed);
-        return;
-    }
-
-    // Extract the filename
-    fs::path relative_path = item_path.filename();
-    std::string name = relative_path.string();
-    std::string new_name = name;
-
-    // Perform transformations on file names if requested
-    if (transform_files) {
-        static const std::unordered_set<std::string> transformations = {
-            "lower", "upper", "reverse", "title", "snake", "rsnake",
-            "kebab", "rkebab", "rspecial", "rnumeric", "rbra", "roperand",
-            "camel", "rcamel", "sequence", "rsequence", "date", "rdate",
-            "sentence", "swap", "swapr", "pascal", "rpascal"
-        };
-
-        if (transformations.count(case_input)) {
-            if (case_input == "lower") {
-                std::transform(new_name.begin(), new_name.end(), new_name.begin(), ::tolower);
-            } else if (case_input == "upper") {
-                std::transform(new_name.begin(), new_name.end(), new_name.begin(), ::toupper);
-            } else if (case_input == "reverse") {
-                std::transform(new_name.begin(), new_name.end(), new_name.begin(), [](unsigned char c) {
-                    return std::islower(c) ? std::toupper(c) : std::tolower(c);
-                });
-            } else if (case_input == "title") {
-                new_name = capitalizeFirstLetter(new_name);
-            } else if (case_input == "snake") {
-                std::replace(new_name.begin(), new_name.end(), ' ', '_');
-            } else if (case_input == "rsnake") {
-                std::replace(new_name.begin(), new_name.end(), '_', ' ');
-            } else if (case_input == "kebab") {
-                std::replace(new_name.begin(), new_name.end(), ' ', '-');
-            } else if (case_input == "rkebab") {
-                std::replace(new_name.begin(), new_name.end(), '-', ' ');
-            } else if (case_input == "rspecial") {
-                new_name.erase(std::remove_if(new_name.begin(), new_name.end(), [](char c) {
-                    return !std::isalnum(c) && c != '.' && c != '_' && c != '-' && c != '(' && c != ')' && c != '[' && c != ']' && c != '{' && c != '}' && c != '+' && c != '*' && c != '<' && c != '>' && c != ' ';
-                }), new_name.end());
-            } else if (case_input == "rnumeric") {
-                new_name.erase(std::remove_if(new_name.begin(), new_name.end(), [](char c) {
-                    return std::isdigit(c);
-                }), new_name.end());
-            } else if (case_input == "rbra") {
-                new_name.erase(std::remove_if(new_name.begin(), new_name.end(), [](char c) {
-                    return c == '[' || c == ']' || c == '{' || c == '}' || c == '(' || c == ')';
-                }), new_name.end());
-            } else if (case_input == "roperand") {
-                new_name.erase(std::remove_if(new_name.begin(), new_name.end(), [](char c) {
-                    return c == '-' || c == '+' || c == '>' || c == '<' || c == '=' || c == '*';
-                }), new_name.end());
-            } else if (case_input == "camel") {
-                new_name = to_camel_case(new_name, true);
-            } else if (case_input == "rcamel") {
-                new_name = from_camel_case(new_name);
-            } else if (case_input == "sequence") {
-                new_name = append_numbered_prefix(item_path.parent_path(), new_name);
-            } else if (case_input == "rsequence") {
-                new_name = remove_numbered_prefix(new_name);
-            } else if (case_input == "date") {
-                new_name = append_date_seq(new_name);
-            } else if (case_input == "rdate") {
-                new_name = remove_date_seq(new_name);
-            } else if (case_input == "sentence") {
-                new_name = sentenceCase(new_name);
-            } else if (case_input == "swap") {
-                new_name = swap_transform(new_name);
-            } else if (case_input == "swapr") {
-                new_name = swapr_transform(new_name);
-            } else if (case_input == "pascal") {
-                new_name = to_pascal(new_name, true);
-            } else if (case_input == "rpascal") {
-                new_name = from_pascal_case(new_name);
-            }
+        if (result.duplicates > 0) {
+            std::cout << " \033[0;1m| Duplicates: \033[1;93m" << result.duplicates << " file(s)";
         }
     }
-
-    // Check if the name is unchanged and skip if necessary
-    if (name == new_name && transform_files) {
-        ++skipped_file_count;
-    }
-
-    // Add data to the list if new name differs
-    if (name != new_name) {
-        rename_data.emplace_back(item_path, new_name);
-    }
-
-    if (!rename_data.empty()) {
-        rename_batch(rename_data, verbose_enabled, files_count, dirs_count, skipped_only);
-    }
-
-    if (name == new_name && verbose_enabled && skipped && transform_files) {
-        print_verbose_enabled("\033[0m\033[93mSkipped\033[0m file " + item_path.string() + " (name unchanged)", std::cout);
-    }
-}
-
-
-
-// Function to rename a batch of files/directories using multiple threads for parallel execution
-void rename_batch(const std::vector<std::pair<fs::path, std::string>>& data, bool verbose_enabled, std::atomic<int>& files_count, std::atomic<int>& dirs_count, bool skipped_only) {
-    int num_threads = std::min(static_cast<int>(data.size()), static_cast<int>(max_threads));
-    #pragma omp parallel for schedule(dynamic) num_threads(num_threads)
-    for (std::size_t i = 0; i < data.size(); ++i) {
-        const auto& [item_path, new_name] = data[i];
-        fs::path new_path = item_path.parent_path() / new_name;
-
-        try {
-            fs::rename(item_path, new_path);
-
-            if (verbose_enabled && !skipped_only) {
-                if (fs::is_symlink(item_path) || fs::is_symlink(new_path)) {
-                    print_verbose_enabled("\033[0m\033[92mRenamed\033[0m \033[95msymlink_file\033[0m " + item_path.string() + "\e[1;38;5;214m -> \033[0m" + new_path.string(), std::cout);
-                } else {
-                    print_verbose_enabled("\033[0m\033[92mRenamed\033[0m file " + item_path.string() + "\e[1;38;5;214m -> \033[0m" + new_path.string(), std::cout);
-                }
-            }
-
-            fs::file_status status = fs::status(new_path);
-            if (fs::is_regular_file(status)) {
-                files_count.fetch_add(1, std::memory_order_relaxed);
-            } else if (fs::is_directory(status)) {
-                dirs_count.fetch_add(1, std::memory_order_relaxed);
-            }
-        } catch (const fs::filesystem_error& e) {
-            if (e.code() == std::errc::permission_denied) {
-                if (verbose_enabled) {
-                    print_error("\033[1;91mError\033[0m: " + std::string(e.what()) + "\n", std::cerr);
-                }
-            }
-        }
+    std::cout << "\n\n\033[0;1mTime Elapsed: " << std::setprecision(1)
+              << std::fixed << result.elapsed_seconds << "\033[1m second(s)\n";
+    if (result.batch_size_files > 0) {
+        std::cout << "\033[0;1mBatches: \033[1;96m" << result.batch_size_files << " file(s) \033[0;1m&& \033[1;96m" << result.batch_size_folders
+                  << " folder(s) \033[0;1m| In flight: \033[1;96m" << result.in_flight << " thread(s) \033[0;1m("
+                  << (result.adaptive_batches ? "adaptive" : "fixed") << ")\033[0m\n";
     }
-}
-
-
-// Helper template for batch parallel processing.
-template<typename Func>
-void process_in_batches(const std::vector<fs::path>& items,
-                        size_t batch_size,
-                        unsigned int num_threads,
-                        Func func) {
-    const size_t total_items = items.size();
-    for (size_t start = 0; start < total_items; start += batch_size) {
-        const size_t end = std::min(start + batch_size, total_items);
-
-        #pragma omp parallel for num_threads(num_threads) schedule(static)
-        for (size_t i = start; i < end; ++i) {
-            func(items[i]);
-        }
+    if (result.transform_cache_lookups > 0) {
+        std::cout << "\033[0;1mTransform cache: \033[1;96m" << result.transform_cache_hits << " hit(s) \033[0;1mof \033[1;96m" << result.transform_cache_lookups
+                  << " lookup(s) \033[0;1m(" << result.transform_cache_hits * 100 / result.transform_cache_lookups << "%"
+                  << (result.transform_cache_off ? ", switched off" : "") << ")\033[0m\n";
     }
+    std::cout << "\n";
 }
 
 
-// Function to rename a directory based on specified transformations
-void rename_directory(const fs::path& directory_path, const std::string& case_input, bool rename_parents, bool verbose_enabled, bool transform_dirs, bool transform_files, std::atomic<int>& files_count, std::atomic<int>& dirs_count, int depth, size_t batch_size_files, size_t batch_size_folders, bool symlinks, std::atomic<int>& skipped_file_count, std::atomic<int>& skipped_folder_count, std::atomic<int>& skipped_folder_special_count, bool skipped, bool skipped_only, std::atomic<bool>& isFirstRun, std::atomic<bool>& special, int num_paths) {
-    std::string dirname = directory_path.filename().string();
-    std::string new_dirname = dirname;
-
-    unsigned int num_threads = max_threads;
-
-    if (num_paths > 1) {
-        unsigned int max_threads_per_path = std::max(1u, max_threads / static_cast<unsigned int>(num_paths));
-        num_threads = max_threads_per_path;
-    }
-
-    // Early exit if the directory is a symlink and should not be transformed
-    if (fs::is_symlink(directory_path) && !symlinks) {
-        if (transform_dirs) {
-            skipped_folder_count.fetch_add(1, std::memory_order_relaxed);
-        }
-        if (verbose_enabled && skipped) {
-            print_verbose_enabled("\033[0m\033[93mSkipped\033[0m processing \033[95msymlink_folder\033[0m " + directory_path.string() + " (excluded)", std::cout);
-        }
-        return;
-    }
-
-    // Apply transformations to the directory name if required
-    if (transform_dirs) {
-        static const std::unordered_set<std::string> transformations = {
-            "lower", "upper", "reverse", "title", "snake", "rsnake",
-            "kebab", "rkebab", "rspecial", "rnumeric", "rbra", "roperand",
-            "camel", "rcamel", "sequence", "rsequence", "date", "rdate",
-            "sentence", "swap", "swapr", "pascal", "rpascal"
-        };
-
-        if (transformations.count(case_input)) {
-            if (case_input == "lower") {
-                std::transform(new_dirname.begin(), new_dirname.end(), new_dirname.begin(), ::tolower);
-            } else if (case_input == "upper") {
-                std::transform(new_dirname.begin(), new_dirname.end(), new_dirname.begin(), ::toupper);
-            } else if (case_input == "reverse") {
-                std::transform(new_dirname.begin(), new_dirname.end(), new_dirname.begin(), [](unsigned char c) {
-                    return std::islower(c) ? std::toupper(c) : std::tolower(c);
-                });
-            } else if (case_input == "title") {
-                new_dirname = capitalizeFirstLetter(new_dirname);
-            } else if (case_input == "snake") {
-                std::replace(new_dirname.begin(), new_dirname.end(), ' ', '_');
-            } else if (case_input == "rsnake") {
-                std::replace(new_dirname.begin(), new_dirname.end(), '_', ' ');
-            } else if (case_input == "kebab") {
-                std::replace(new_dirname.begin(), new_dirname.end(), ' ', '-');
-            } else if (case_input == "rkebab") {
-                std::replace(new_dirname.begin(), new_dirname.end(), '-', ' ');
-            } else if (case_input == "rspecial") {
-                new_dirname.erase(std::remove_if(new_dirname.begin(), new_dirname.end(), [](char c) {
-                    return !std::isalnum(c) && c != '.' && c != '_' && c != '-' && c != '(' && c != ')' && c != '[' && c != ']' && c != '{' && c != '}' && c != '+' && c != '*' && c != '<' && c != '>' && c != ' ';
-                }), new_dirname.end());
-            } else if (case_input == "rnumeric") {
-                new_dirname.erase(std::remove_if(new_dirname.begin(), new_dirname.end(), [](char c) {
-                    return std::isdigit(c);
-                }), new_dirname.end());
-            } else if (case_input == "rbra") {
-                new_dirname.erase(std::remove_if(new_dirname.begin(), new_dirname.end(), [](char c) {
-                    return c == '[' || c == ']' || c == '{' || c == '}' || c == '(' || c == ')';
-                }), new_dirname.end());
-            } else if (case_input == "roperand") {
-                new_dirname.erase(std::remove_if(new_dirname.begin(), new_dirname.end(), [](char c) {
-                    return c == '-' || c == '+' || c == '>' || c == '<' || c == '=' || c == '*';
-                }), new_dirname.end());
-            } else if (case_input == "camel") {
-                new_dirname = to_camel_case(new_dirname, false);
-            } else if (case_input == "rcamel") {
-                new_dirname = from_camel_case(new_dirname);
-            } else if (case_input == "sequence") {
-                special = true;
-                rename_folders_with_sequential_numbering(directory_path, "", dirs_count, skipped_folder_special_count, depth, verbose_enabled, skipped, skipped_only, symlinks, batch_size_folders, num_paths);
-            } else if (case_input == "rsequence") {
-                new_dirname = get_renamed_folder_name_without_numbering(dirname);
-            } else if (case_input == "date") {
-                new_dirname = append_date_suffix_to_folder_name(dirname);
-            } else if (case_input == "rdate") {
-                new_dirname = get_renamed_folder_name_without_date(dirname);
-            } else if (case_input == "sentence") {
-                new_dirname = sentenceCase(new_dirname);
-            } else if (case_input == "swap") {
-                new_dirname = swap_transform(new_dirname);
-            } else if (case_input == "swapr") {
-                new_dirname = swapr_transform(new_dirname);
-            } else if (case_input == "pascal") {
-                new_dirname = to_pascal(new_dirname, false);
-            } else if (case_input == "rpascal") {
-                new_dirname = from_pascal_case(new_dirname);
-            }
-        }
-    }
-
-    fs::path new_path = directory_path.parent_path() / new_dirname;
-
-    if (directory_path == new_path && transform_dirs && !special) {
-        skipped_folder_count.fetch_add(1, std::memory_order_relaxed);
-    }
-
-    // Check if renaming is necessary
-    if (directory_path != new_path) {
-        try {
-            fs::rename(directory_path, new_path);
-            if (verbose_enabled && !skipped_only) {
-                if ((std::filesystem::is_symlink(directory_path) || (std::filesystem::is_symlink(new_path) && symlinks)) && !special) {
-                    print_verbose_enabled("\033[0m\033[92mRenamed \033[95msymlink_folder\033[0m " + directory_path.string() + "\e[1;38;5;214m -> \033[0m" + new_path.string(), std::cout);
-                } else {
-                    print_verbose_enabled("\033[0m\033[92mRenamed \033[94mfolder\033[0m " + directory_path.string() + "\e[1;38;5;214m -> \033[0m" + new_path.string(), std::cout);
-                }
-            }
-            dirs_count.fetch_add(1, std::memory_order_relaxed);
-        } catch (const fs::filesystem_error& e) {
-            if (e.code() == std::errc::permission_denied) {
-                if (verbose_enabled) {
-                    print_error("\033[1;91mError\033[0m: Permission denied: " + directory_path.string(), std::cout);
-                }
-            }
-            return;
-        }
-    } else {
-        if (verbose_enabled && (std::filesystem::is_symlink(directory_path) || std::filesystem::is_symlink(new_path)) && !transform_files && skipped && !special) {
-            print_verbose_enabled("\033[0m\033[93mSkipped\033[0m\033[95m symlink_folder\033[0m " + directory_path.string() + " (name unchanged)", std::cout);
-        } else if (verbose_enabled && (std::filesystem::is_symlink(directory_path) || std::filesystem::is_symlink(new_path)) && transform_dirs && transform_files && !special && skipped) {
-            print_verbose_enabled("\033[0m\033[93mSkipped\033[0m\033[95m symlink_folder\033[0m " + directory_path.string() + " (name unchanged)", std::cout);
-        }
-        if (!rename_parents && isFirstRun) {
-            // First-run root path: do not print skipped for the root itself
-        } else {
-            if (verbose_enabled && !transform_files && skipped && !special) {
-                print_verbose_enabled("\033[0m\033[93mSkipped\033[0m\033[94m folder\033[0m " + directory_path.string() + " (name unchanged)", std::cout);
-            } else if (verbose_enabled && transform_dirs && transform_files && !special && skipped) {
-                print_verbose_enabled("\033[0m\033[93mSkipped\033[0m\033[94m folder\033[0m " + directory_path.string() + " (name unchanged)", std::cout);
-            }
-        }
-    }
-
-    if (isFirstRun) {
-        isFirstRun = false;
-    }
-
-    // Process directory contents
-    if (depth != 0) {
-            int child_depth = (depth > 0) ? depth - 1 : depth;
-
-        std::vector<fs::path> dir_batch;
-        std::vector<fs::path> file_batch;
-        dir_batch.reserve(batch_size_folders);
-        file_batch.reserve(batch_size_files);
-
-        for (const auto& entry : fs::directory_iterator(new_path)) {
-            if (entry.is_directory()) {
-                if (rename_parents) {
-                    rename_directory(entry.path(), case_input, false, verbose_enabled,
-                                   transform_dirs, transform_files, files_count, dirs_count,
-                                   child_depth, batch_size_files, batch_size_folders, symlinks,
-                                   skipped_file_count, skipped_folder_count,
-                                   skipped_folder_special_count, skipped, skipped_only,
-                                   isFirstRun, special, num_paths);
-                } else {
-                    dir_batch.emplace_back(entry.path());
-                }
-            } else {
-                file_batch.emplace_back(entry.path());
-            }
-        }
-
-        // Parallel directory processing
-        process_in_batches(dir_batch, batch_size_folders, num_threads,
-            [&](const fs::path& dir) {
-                rename_directory(dir, case_input, false, verbose_enabled,
-                               transform_dirs, transform_files, files_count, dirs_count,
-                               child_depth, batch_size_files, batch_size_folders, symlinks,
-                               skipped_file_count, skipped_folder_count,
-                               skipped_folder_special_count, skipped, skipped_only,
-                               isFirstRun, special, num_paths);
-            });
-
-        // Parallel file processing
-        process_in_batches(file_batch, batch_size_files, num_threads,
-            [&](const fs::path& file) {
-                rename_file(file, case_input, false, verbose_enabled,
-                          transform_dirs, transform_files, files_count, dirs_count,
-                          batch_size_files, symlinks, skipped_file_count,
-                          skipped_folder_count, skipped, skipped_only);
-            });
+// Function to stop the run on the first SIGINT/SIGTERM, a second one exits at once
+static void handle_interrupt(int signal_number) {
+    if (interrupt_requested.exchange(true)) {
+        restoreInput();
+        _exit(128 + signal_number);
     }
 }
 
 
-// Function to rename paths (directories and files) based on specified transformations
-void rename_path(const std::vector<std::string>& paths, const std::string& case_input, bool rename_parents, bool verbose_enabled, bool transform_dirs, bool transform_files, std::atomic<int>& depth, std::atomic<int>& files_count, std::atomic<int>& dirs_count, size_t batch_size_files, size_t batch_size_folders, bool symlinks, std::atomic<int>& skipped_file_count, std::atomic<int>& skipped_folder_count, std::atomic<int>& skipped_folder_special_count, bool skipped, bool skipped_only, std::atomic<bool>& isFirstRun, bool non_interactive, std::atomic<bool>& special) {
-    auto start_time = std::chrono::steady_clock::now();
-    int num_paths = static_cast<int>(paths.size());
-    // shared atomic simultaneously.
-    #pragma omp parallel for schedule(dynamic) num_threads(max_threads) default(none) \
-        shared(paths, case_input, rename_parents, verbose_enabled, transform_dirs, \
-               transform_files, depth, files_count, dirs_count, batch_size_files, \
-               batch_size_folders, symlinks, skipped_file_count, skipped_folder_count, \
-               skipped_folder_special_count, skipped, skipped_only, isFirstRun, \
-               special, num_paths)
-    for (int i = 0; i < num_paths; ++i) {
-        // its own independent path, so the final value (false) is correct once
-        // all paths have started. For single-path use this is straightforward.
-        isFirstRun = true;
-
-        fs::path current_path(paths[i]);
-        if (fs::exists(current_path)) {
-            if (fs::is_directory(current_path)) {
-                if (rename_parents) {
-                    fs::path immediate_parent_path = current_path.parent_path();
-                    rename_directory(immediate_parent_path, case_input, rename_parents, verbose_enabled, transform_dirs, transform_files, files_count, dirs_count, depth, batch_size_files, batch_size_folders, symlinks, skipped_file_count, skipped_folder_count, skipped_folder_special_count, skipped, skipped_only, isFirstRun, special, num_paths);
-                } else {
-                    rename_directory(current_path, case_input, rename_parents, verbose_enabled, transform_dirs, transform_files, files_count, dirs_count, depth, batch_size_files, batch_size_folders, symlinks, skipped_file_count, skipped_folder_count, skipped_folder_special_count, skipped, skipped_only, isFirstRun, special, num_paths);
-                }
-            } else if (fs::is_regular_file(current_path)) {
-                rename_file(current_path, case_input, false, verbose_enabled, transform_dirs, transform_files, files_count, dirs_count, batch_size_files, symlinks, skipped_file_count, skipped_folder_count, skipped, skipped_only);
-            }
-        }
-    }
-
-    auto end_time = std::chrono::steady_clock::now();
-    std::chrono::duration<double> elapsed_seconds = end_time - start_time;
-
-    if (verbose_enabled) {
-        std::cout << "\n";
-    }
-    if (!non_interactive || verbose_enabled) {
-        std::cout << "\n\033[1A\033[K\033[0;1mRenamed: \033[1;92m" << files_count << " file(s) \033[0;1m&& \033[1;94m"
-                  << dirs_count << " folder(s) \033[1m\033[0;1m| Skipped: \033[1;93m" << skipped_file_count << " file(s) \033[0;1m&& \033[1;93m";
-
-        if (special) {
-            std::cout << skipped_folder_special_count << " folder(s) ";
-        } else {
-            std::cout << skipped_folder_count << " folder(s) ";
-        }
-
-        std::cout << "\033[0m\033[0;1m| From: \033[1;95m" << paths.size() << " input path(s)"
-                  << "\n\n\033[0;1mTime Elapsed: " << std::setprecision(1)
-                  << std::fixed << elapsed_seconds.count() << "\033[1m second(s)\n\n";
-    }
+// Function to install the SIGINT/SIGTERM handlers for the rename phase
+void install_interrupt_handlers() {
+    struct sigaction action{};
+    action.sa_handler = handle_interrupt;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGINT, &action, nullptr);
+    sigaction(SIGTERM, &action, nullptr);
 }
 
 
@@ -814,6 +247,8 @@ std::string example_transform(const std::string& mode, std::string word, bool ce
         word = "1Te0st2";
     } else if (!ce_flag && mode == "rbra") {
         word = "[{Test}]";
+    } else if (mode == "hash" || mode == "hash:sha256") {
+        word = "Test.txt";
     } else {
         word = "Test";
     }
@@ -847,10 +282,16 @@ std::string example_transform(const std::string& mode, std::string word, bool ce
         transformed_word = ce_flag ? "Test.txt" : "Te st";
     } else if (mode == "rkebab") {
         transformed_word = ce_flag ? "Test.txt" : "Te st";
-    } else if (mode == "date") {
+    } else if (mode == "date" || mode == "date:mtime" || mode == "date:btime") {
         transformed_word = ce_flag ? "Test.txt" : "Test_20240215";
     } else if (mode == "sequence") {
         transformed_word = ce_flag ? "Test.txt" : "001_Test";
+    } else if (mode == "hash") {
+        transformed_word = "ef46db3751d8e999.txt";
+    } else if (mode == "hash:sha256") {
+        transformed_word = "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855.txt";
+    } else if (mode == "exif") {
+        transformed_word = "20240215_143210";
     } else if (mode == "rsequence") {
         transformed_word = ce_flag ? "Test.txt" : "Test";
     } else if (mode == "rdate") {
@@ -869,6 +310,9 @@ std::string example_transform(const std::string& mode, std::string word, bool ce
         transformed_word = ce_flag ? "Test.txt" : "Test";
     } else if (mode == "noext") {
         transformed_word = "Test";
+    } else if (const PluginMode* plugin_mode = find_plugin_mode(mode)) {
+        transformed_word = word;
+        plugin_transform(*plugin_mode, transformed_word, false);
     } else {
         transformed_word = word;
     }
@@ -881,29 +325,35 @@ std::string example_transform(const std::string& mode, std::string word, bool ce
 int main(int argc, char *argv[]) {
     std::vector<std::string> paths;
     std::string case_input;
+    std::string template_text;
     bool rename_parents = false;
     bool rename_extensions = false;
     bool verbose_enabled = false;
-    std::atomic<int> skipped_folder_special_count{0};
-    std::atomic<int> skipped_folder_count{0};
-    std::atomic<int> skipped_file_count{0};
-    std::atomic<int> files_count{0};
-    std::atomic<int> dirs_count{0};
-    std::atomic<int> depth{-1};
+    int depth = -1;
     bool case_specified = false;
     bool transform_dirs = true;
     bool transform_files = true;
     bool skipped = false;
     bool skipped_only = false;
     bool symlinks = false;
-    std::atomic<bool> isFirstRun{true};
-    std::atomic<bool> special{false};
     bool non_interactive = false;
-    constexpr int batch_size_files = 1000;
-    constexpr int batch_size_folders = 100;
+    bool one_file_system = false;
+    bool progress = false;
+    std::string checkpoint_path;
+    std::string connect_path;
+    std::string archive_input;
+    std::string archive_output;
+    RenameDurability durability = RenameDurability::None;
+    size_t memory_budget = 0;
+    size_t batch_files = 0;
+    size_t batch_folders = 0;
+    size_t in_flight = 0;
+    RenameFilter filter;
+    bool filtered = false;
 
     const std::unordered_set<std::string> valid_flags = {
-        "-fi", "-sym", "-fo", "-d", "-v", "--verbose", "-vs", "-vso", "-ni", "-h", "--help", "-c", "-cp", "-ce"
+        "-fi", "-sym", "-fo", "-d", "-v", "--verbose", "-vs", "-vso", "-ni", "-h", "--help", "-c", "-cp", "-ce", "-t", "--one-file-system", "--max-memory", "--progress", "--resume", "--serve", "--connect", "--plugin", "--archive", "--batch-files", "--batch-folders", "--in-flight",
+        "--newer", "--older", "--min-size", "--max-size", "--uid", "--gid"
     };
 
     if (argc == 1) {
@@ -916,11 +366,32 @@ int main(int argc, char *argv[]) {
         return 0;
     }
 
+    if (argc > 1 && std::string(argv[1]) == "--serve") {
+        bool usage_ok = argc >= 3 && argc % 2 == 1;
+        for (int i = 3; usage_ok && i < argc; i += 2) {
+            usage_ok = std::string(argv[i]) == "--plugin";
+        }
+        if (!usage_ok) {
+            print_error("\n\033[1;91mError: --serve takes only a socket path and --plugin options, e.g. --serve /run/user/1000/brpp.sock\033[0m\n");
+            return 1;
+        }
+        // Jobs in plugin modes need the plugins loaded in the daemon
+        for (int i = 3; i < argc; i += 2) {
+            std::string error;
+            if (!RenameEngine::load_plugin(argv[i + 1], error)) {
+                print_error("\n\033[1;91mError: " + error + "\033[0m\n");
+                return 1;
+            }
+        }
+        return serve_jobs(argv[2]);
+    }
+
     bool fi_flag = false;
     bool fo_flag = false;
     bool c_flag = false;
     bool cp_flag = false;
     bool ce_flag = false;
+    bool t_flag = false;
     bool ni_flag = false;
     bool v_flag = false;
     bool vs_flag = false;
@@ -928,7 +399,7 @@ int main(int argc, char *argv[]) {
 
     for (int i = 1; i < argc; ++i) {
         std::string arg(argv[i]);
-        if (valid_flags.count(arg) || arg.substr(0, 2) == "-d") {
+        if (valid_flags.count(arg) || arg.substr(0, 2) == "-d" || arg.rfind("--durability", 0) == 0) {
             if (arg == "-fi") {
                 transform_dirs = false;
                 fi_flag = true;
@@ -971,6 +442,99 @@ int main(int argc, char *argv[]) {
                 verbose_enabled = true;
                 skipped = true;
                 skipped_only = true;
+            } else if (arg == "--one-file-system") {
+                one_file_system = true;
+            } else if (arg == "--progress") {
+                progress = true;
+            } else if (arg.rfind("--durability", 0) == 0) {
+                std::string level;
+                if (arg.size() > 12 && arg[12] == '=') {
+                    level = arg.substr(13);
+                } else if (arg.size() == 12 && i + 1 < argc) {
+                    level = argv[++i];
+                }
+                if (level == "none") {
+                    durability = RenameDurability::None;
+                } else if (level == "dirs") {
+                    durability = RenameDurability::Dirs;
+                } else if (level == "fs") {
+                    durability = RenameDurability::Fs;
+                } else {
+                    print_error("\n\033[1;91mError: Durability must be none, dirs or fs, e.g. --durability=dirs\033[0m\n");
+                    return 1;
+                }
+            } else if (arg == "--serve") {
+                print_error("\n\033[1;91mError: --serve must be the only option.\033[0m\n");
+                return 1;
+            } else if (arg == "--plugin") {
+                if (i + 1 >= argc) {
+                    print_error("\n\033[1;91mError: Missing argument for option " + arg + "\033[0m\n");
+                    return 1;
+                }
+                // Loaded right away, so the mode check below knows the plugin modes
+                std::string error;
+                if (!RenameEngine::load_plugin(argv[++i], error)) {
+                    print_error("\n\033[1;91mError: " + error + "\033[0m\n");
+                    return 1;
+                }
+            } else if (arg == "--connect") {
+                if (i + 1 >= argc) {
+                    print_error("\n\033[1;91mError: Missing argument for option " + arg + "\033[0m\n");
+                    return 1;
+                }
+                connect_path = argv[++i];
+            } else if (arg == "--archive") {
+                if (i + 2 >= argc || valid_flags.count(argv[i + 1]) || valid_flags.count(argv[i + 2])) {
+                    print_error("\n\033[1;91mError: --archive takes an input and an output archive, e.g. --archive in.tar out.tar\033[0m\n");
+                    return 1;
+                }
+                archive_input = argv[++i];
+                archive_output = argv[++i];
+            } else if (arg == "--resume") {
+                if (i + 1 >= argc) {
+                    print_error("\n\033[1;91mError: Missing argument for option " + arg + "\033[0m\n");
+                    return 1;
+                }
+                checkpoint_path = argv[++i];
+            } else if (arg == "--batch-files" || arg == "--batch-folders" || arg == "--in-flight") {
+                size_t& value = arg == "--batch-files" ? batch_files : (arg == "--batch-folders" ? batch_folders : in_flight);
+                const char* text = i + 1 < argc ? argv[i + 1] : "";
+                const auto [end, error] = std::from_chars(text, text + std::strlen(text), value);
+                if (error != std::errc() || *end != '\0' || value == 0 || value > 1000000) {
+                    print_error("\n\033[1;91mError: " + arg + " must be a positive integer.\033[0m\n");
+                    return 1;
+                }
+                ++i;
+            } else if (arg == "--newer" || arg == "--older") {
+                int64_t& seconds = arg == "--newer" ? filter.newer_than : filter.older_than;
+                if (i + 1 >= argc || !parse_filter_time(argv[i + 1], seconds)) {
+                    print_error("\n\033[1;91mError: " + arg + " takes an age or a date, e.g. 24h, 7d or 2024-01-15.\033[0m\n");
+                    return 1;
+                }
+                filtered = true;
+                ++i;
+            } else if (arg == "--min-size" || arg == "--max-size") {
+                size_t bytes = 0;
+                if (i + 1 >= argc || !parse_memory_size(argv[i + 1], bytes)) {
+                    print_error("\n\033[1;91mError: " + arg + " takes a size, e.g. 100K or 2G.\033[0m\n");
+                    return 1;
+                }
+                (arg == "--min-size" ? filter.min_size : filter.max_size) = bytes;
+                filtered = true;
+                ++i;
+            } else if (arg == "--uid" || arg == "--gid") {
+                if (i + 1 >= argc || !parse_filter_owner(argv[i + 1], arg == "--gid", arg == "--uid" ? filter.uid : filter.gid)) {
+                    print_error("\n\033[1;91mError: " + arg + " takes a " + (arg == "--uid" ? "user" : "group") + " name or number.\033[0m\n");
+                    return 1;
+                }
+                filtered = true;
+                ++i;
+            } else if (arg == "--max-memory") {
+                if (i + 1 >= argc || !parse_memory_size(argv[i + 1], memory_budget) || memory_budget == 0) {
+                    print_error("\n\033[1;91mError: Memory budget must be a positive size, e.g. 512M or 2G.\033[0m\n");
+                    return 1;
+                }
+                ++i;
             } else if (arg == "-ni") {
                 non_interactive = true;
                 ni_flag = true;
@@ -979,8 +543,8 @@ int main(int argc, char *argv[]) {
                 print_help();
                 return 0;
             } else if (arg == "-c") {
-                if (c_flag || cp_flag || ce_flag) {
-                    print_error("\n\033[1;91mError: Cannot mix -c, -cp, and -ce options.\033[0m\n");
+                if (c_flag || cp_flag || ce_flag || t_flag) {
+                    print_error("\n\033[1;91mError: Cannot mix -c, -cp, -ce and -t options.\033[0m\n");
                     return 1;
                 }
                 c_flag = true;
@@ -992,8 +556,8 @@ int main(int argc, char *argv[]) {
                     return 1;
                 }
             } else if (arg == "-cp") {
-                if (c_flag || cp_flag || ce_flag) {
-                    print_error("\n\033[1;91mError: Cannot mix -c, -cp, and -ce options.\033[0m\n");
+                if (c_flag || cp_flag || ce_flag || t_flag) {
+                    print_error("\n\033[1;91mError: Cannot mix -c, -cp, -ce and -t options.\033[0m\n");
                     return 1;
                 }
                 cp_flag = true;
@@ -1005,9 +569,22 @@ int main(int argc, char *argv[]) {
                     print_error("\n\033[1;91mError: Missing argument for option " + arg + "\033[0m\n");
                     return 1;
                 }
+            } else if (arg == "-t") {
+                if (c_flag || cp_flag || ce_flag || t_flag) {
+                    print_error("\n\033[1;91mError: Cannot mix -c, -cp, -ce and -t options.\033[0m\n");
+                    return 1;
+                }
+                t_flag = true;
+                if (i + 1 < argc) {
+                    template_text = argv[++i];
+                    case_specified = true;
+                } else {
+                    print_error("\n\033[1;91mError: Missing argument for option " + arg + "\033[0m\n");
+                    return 1;
+                }
             } else if (arg == "-ce") {
-                if (c_flag || cp_flag || ce_flag) {
-                    print_error("\n\033[1;91mError: Cannot mix -c, -cp, and -ce options.\033[0m\n");
+                if (c_flag || cp_flag || ce_flag || t_flag) {
+                    print_error("\n\033[1;91mError: Cannot mix -c, -cp, -ce and -t options.\033[0m\n");
                     return 1;
                 }
                 if (fi_flag || fo_flag) {
@@ -1036,38 +613,71 @@ int main(int argc, char *argv[]) {
     std::string word;
     std::string result = example_transform(case_input, word, ce_flag);
 
+    // The template is compiled here once to report errors before anything runs, and rendered
+    // for the example of the confirmation prompt
+    if (t_flag) {
+        NameTemplate program;
+        std::string error;
+        if (!compile_name_template(template_text, program, error)) {
+            print_error("\n\033[1;91mError: " + error + " - " + template_text + "\033[0m\n");
+            return 1;
+        }
+        struct statx example_stx {};
+        example_stx.stx_mask = STATX_MTIME | STATX_BTIME;
+        example_stx.stx_mtime.tv_sec = example_stx.stx_btime.tv_sec = std::time(nullptr);
+        std::string example;
+        render_name_template(program, "IMG_1234.JPG", "Photos", 1, example_stx, example);
+        result = template_text + " \033[0;1m(e.g., \033[38;5;130mPhotos/IMG_1234.JPG => " + example + "\033[0;1m)\033[0m";
+    }
+
     if (fi_flag && fo_flag) {
         print_error("\n\033[1;91mError: Cannot mix -fi and -fo options.\033[0m\n");
         return 1;
     }
 
+    if (filtered && fo_flag) {
+        print_error("\n\033[1;91mError: --newer, --older, --min-size, --max-size, --uid and --gid select files, they do not go with -fo.\033[0m\n");
+        return 1;
+    }
+
     if ((v_flag && (vs_flag || vso_flag)) || (vs_flag && (v_flag || vso_flag)) || (vso_flag && (v_flag || vs_flag))) {
         print_error("\n\033[1;91mError: Cannot mix -v, -vs, and -vso options.\033[0m\n");
         return 1;
     }
 
     if (!case_specified) {
-        print_error("\n\033[1;91mError: Case conversion mode not specified (-c, -cp, or -ce option is required)\033[0m\n");
+        print_error("\n\033[1;91mError: Case conversion mode not specified (-c, -cp, -ce or -t option is required)\033[0m\n");
         return 1;
     }
-    std::vector<std::string> valid_modes;
-    if (ce_flag) {
-        valid_modes = {"lower", "upper", "reverse", "title", "swap", "swapr", "rbak", "bak", "noext"};
-    } else {
-        // valid for both -c and -cp
-        valid_modes = {"lower", "upper", "reverse", "title", "date", "swap", "swapr", "rdate",
-                       "pascal", "rpascal", "camel", "sentence", "rcamel", "kebab", "rkebab",
-                       "rsnake", "snake", "rnumeric", "rspecial", "rbra", "roperand",
-                       "sequence", "rsequence"};
+    if (cp_flag && case_input == "sequence") {
+        print_error("\n\033[1;91mError: sequence mode is only available with -c option.\033[0m\n");
+        return 1;
+    }
+
+    // Archive jobs rename member names, the options of a directory walk do not apply
+    if (!archive_input.empty()) {
+        if (!c_flag || !paths.empty() || depth != -1 || one_file_system || progress || memory_budget != 0 || !checkpoint_path.empty() ||
+            !connect_path.empty() || durability != RenameDurability::None || batch_files != 0 || batch_folders != 0 || in_flight != 0 || filtered) {
+            print_error("\n\033[1;91mError: --archive takes -c, -fi, -fo, -sym, -v, -vs, -vso, -ni and --plugin only, and no paths.\033[0m\n");
+            return 1;
+        }
+        if (name_transform(case_input) == nullptr && find_plugin_mode(case_input) == nullptr) {
+            print_error("\n\033[1;91mError: Mode " + case_input + " needs the files on disk, archive members take the modes that only change names.\033[0m\n");
+            return 1;
+        }
     }
 
-    if (std::find(valid_modes.begin(), valid_modes.end(), case_input) == valid_modes.end()) {
+    const RenameScope scope = ce_flag ? RenameScope::Extensions : (cp_flag ? RenameScope::LowestParents : RenameScope::Names);
+    if (!t_flag && !RenameEngine::valid_case_mode(case_input, scope)) {
         print_error("\n\033[1;91mError: Unspecified or invalid case mode - " + case_input + ". Run 'bulk_rename++ --help'.\033[0m\n");
         return 1;
     }
 
-    if (cp_flag && case_input == "sequence") {
-        print_error("\n\033[1;91mError: sequence mode is only available with -c option.\033[0m\n");
+    // A folder the interrupt caught midway is walked again, only a mode that leaves its own result
+    // unchanged can take it twice
+    if (!checkpoint_path.empty() && (t_flag || !resumable_mode(case_input, ce_flag))) {
+        print_error("\n\033[1;91mError: --resume cannot take " + (t_flag ? std::string("-t") : "mode " + case_input) +
+                    ", it renames already renamed entries again. Resumable modes leave their own result unchanged, e.g. lower, snake or title.\033[0m\n");
         return 1;
     }
 
@@ -1090,12 +700,25 @@ int main(int argc, char *argv[]) {
     }
 
     std::string confirmation;
-    if (rename_parents && !ni_flag) {
+    if (!archive_input.empty() && !ni_flag) {
+        std::cout << "\033[0;1mThe members of the following archive will be renamed to \033[0m\e[1;38;5;214m"
+                  << result;
+        if (!transform_dirs) {
+            std::cout << "\033[0;1m (excluding directories)";
+        } else if (!transform_files) {
+            std::cout << "\033[0;1m (excluding files)";
+        }
+        std::cout << "\033[0;1m and written to \033[1;94m" << archive_output << "\033[0;1m:\033[1m\n";
+        std::cout << "\n" << "\033[1;94m" << archive_input << "\033[0m";
+    } else if (rename_parents && !ni_flag) {
         std::cout << "\033[0;1mThe following path(s) and their \033[4mlowest Parent\033[0;1m dir(s), will be recursively renamed to \033[0m\e[1;38;5;214m"
                   << result;
         if (depth != -1) {
             std::cout << "\033[0;1m (up to depth " << depth << ")";
         }
+        if (filtered) {
+            std::cout << "\033[0;1m (only files matching the filters)";
+        }
         if (!transform_dirs) {
             std::cout << "\033[0;1m (excluding directories)";
         }
@@ -1112,6 +735,9 @@ int main(int argc, char *argv[]) {
         if (depth != -1) {
             std::cout << "\033[0;1m (up to depth " << depth << ")";
         }
+        if (filtered) {
+            std::cout << "\033[0;1m (only files matching the filters)";
+        }
         std::cout << ":\033[1m\n";
         for (const auto& path : paths) {
             std::cout << "\n" << "\033[1;94m" << path << "\033[0m";
@@ -1122,6 +748,9 @@ int main(int argc, char *argv[]) {
         if (depth != -1) {
             std::cout << "\033[0;1m (up to depth " << depth << ")";
         }
+        if (filtered) {
+            std::cout << "\033[0;1m (only files matching the filters)";
+        }
         if (!transform_dirs && rename_parents) {
             std::cout << "\033[0;1m (excluding both files and directories)";
         } else if (!transform_dirs) {
@@ -1149,16 +778,52 @@ int main(int argc, char *argv[]) {
         }
     }
 
+    RenameOptions options;
+    options.case_mode = case_input;
+    options.name_template = template_text;
+    options.scope = scope;
+    options.rename_folders = transform_dirs;
+    options.rename_files = transform_files;
+    options.depth = depth;
+    options.follow_symlinks = symlinks;
+    options.one_file_system = one_file_system;
+    options.report_renamed = verbose_enabled && !skipped_only;
+    options.report_skipped = skipped;
+    options.max_memory = memory_budget;
+    options.checkpoint_path = checkpoint_path;
+    options.progress = progress;
+    options.durability = durability;
+    options.batch_size_files = batch_files;
+    options.batch_size_folders = batch_folders;
+    options.in_flight = static_cast<unsigned int>(in_flight);
+    options.filter = filter;
+
     if (!ni_flag) disableInput();
 
-    if (rename_parents) {
-        rename_path(paths, case_input, true, verbose_enabled, transform_dirs, transform_files, depth, files_count, dirs_count, batch_size_files, batch_size_folders, symlinks, skipped_file_count, skipped_folder_count, skipped_folder_special_count, skipped, skipped_only, isFirstRun, non_interactive, special);
-    } else if (rename_extensions) {
-        rename_extension_path(paths, case_input, verbose_enabled, depth, files_count, batch_size_files, symlinks, skipped_file_count, skipped, skipped_only, non_interactive);
-    } else if (!transform_dirs) {
-        rename_path(paths, case_input, rename_parents, verbose_enabled, transform_dirs, transform_files, depth, files_count, dirs_count, batch_size_files, batch_size_folders, symlinks, skipped_file_count, skipped_folder_count, skipped_folder_special_count, skipped, skipped_only, isFirstRun, non_interactive, special);
-    } else {
-        rename_path(paths, case_input, rename_parents, verbose_enabled, transform_dirs, transform_files, depth, files_count, dirs_count, batch_size_files, batch_size_folders, symlinks, skipped_file_count, skipped_folder_count, skipped_folder_special_count, skipped, skipped_only, isFirstRun, non_interactive, special);
+    // SIGINT/SIGTERM let the running batches finish, then the checkpoint is flushed
+    install_interrupt_handlers();
+
+    // With --connect the job runs on a --serve daemon and its events stream back here
+    const RenameResult outcome = !archive_input.empty() ? RenameEngine(options).run_archive(archive_input, archive_output)
+                                 : connect_path.empty() ? RenameEngine(options).run(paths) : run_remote_job(connect_path, options, paths);
+
+    if (!outcome.error.empty()) {
+        if (!ni_flag) restoreInput();
+        print_error("\n\033[1;91mError: " + outcome.error + "\033[0m\n");
+        return 1;
+    }
+
+    if (!non_interactive || verbose_enabled) {
+        print_summary(outcome, rename_extensions, one_file_system, verbose_enabled);
+    }
+
+    if (outcome.interrupted) {
+        if (!ni_flag) {
+            flushStdin();
+            restoreInput();
+        }
+        print_error("\033[1;93mInterrupted\033[0m" + (checkpoint_path.empty() ? std::string() : ", run again with --resume " + checkpoint_path + " to continue"));
+        return 130;
     }
 
     if (!ni_flag) {
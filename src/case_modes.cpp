@@ -262,6 +262,120 @@ std::string get_renamed_folder_name_without_numbering(const std::string& folder_
 }
 
 
+// Date stamps
+
+// A timestamp is dated with the UTC offset in force at that moment, not the run's: a file from
+// last winter keeps its winter date in summer. The offsets are cached per UTC day in direct-mapped
+// slots, an atomic word each (day + 1 and offset), so formatting takes no tz lock. A day with a
+// DST change is stored as mixed and asks localtime_r() for every timestamp in it.
+// reset_date_stamps() clears the slots and takes today's stamp at the start of each run.
+static constexpr size_t offset_slots = 4096;
+// Offsets are stored biased into 20 bits, the largest value marks a mixed day
+static constexpr std::int64_t offset_bias = 1 << 19;
+static constexpr std::int64_t offset_mixed = offset_bias - 1;
+static std::atomic<std::uint64_t> day_offsets[offset_slots];
+static std::string today_stamp;
+
+
+// Function to ask the C library for the UTC offset in force at a timestamp
+static long libc_utc_offset(std::int64_t seconds) {
+    const std::time_t time = static_cast<std::time_t>(seconds);
+    std::tm local_tm{};
+    return localtime_r(&time, &local_tm) ? local_tm.tm_gmtoff : 0;
+}
+
+
+// Function to get the UTC offset in force at a timestamp, through the per-day cache
+static long utc_offset_at(std::int64_t seconds) {
+    const std::int64_t day = seconds / 86400 - (seconds % 86400 < 0 ? 1 : 0);
+    // Days beyond what fits next to the offset go to the C library
+    if (day < -(std::int64_t(1) << 42) || day >= (std::int64_t(1) << 42)) {
+        return libc_utc_offset(seconds);
+    }
+    std::atomic<std::uint64_t>& slot = day_offsets[static_cast<std::uint64_t>(day) % offset_slots];
+    const std::uint64_t tag = static_cast<std::uint64_t>(day + 1) << 20;
+    const std::uint64_t entry = slot.load(std::memory_order_relaxed);
+    std::int64_t offset;
+    if (entry != 0 && (entry & ~std::uint64_t(0xfffff)) == tag) {
+        offset = static_cast<std::int64_t>(entry & 0xfffff) - offset_bias;
+    } else {
+        const long first = libc_utc_offset(day * 86400);
+        offset = first == libc_utc_offset(day * 86400 + 86399) ? first : offset_mixed;
+        slot.store(tag | static_cast<std::uint64_t>(offset + offset_bias), std::memory_order_relaxed);
+    }
+    return offset == offset_mixed ? libc_utc_offset(seconds) : static_cast<long>(offset);
+}
+
+
+// Function to format a timestamp as local YYYYMMDD into out[0..7], without locale, locks or allocation
+void format_date_stamp(std::int64_t seconds, char* out) {
+    // Days since the epoch, floored, then civil-from-days (proleptic Gregorian calendar)
+    std::int64_t local_seconds = seconds + utc_offset_at(seconds);
+    std::int64_t days = local_seconds / 86400 - (local_seconds % 86400 < 0 ? 1 : 0);
+    days += 719468;
+    const std::int64_t era = (days >= 0 ? days : days - 146096) / 146097;
+    const unsigned day_of_era = static_cast<unsigned>(days - era * 146097);
+    const unsigned year_of_era = (day_of_era - day_of_era / 1460 + day_of_era / 36524 - day_of_era / 146096) / 365;
+    const unsigned day_of_year = day_of_era - (365 * year_of_era + year_of_era / 4 - year_of_era / 100);
+    const unsigned month_index = (5 * day_of_year + 2) / 153;
+    const unsigned day = day_of_year - (153 * month_index + 2) / 5 + 1;
+    const unsigned month = month_index < 10 ? month_index + 3 : month_index - 9;
+    const std::int64_t year = static_cast<std::int64_t>(year_of_era) + era * 400 + (month <= 2 ? 1 : 0);
+
+    unsigned year_digits = static_cast<unsigned>(std::clamp<std::int64_t>(year, 0, 9999));
+    for (int i = 3; i >= 0; --i) {
+        out[i] = static_cast<char>('0' + year_digits % 10);
+        year_digits /= 10;
+    }
+    out[4] = static_cast<char>('0' + month / 10);
+    out[5] = static_cast<char>('0' + month % 10);
+    out[6] = static_cast<char>('0' + day / 10);
+    out[7] = static_cast<char>('0' + day % 10);
+}
+
+
+// Function to take the time zone and today's date stamp for a new run, called before the workers
+// start (and by the benches before they transform)
+void reset_date_stamps() {
+    tzset();
+    for (auto& slot : day_offsets) {
+        slot.store(0, std::memory_order_relaxed);
+    }
+
+    char buffer[8];
+    format_date_stamp(static_cast<std::int64_t>(std::time(nullptr)), buffer);
+    today_stamp.assign(buffer, sizeof(buffer));
+}
+
+
+// Function to get today's date stamp, formatted once for the whole run by reset_date_stamps()
+const std::string& run_date_stamp() {
+    return today_stamp;
+}
+
+
+// Function to map a date mode to the statx timestamp it reads (0 for the run date and other modes)
+unsigned int date_stamp_mask(const std::string& case_input) {
+    if (case_input == "date:mtime") {
+        return STATX_MTIME;
+    }
+    if (case_input == "date:btime") {
+        return STATX_BTIME;
+    }
+    return 0;
+}
+
+
+// Function to format the timestamp selected by mask, false if the filesystem did not report it
+bool stat_date_stamp(const struct statx& stx, unsigned int mask, char* out) {
+    if (!(stx.stx_mask & mask)) {
+        return false;
+    }
+    format_date_stamp(mask == STATX_BTIME ? stx.stx_btime.tv_sec : stx.stx_mtime.tv_sec, out);
+    return true;
+}
+
+
 // Function to remove date suffix from folder name.
 // Accepts a bare folder name (not a full path).
 std::string get_renamed_folder_name_without_date(const std::string& folder_name) {
@@ -287,6 +401,12 @@ std::string get_renamed_folder_name_without_date(const std::string& folder_name)
 // Function to append date suffix to folder name.
 // Accepts a bare folder name (not a full path).
 std::string append_date_suffix_to_folder_name(const std::string& folder_name) {
+    return append_date_suffix_to_folder_name(folder_name, run_date_stamp());
+}
+
+
+// Function to append the given YYYYMMDD date suffix to folder name.
+std::string append_date_suffix_to_folder_name(const std::string& folder_name, std::string_view date_stamp) {
     // If the folder name is empty, return an empty string
     if (folder_name.empty())
         return "";
@@ -305,62 +425,59 @@ std::string append_date_suffix_to_folder_name(const std::string& folder_name) {
         folder_name.substr(last_underscore_pos + 1, 8).find_first_not_of("0123456789") == std::string::npos)
         return folder_name; // Already has a date suffix; do not rename
 
-    // Get the current date in YYYYMMDD format
-    auto now = std::chrono::system_clock::now();
-    auto now_time_t = std::chrono::system_clock::to_time_t(now);
-    std::tm local_tm = *std::localtime(&now_time_t);
-    std::ostringstream oss;
-    oss << std::put_time(&local_tm, "%Y%m%d");
-    std::string date_suffix = "_" + oss.str();
-
-    return folder_name + date_suffix;
+    std::string renamed;
+    renamed.reserve(folder_name.size() + 1 + date_stamp.size());
+    renamed.append(folder_name).append(1, '_').append(date_stamp);
+    return renamed;
 }
 
 
 // For Files
 
-// Function to add sequential numbering to files
-std::string append_numbered_prefix(const std::filesystem::path& parent_path, const std::string& file_string) {
-    static std::unordered_map<std::filesystem::path, std::vector<std::string>> file_map;
-
-    // Clear the file map for this parent path
-    file_map[parent_path].clear();
-
-    // Function to remove existing numeric prefix
-    auto remove_prefix = [](const std::string& filename) {
-        size_t pos = filename.find('_');
-        if (pos != std::string::npos && pos > 0 && std::all_of(filename.begin(), filename.begin() + pos, ::isdigit)) {
-            return filename.substr(pos + 1);
-        }
-        return filename;
-    };
-
-    // Collect all files in the directory
-    for (const auto& entry : std::filesystem::directory_iterator(parent_path)) {
-        if (entry.is_regular_file()) {
-            file_map[parent_path].push_back(remove_prefix(entry.path().filename().string()));
-        }
+// Function to strip an existing numeric prefix (e.g. 001_) from a file name
+std::string strip_numbered_prefix(const std::string& file_string) {
+    size_t pos = file_string.find('_');
+    if (pos != std::string::npos && pos > 0 && std::all_of(file_string.begin(), file_string.begin() + pos, ::isdigit)) {
+        return file_string.substr(pos + 1);
     }
+    return file_string;
+}
 
-    auto& files = file_map[parent_path];
 
-    // Add the new file to the list if it doesn't exist
-    std::string file_without_prefix = remove_prefix(file_string);
-    if (std::find(files.begin(), files.end(), file_without_prefix) == files.end()) {
-        files.push_back(file_without_prefix);
-    }
+// Function to build the numbered name for a file at the given 1-based position
+std::string format_numbered_prefix(size_t position, const std::string& file_string) {
+    std::ostringstream oss;
+    oss << std::setfill('0') << std::setw(3) << position << "_" << file_string;
+    return oss.str();
+}
 
-    // Sort files alphabetically by their names
-    std::sort(files.begin(), files.end());
 
-    // Find the position of the current file
-    auto it = std::find(files.begin(), files.end(), file_without_prefix);
-    int position = std::distance(files.begin(), it) + 1;
+// Function to add sequential numbering to a single file, its position is the number of
+// sibling files sorting before it. Directory walks rank a sorted listing instead.
+std::string append_numbered_prefix(const std::filesystem::path& parent_path, const std::string& file_string) {
+    const std::string file_without_prefix = strip_numbered_prefix(file_string);
+
+    // Count the files whose unnumbered name sorts before this one, no listing is kept. With a
+    // metadata filter only the files it keeps count, like in a directory walk.
+    size_t position = 1;
+    std::string sibling_path;
+    const bool listed = vfs_list(parent_path.c_str(), [&](std::string_view name, unsigned char type, uint64_t) {
+        if (type == DT_REG && strip_numbered_prefix(std::string(name)) < file_without_prefix) {
+            if (metadata_filter.checks != 0) {
+                struct statx stx;
+                join_path(sibling_path, parent_path.native(), name);
+                if (!statx_path(sibling_path.c_str(), metadata_filter.mask, true, stx) || !metadata_filter_matches(metadata_filter, stx)) {
+                    return;
+                }
+            }
+            ++position;
+        }
+    });
+    if (!listed) {
+        throw fs::filesystem_error("directory listing failed", parent_path, std::error_code(errno, std::generic_category()));
+    }
 
-    // Create the new filename
-    std::ostringstream oss;
-    oss << std::setfill('0') << std::setw(3) << position << "_" << file_without_prefix;
-    return oss.str();
+    return format_numbered_prefix(position, file_without_prefix);
 }
 
 
@@ -387,6 +504,12 @@ std::string remove_numbered_prefix(const std::string& file_string) {
 
 // Function to add current date to files
 std::string append_date_seq(const std::string& file_string) {
+    return append_date_seq(file_string, run_date_stamp());
+}
+
+
+// Function to add the given YYYYMMDD date to files, before the extension
+std::string append_date_seq(const std::string& file_string, std::string_view date_seq) {
     // Check if the filename already contains a date seq
     size_t dot_position = file_string.find_last_of('.');
     size_t underscore_position = file_string.find_last_of('_');
@@ -404,19 +527,14 @@ std::string append_date_seq(const std::string& file_string) {
         }
     }
 
-    auto now = std::chrono::system_clock::now();
-    auto time_t_now = std::chrono::system_clock::to_time_t(now);
-    std::tm* local_tm = std::localtime(&time_t_now);
-
-    std::ostringstream oss;
-    oss << std::put_time(local_tm, "%Y%m%d");
-    std::string date_seq = oss.str();
-
+    std::string renamed;
+    renamed.reserve(file_string.size() + 1 + date_seq.size());
     if (dot_position != std::string::npos) {
-        return file_string.substr(0, dot_position) + "_" + date_seq + file_string.substr(dot_position);
+        renamed.append(file_string, 0, dot_position).append(1, '_').append(date_seq).append(file_string, dot_position);
     } else {
-        return file_string + "_" + date_seq;
+        renamed.append(file_string).append(1, '_').append(date_seq);
     }
+    return renamed;
 }
 
 
@@ -447,143 +565,337 @@ std::string remove_date_seq(const std::string& file_string) {
 }
 
 
+// Mode dispatch
+
+// Function to look up a case mode that only needs the name itself, nullptr for sequence and
+// date:mtime/date:btime (they need the listing or a stat) and unknown modes. Templates resolve
+// their field transforms here once, instead of comparing mode names for every entry.
+NameTransform name_transform(std::string_view case_input) {
+    static const std::pair<std::string_view, NameTransform> transforms[] = {
+        {"lower", [](std::string& name, bool) {
+            std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+        }},
+        {"upper", [](std::string& name, bool) {
+            std::transform(name.begin(), name.end(), name.begin(), ::toupper);
+        }},
+        {"reverse", [](std::string& name, bool) {
+            std::transform(name.begin(), name.end(), name.begin(), [](unsigned char c) {
+                return std::islower(c) ? std::toupper(c) : std::tolower(c);
+            });
+        }},
+        {"title", [](std::string& name, bool) { name = capitalizeFirstLetter(name); }},
+        {"snake", [](std::string& name, bool) { std::replace(name.begin(), name.end(), ' ', '_'); }},
+        {"rsnake", [](std::string& name, bool) { std::replace(name.begin(), name.end(), '_', ' '); }},
+        {"kebab", [](std::string& name, bool) { std::replace(name.begin(), name.end(), ' ', '-'); }},
+        {"rkebab", [](std::string& name, bool) { std::replace(name.begin(), name.end(), '-', ' '); }},
+        {"rspecial", [](std::string& name, bool) {
+            name.erase(std::remove_if(name.begin(), name.end(), [](char c) {
+                return !std::isalnum(c) && c != '.' && c != '_' && c != '-' && c != '(' && c != ')' && c != '[' && c != ']' && c != '{' && c != '}' && c != '+' && c != '*' && c != '<' && c != '>' && c != ' ';
+            }), name.end());
+        }},
+        {"rnumeric", [](std::string& name, bool) {
+            name.erase(std::remove_if(name.begin(), name.end(), [](char c) {
+                return std::isdigit(c);
+            }), name.end());
+        }},
+        {"rbra", [](std::string& name, bool) {
+            name.erase(std::remove_if(name.begin(), name.end(), [](char c) {
+                return c == '[' || c == ']' || c == '{' || c == '}' || c == '(' || c == ')';
+            }), name.end());
+        }},
+        {"roperand", [](std::string& name, bool) {
+            name.erase(std::remove_if(name.begin(), name.end(), [](char c) {
+                return c == '-' || c == '+' || c == '>' || c == '<' || c == '=' || c == '*';
+            }), name.end());
+        }},
+        {"camel", [](std::string& name, bool isFile) { name = to_camel_case(name, isFile); }},
+        {"rcamel", [](std::string& name, bool) { name = from_camel_case(name); }},
+        {"rsequence", [](std::string& name, bool isFile) {
+            name = isFile ? remove_numbered_prefix(name) : get_renamed_folder_name_without_numbering(name);
+        }},
+        {"date", [](std::string& name, bool isFile) {
+            name = isFile ? append_date_seq(name) : append_date_suffix_to_folder_name(name);
+        }},
+        {"rdate", [](std::string& name, bool isFile) {
+            name = isFile ? remove_date_seq(name) : get_renamed_folder_name_without_date(name);
+        }},
+        {"sentence", [](std::string& name, bool) { name = sentenceCase(name); }},
+        {"swap", [](std::string& name, bool) { name = swap_transform(name); }},
+        {"swapr", [](std::string& name, bool) { name = swapr_transform(name); }},
+        {"pascal", [](std::string& name, bool isFile) { name = to_pascal(name, isFile); }},
+        {"rpascal", [](std::string& name, bool) { name = from_pascal_case(name); }},
+    };
+    for (const auto& [mode, transform] : transforms) {
+        if (mode == case_input) {
+            return transform;
+        }
+    }
+    return nullptr;
+}
+
+
+// Function to apply a case mode that only needs the name itself, in place. Returns false for
+// sequence and date:mtime/date:btime (they need the listing or a stat) and unknown modes.
+bool transform_name(const std::string& case_input, std::string& name, bool isFile) {
+    const NameTransform transform = name_transform(case_input);
+    if (!transform) {
+        return false;
+    }
+    transform(name, isFile);
+    return true;
+}
+
+
 // Folder numbering functions mv style
-void rename_folders_with_sequential_numbering(const fs::path& base_directory, std::string prefix, std::atomic<int>& dirs_count, std::atomic<int>& skipped_folder_special_count, int depth, bool verbose_enabled, bool skipped, bool skipped_only, bool symlinks, size_t batch_size_folders, int num_paths) {
-    // Reserve capacity for folders_to_rename
-    std::vector<std::pair<fs::path, fs::path>> folders_to_rename;
-    folders_to_rename.reserve(batch_size_folders);
 
-    // Reserve capacity for unchanged_folder_paths
-    std::vector<std::pair<fs::path, bool>> unchanged_folder_paths;
-    unchanged_folder_paths.reserve(batch_size_folders);
+// Function to build a natural-order sort key: a digit run becomes a '0' marker, its length
+// without leading zeros and its significant digits, so byte order of keys ranks "2_x" before "10_x"
+void natural_sort_key(std::string_view name, std::string& key) {
+    key.clear();
+    key.reserve(name.size() + 4);
+    size_t i = 0;
+    while (i < name.size()) {
+        if (!std::isdigit(static_cast<unsigned char>(name[i]))) {
+            key.push_back(name[i++]);
+            continue;
+        }
+        while (i < name.size() && name[i] == '0') {
+            ++i;
+        }
+        const size_t digits_begin = i;
+        while (i < name.size() && std::isdigit(static_cast<unsigned char>(name[i]))) {
+            ++i;
+        }
+        key.push_back('0');
+        key.push_back(static_cast<char>(std::min<size_t>(i - digits_begin, 255)));
+        key.append(name.substr(digits_begin, i - digits_begin));
+    }
+}
+
 
-    // Reserve capacity for folder_names
-    std::vector<std::pair<std::string, fs::path>> folder_names;
-    folder_names.reserve(batch_size_folders);
+void rename_folders_with_sequential_numbering(const fs::path& base_directory, std::string prefix, ShardedCounter& dirs_count, ShardedCounter& skipped_folder_special_count, int depth, bool verbose_enabled, bool skipped, bool skipped_only, bool symlinks, unsigned int thread_budget, bool one_file_system, dev_t root_dev) {
+    if (depth == 0) {
+        return;
+    }
 
-    bool renaming_needed = false;
+    // Function to remove any existing numbering from a folder name
+    auto remove_numbering = [](std::string_view folder_name) {
+        size_t pos = folder_name.find('_');
+        if (pos != std::string_view::npos && std::all_of(folder_name.begin(), folder_name.begin() + pos, ::isdigit)) {
+            return folder_name.substr(pos + 1);
+        }
+        return folder_name;
+    };
 
-    if (depth != 0) {
+    // Folder names keyed once by the natural-order key of their unnumbered name, spilled to disk past --max-memory
+    ListingSpool folder_names;
+    std::string sort_key;
+    std::string tie_key;
 
-        // Collect folder paths and names
-        for (const auto& folder : fs::directory_iterator(base_directory)) {
-            bool skip = !symlinks && fs::is_symlink(folder);
-            if (folder.is_directory() && !skip) {
-                std::string folder_name = folder.path().filename().string();
-                folder_names.emplace_back(folder_name, folder.path());
-            }
+    // Targets always carry a numeric prefix, so they can only collide with a sibling that already has one
+    bool numbered_sources = false;
+
+    // Collect folder names, the record type remembers symlinks for the verbose output
+    std::string folder_path;
+    const bool listed = vfs_list(base_directory.c_str(), [&](std::string_view folder_name, unsigned char type, uint64_t) {
+        if (type != DT_DIR) {
+            return;
         }
+        struct statx stx;
+        const bool have_stat = statx_path(join_path(folder_path, base_directory.native(), folder_name).c_str(), STATX_TYPE, false, stx);
+        const bool is_symlink = have_stat && S_ISLNK(stx.stx_mode);
+        bool skip = !symlinks && is_symlink;
+        // Mount points are not numbered with --one-file-system
+        if (one_file_system && have_stat && !is_symlink && statx_dev(stx) != root_dev) {
+            skip = true;
+        }
+        if (!skip) {
+            const std::string_view unnumbered = remove_numbering(folder_name);
+            numbered_sources = numbered_sources || unnumbered.size() != folder_name.size() ||
+                               (!prefix.empty() && folder_name.substr(0, prefix.size()) == prefix);
+            // Ties on the unnumbered name fall back to the natural order of the full name
+            natural_sort_key(unnumbered, sort_key);
+            sort_key.push_back('\0');
+            natural_sort_key(folder_name, tie_key);
+            sort_key += tie_key;
+            folder_names.push(sort_key, folder_name, is_symlink ? DT_LNK : DT_DIR);
+        }
+    });
+    if (!listed) {
+        throw fs::filesystem_error("directory listing failed", base_directory, std::error_code(errno, std::generic_category()));
+    }
 
-        // Sort folder names alphabetically, ignoring any existing numbering
-        std::sort(folder_names.begin(), folder_names.end(),
-            [](const auto& a, const auto& b) {
-                std::string name_a = a.first, name_b = b.first;
-                size_t pos_a = name_a.find('_');
-                size_t pos_b = name_b.find('_');
-                if (pos_a != std::string::npos && std::all_of(name_a.begin(), name_a.begin() + pos_a, ::isdigit))
-                    name_a = name_a.substr(pos_a + 1);
-                if (pos_b != std::string::npos && std::all_of(name_b.begin(), name_b.begin() + pos_b, ::isdigit))
-                    name_b = name_b.substr(pos_b + 1);
-                return name_a < name_b;
-            });
+    // Sort folder names in natural order, ignoring any existing numbering (external sort when spilled)
+    folder_names.sort();
 
-        // Check if renaming is needed
-        int expected_counter = 1;
-        for (const auto& [folder_name, folder_path] : folder_names) {
-            size_t pos = folder_name.find('_');
-            if (pos == std::string::npos || !std::all_of(folder_name.begin(), folder_name.begin() + pos, ::isdigit)) {
-                renaming_needed = true;
-                break;
-            }
-            int current_number = std::stoi(folder_name.substr(0, pos));
-            if (current_number != expected_counter) {
-                renaming_needed = true;
-                break;
-            }
-            expected_counter++;
+    // Check if renaming is needed
+    ListingSpool::Record record;
+    bool renaming_needed = false;
+    int expected_counter = 1;
+    folder_names.rewind();
+    while (folder_names.next(record)) {
+        const std::string_view folder_name = record.name;
+        size_t pos = folder_name.find('_');
+        if (pos == std::string_view::npos || !std::all_of(folder_name.begin(), folder_name.begin() + pos, ::isdigit)) {
+            renaming_needed = true;
+            break;
+        }
+        int current_number = 0;
+        const auto parsed = std::from_chars(folder_name.data(), folder_name.data() + pos, current_number);
+        if (parsed.ec != std::errc() || current_number != expected_counter) {
+            renaming_needed = true;
+            break;
         }
+        expected_counter++;
+    }
 
-        // Process sorted folder names only if renaming is needed
-        if (renaming_needed) {
-            int counter = 1;
-            for (const auto& [folder_name, folder_path] : folder_names) {
-                // Remove any existing numbering from the folder name
-                std::string original_name = folder_name;
-                size_t pos = folder_name.find('_');
-                if (pos != std::string::npos && std::all_of(folder_name.begin(), folder_name.begin() + pos, ::isdigit)) {
-                    original_name = folder_name.substr(pos + 1);
+    // A target may still be held by a sibling awaiting its own rename, and renaming a folder over
+    // an empty one replaces it. Re-numbering therefore moves every renamed folder to a temporary
+    // name first and only then to its target, fresh numbering renames directly.
+    enum class Pass { Direct, ToTemporary, FromTemporary };
+    const std::string temporary_prefix = ".bulk_rename++_" + std::to_string(::getpid()) + "_";
+
+    // Rename and report in bounded chunks, old and new names are arena nodes under base_directory
+    struct FolderRename {
+        PathArena::Node old_node;
+        PathArena::Node new_node;
+        PathArena::Node original_node;
+        bool is_symlink;
+    };
+    const size_t batch_size_folders = folder_batch_size();
+    const size_t chunk_size = batch_size_folders * std::max(1u, thread_budget);
+    PathArena chunk;
+    std::vector<FolderRename> folders_to_rename;
+    std::vector<std::pair<PathArena::Node, bool>> unchanged_folder_paths;
+    folders_to_rename.reserve(chunk_size);
+    unchanged_folder_paths.reserve(chunk_size);
+    std::string new_filename;
+    std::string temporary_name;
+
+    auto run_pass = [&](Pass pass) {
+        const bool final_pass = pass != Pass::ToTemporary;
+        int counter = 1;
+        bool more = true;
+        folder_names.rewind();
+        while (more) {
+            chunk.clear();
+            folders_to_rename.clear();
+            unchanged_folder_paths.clear();
+            const PathArena::Node root = chunk.add(PathArena::no_parent, base_directory.native());
+
+            while (folders_to_rename.size() + unchanged_folder_paths.size() < chunk_size && (more = folder_names.next(record))) {
+                const bool is_symlink = record.type == DT_LNK;
+
+                // Process sorted folder names only if renaming is needed
+                if (!renaming_needed) {
+                    unchanged_folder_paths.emplace_back(chunk.add(root, record.name), is_symlink);
+                    continue;
                 }
 
                 // Construct the new name with sequential numbering and original name
                 // Fix: prefix is prepended to the filename string, not inserted as a path segment
-                std::stringstream ss;
-                ss << std::setw(3) << std::setfill('0') << counter << "_" << original_name;
-                std::string new_filename = (prefix.empty() ? "" : (prefix + "_")) + ss.str();
-                fs::path new_name = base_directory / new_filename;
+                new_filename.clear();
+                if (!prefix.empty()) {
+                    new_filename.append(prefix).push_back('_');
+                }
+                new_filename += format_numbered_prefix(counter, std::string(remove_numbering(record.name)));
+                temporary_name = temporary_prefix + std::to_string(counter);
+                counter++;
 
                 // Add folder to the vector for batch renaming only if the name has changed
-                if (new_name != folder_path) {
-                    folders_to_rename.emplace_back(folder_path, new_name);
+                if (new_filename == record.name) {
+                    if (final_pass) {
+                        unchanged_folder_paths.emplace_back(chunk.add(root, record.name), is_symlink);
+                    }
                 } else {
-                    unchanged_folder_paths.emplace_back(folder_path, fs::is_symlink(folder_path));
+                    const PathArena::Node original_node = chunk.add(root, record.name);
+                    const PathArena::Node old_node = pass == Pass::FromTemporary ? chunk.add(root, temporary_name) : original_node;
+                    const PathArena::Node new_node = chunk.add(root, pass == Pass::ToTemporary ? temporary_name : new_filename);
+                    folders_to_rename.push_back({old_node, new_node, original_node, is_symlink});
                 }
-
-                counter++;
             }
 
-            // Determine the number of threads to create
-            unsigned int num_threads = std::min(static_cast<unsigned int>(folders_to_rename.size()), max_threads);
-
-            if (num_paths > 1) {
-                unsigned int max_threads_per_path = std::max(1u, max_threads / static_cast<unsigned int>(num_paths));
-                num_threads = max_threads_per_path;
-            }
-
-            // Rename folders in parallel batches
-            const size_t batch_size = std::min(batch_size_folders, folders_to_rename.size());
-            #pragma omp parallel for shared(folders_to_rename, dirs_count) schedule(static, 1) num_threads(num_threads) if(num_threads > 1)
-            for (size_t i = 0; i < folders_to_rename.size(); i += batch_size) {
-                const size_t end = std::min(i + batch_size, folders_to_rename.size());
-                for (size_t j = i; j < end; ++j) {
-                    const auto& [old_path, new_path] = folders_to_rename[j];
-
-                    try {
-                        fs::rename(old_path, new_path);
-                    } catch (const fs::filesystem_error& e) {
-                        if (e.code() == std::errc::permission_denied && verbose_enabled) {
-                            print_error("\033[1;91mError\033[0m: " + std::string(e.what()));
+            if (!folders_to_rename.empty()) {
+                // All of them go into base_directory: one worker with directory_affinity, which
+                // spares the threads a wait on its inode lock
+                const unsigned int num_threads = directory_affinity ? 1 : batch_in_flight(std::min(static_cast<unsigned int>(folders_to_rename.size()), thread_budget));
+
+                // Rename folders in batches, targets within a pass never collide
+                const size_t batch_size = std::min(batch_size_folders, folders_to_rename.size());
+                #pragma omp parallel for shared(folders_to_rename, chunk, dirs_count) schedule(static, 1) num_threads(num_threads) if(num_threads > 1)
+                for (size_t i = 0; i < folders_to_rename.size(); i += batch_size) {
+                    thread_local std::string old_path;
+                    thread_local std::string new_path;
+                    const size_t end = std::min(i + batch_size, folders_to_rename.size());
+                    for (size_t j = i; j < end; ++j) {
+                        const FolderRename& folder = folders_to_rename[j];
+                        chunk.path(folder.old_node, old_path);
+                        chunk.path(folder.new_node, new_path);
+
+                        // Never over an entry the pass does not own: a sibling outside the
+                        // numbering or an empty folder keeps its place, the folder is skipped
+                        if (!vfs->rename(old_path.c_str(), new_path.c_str(), RENAME_NOREPLACE)) {
+                            const int error = errno;
+                            // A folder whose first move failed has no temporary name and was reported already
+                            if (pass == Pass::FromTemporary && error == ENOENT) {
+                                continue;
+                            }
+                            if (error == EEXIST) {
+                                skipped_folder_special_count.fetch_add(1, std::memory_order_relaxed);
+                                if (verbose_enabled) {
+                                    std::string original_path;
+                                    chunk.path(folder.original_node, original_path);
+                                    print_verbose_enabled("\033[0m\033[93mSkipped\033[0m\033[94m folder\033[0m " + original_path + " (" + new_path + " exists)", std::cout);
+                                }
+                            } else if (error == EACCES && verbose_enabled) {
+                                print_error("\033[1;91mError\033[0m: " + rename_error_message(old_path, new_path, error));
+                            }
+                            // One that cannot reach its target goes back to its original name,
+                            // or stays at the temporary one when that was taken meanwhile
+                            if (pass == Pass::FromTemporary &&
+                                !vfs->rename(old_path.c_str(), chunk.path(folder.original_node, new_path).c_str(), RENAME_NOREPLACE) && verbose_enabled) {
+                                print_error("\033[1;91mError\033[0m: " + rename_error_message(old_path, new_path, errno));
+                            }
+                            continue;
                         }
-                        continue;
-                    }
-                    if (verbose_enabled && !skipped_only) {
-                        if ((symlinks && fs::is_symlink(old_path)) || fs::is_symlink(new_path)) {
-                            print_verbose_enabled("\033[0m\033[92mRenamed\033[0m\033[95m symlink_folder\033[0m " + old_path.string() + "\e[1;38;5;214m -> \033[0m" + new_path.string(), std::cout);
-                        } else {
-                            print_verbose_enabled("\033[0m\033[92mRenamed\033[0m\033[94m folder\033[0m " + old_path.string() + "\e[1;38;5;214m -> \033[0m" + new_path.string(), std::cout);
+                        note_renamed(base_directory.native());
+                        if (!final_pass) {
+                            continue;
                         }
+                        if (verbose_enabled && !skipped_only) {
+                            // Report the original name, not the temporary one
+                            chunk.path(folder.original_node, old_path);
+                            if (folder.is_symlink) {
+                                print_verbose_enabled("\033[0m\033[92mRenamed\033[0m\033[95m symlink_folder\033[0m " + old_path + "\e[1;38;5;214m -> \033[0m" + new_path, std::cout);
+                            } else {
+                                print_verbose_enabled("\033[0m\033[92mRenamed\033[0m\033[94m folder\033[0m " + old_path + "\e[1;38;5;214m -> \033[0m" + new_path, std::cout);
+                            }
+                        }
+                        dirs_count.fetch_add(1, std::memory_order_relaxed);
                     }
-                    dirs_count.fetch_add(1, std::memory_order_relaxed);
                 }
             }
-        } else {
-            // If no renaming is needed, add all folders to unchanged_folder_paths
-            for (const auto& [folder_name, folder_path] : folder_names) {
-                unchanged_folder_paths.emplace_back(folder_path, fs::is_symlink(folder_path));
-            }
-        }
 
-        // Print folder paths that did not need renaming
-        if (!unchanged_folder_paths.empty()) {
-            for (const auto& [folder_path, is_symlink] : unchanged_folder_paths) {
+            // Print folder paths that did not need renaming
+            std::string folder_path;
+            for (const auto& [folder_node, is_symlink] : unchanged_folder_paths) {
                 if (verbose_enabled && skipped) {
+                    chunk.path(folder_node, folder_path);
                     if (is_symlink) {
-                        print_verbose_enabled("\033[0m\033[93mSkipped\033[0m\033[95m symlink_folder\033[0m " + folder_path.string() + " (name unchanged)", std::cout);
+                        print_verbose_enabled("\033[0m\033[93mSkipped\033[0m\033[95m symlink_folder\033[0m " + folder_path + " (name unchanged)", std::cout);
                     } else {
-                        print_verbose_enabled("\033[0m\033[93mSkipped\033[0m\033[94m folder\033[0m " + folder_path.string() + " (name unchanged)", std::cout);
+                        print_verbose_enabled("\033[0m\033[93mSkipped\033[0m\033[94m folder\033[0m " + folder_path + " (name unchanged)", std::cout);
                     }
                 }
                 skipped_folder_special_count.fetch_add(1, std::memory_order_relaxed);
             }
         }
+    };
+
+    if (renaming_needed && numbered_sources) {
+        run_pass(Pass::ToTemporary);
+        run_pass(Pass::FromTemporary);
+    } else {
+        run_pass(Pass::Direct);
     }
 }
@@ -0,0 +1,151 @@
+// SPDX-License-Identifier: GNU General Public License v3.0 or later
+
+#include "headers.h"
+
+
+// Set by SIGINT/SIGTERM or RenameEngine::cancel(), the walkers stop descending and the run winds down
+std::atomic<bool> interrupt_requested{false};
+
+// Journal of the --resume run: "C <length> <path>" for a finished subtree. Appended through a
+// buffer, flushed every few seconds. A directory the interrupt caught midway has no record and
+// is walked again from the start, which is why --resume only takes the modes that leave an
+// already renamed name as it is.
+static int checkpoint_fd = -1;
+static std::mutex checkpoint_mutex;
+static std::string checkpoint_buffer;
+static std::chrono::steady_clock::time_point checkpoint_last_flush;
+static std::unordered_set<std::string> completed_directories;
+
+// Flush thresholds: pending bytes and age of the oldest unflushed record
+static constexpr size_t checkpoint_flush_bytes = 64 * 1024;
+static constexpr std::chrono::seconds checkpoint_flush_interval{2};
+
+
+// Function to append one length-prefixed record, names may contain spaces and newlines
+void append_journal_record(std::string& out, char kind, std::string_view value) {
+    out.push_back(kind);
+    out.push_back(' ');
+    out.append(std::to_string(value.size()));
+    out.push_back(' ');
+    out.append(value);
+    out.push_back('\n');
+}
+
+
+// Function to write the pending records, the caller holds checkpoint_mutex
+static void flush_checkpoint_locked() {
+    size_t written = 0;
+    while (written < checkpoint_buffer.size()) {
+        const ssize_t result = ::write(checkpoint_fd, checkpoint_buffer.data() + written, checkpoint_buffer.size() - written);
+        if (result < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        written += static_cast<size_t>(result);
+    }
+    checkpoint_buffer.clear();
+    fdatasync(checkpoint_fd);
+    checkpoint_last_flush = std::chrono::steady_clock::now();
+}
+
+
+// Function to queue a record and flush when the buffer is large or old enough
+static void record_checkpoint(char kind, std::string_view directory) {
+    std::lock_guard<std::mutex> lock(checkpoint_mutex);
+    append_journal_record(checkpoint_buffer, kind, directory);
+    if (checkpoint_buffer.size() >= checkpoint_flush_bytes ||
+        std::chrono::steady_clock::now() - checkpoint_last_flush >= checkpoint_flush_interval) {
+        flush_checkpoint_locked();
+    }
+}
+
+
+// Function to tell whether a mode can walk a directory twice: applied to its own result it
+// changes nothing. Numbering, date suffixes, camel/pascal word joins, case inversion, templates
+// and plugins are not, and neither are -ce reverse, rbak and noext.
+bool resumable_mode(const std::string& case_mode, bool extensions) {
+    static const std::unordered_set<std::string_view> name_modes = {
+        "title", "upper", "lower", "snake", "rsnake", "kebab", "rkebab", "rcamel", "rpascal", "sentence",
+        "rnumeric", "rbra", "roperand", "rspecial", "swap", "swapr", "hash", "hash:sha256", "exif"
+    };
+    static const std::unordered_set<std::string_view> extension_modes = {"lower", "upper", "title", "bak", "swap", "swapr"};
+    return extensions ? extension_modes.count(case_mode) != 0 : name_modes.count(case_mode) != 0;
+}
+
+
+// Function to open (or create) the --resume journal and load the subtrees finished by earlier runs.
+// The journal is bound to the run settings and working directory that created it.
+bool open_checkpoint(const std::string& path, const std::string& run_settings, std::string& error) {
+    std::string working_directory = fs::current_path().native();
+    completed_directories.clear();
+
+    // Load the existing journal, a record cut short by a kill is ignored
+    std::string settings;
+    std::string directory;
+    bool existing = false;
+    if (FILE* in = std::fopen(path.c_str(), "rb")) {
+        existing = true;
+        char kind;
+        size_t length;
+        while (std::fscanf(in, "%c %zu ", &kind, &length) == 2) {
+            directory.resize(length);
+            if (length > 0 && std::fread(directory.data(), 1, length, in) != length) break;
+            if (std::fgetc(in) != '\n') break;
+            if (kind == 'S') {
+                settings = directory;
+            } else if (kind == 'W' && directory != working_directory) {
+                error = "Checkpoint was created in " + directory + ", run --resume from there.";
+                std::fclose(in);
+                return false;
+            } else if (kind == 'C') {
+                completed_directories.emplace(directory_key(directory));
+            }
+        }
+        std::fclose(in);
+        if (settings != run_settings) {
+            error = "Checkpoint was created for '" + settings + "', not '" + run_settings + "'.";
+            return false;
+        }
+    }
+
+    checkpoint_fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (checkpoint_fd < 0) {
+        error = "Cannot open checkpoint " + path + ": " + std::strerror(errno);
+        return false;
+    }
+    checkpoint_last_flush = std::chrono::steady_clock::now();
+    if (!existing) {
+        std::lock_guard<std::mutex> lock(checkpoint_mutex);
+        append_journal_record(checkpoint_buffer, 'S', run_settings);
+        append_journal_record(checkpoint_buffer, 'W', working_directory);
+        flush_checkpoint_locked();
+    }
+    return true;
+}
+
+
+// Function to tell whether a directory subtree was finished by an earlier run
+bool checkpoint_completed(const std::string& directory) {
+    return checkpoint_fd >= 0 && !completed_directories.empty() && completed_directories.count(std::string(directory_key(directory))) != 0;
+}
+
+
+// Function to record a finished subtree, a subtree cut short by an interrupt is not finished
+void checkpoint_finished(const std::string& directory) {
+    if (checkpoint_fd >= 0 && !interrupt_requested.load(std::memory_order_relaxed)) {
+        record_checkpoint('C', directory_key(directory));
+    }
+}
+
+
+// Function to flush and close the journal at the end of the run or after an interrupt
+void close_checkpoint() {
+    if (checkpoint_fd < 0) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(checkpoint_mutex);
+    flush_checkpoint_locked();
+    ::close(checkpoint_fd);
+    checkpoint_fd = -1;
+    completed_directories.clear();
+}
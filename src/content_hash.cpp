@@ -0,0 +1,290 @@
+// SPDX-License-Identifier: GNU General Public License v3.0 or later
+
+#include "headers.h"
+
+
+// hash and hash:sha256: files are named after their content, <digest>.<extension>
+
+// Duplicates found by the running job, a file whose digest name is already taken
+ShardedCounter content_duplicates;
+
+// Size of the per-thread read buffer: one large sequential read in flight per worker, so the
+// outstanding I/O is bounded by the threads of the walk times this
+static constexpr size_t hash_read_size = 1 << 20;
+
+
+// XXH64, the reference algorithm (xxhash.h by Yann Collet, BSD-2-Clause)
+
+static constexpr uint64_t xxh_prime1 = 0x9E3779B185EBCA87ULL;
+static constexpr uint64_t xxh_prime2 = 0xC2B2AE3D27D4EB4FULL;
+static constexpr uint64_t xxh_prime3 = 0x165667B19E3779F9ULL;
+static constexpr uint64_t xxh_prime4 = 0x85EBCA77C2B2AE63ULL;
+static constexpr uint64_t xxh_prime5 = 0x27D4EB2F165667C5ULL;
+
+static inline uint64_t rotl64(uint64_t value, int bits) {
+    return (value << bits) | (value >> (64 - bits));
+}
+
+static inline uint64_t read64(const unsigned char* data) {
+    uint64_t value;
+    std::memcpy(&value, data, sizeof(value));
+    return value;
+}
+
+static inline uint32_t read32(const unsigned char* data) {
+    uint32_t value;
+    std::memcpy(&value, data, sizeof(value));
+    return value;
+}
+
+static inline uint64_t xxh64_round(uint64_t accumulator, uint64_t input) {
+    accumulator += input * xxh_prime2;
+    return rotl64(accumulator, 31) * xxh_prime1;
+}
+
+static inline uint64_t xxh64_merge_round(uint64_t hash, uint64_t accumulator) {
+    hash ^= xxh64_round(0, accumulator);
+    return hash * xxh_prime1 + xxh_prime4;
+}
+
+
+// Streaming XXH64 state, fed in any chunk sizes
+class Xxh64 {
+public:
+    void update(const unsigned char* data, size_t size) {
+        total_ += size;
+        if (buffered_ + size < sizeof(buffer_)) {
+            std::memcpy(buffer_ + buffered_, data, size);
+            buffered_ += size;
+            return;
+        }
+        if (buffered_ > 0) {
+            const size_t fill = sizeof(buffer_) - buffered_;
+            std::memcpy(buffer_ + buffered_, data, fill);
+            consume(buffer_);
+            data += fill;
+            size -= fill;
+            buffered_ = 0;
+        }
+        while (size >= sizeof(buffer_)) {
+            consume(data);
+            data += sizeof(buffer_);
+            size -= sizeof(buffer_);
+        }
+        std::memcpy(buffer_, data, size);
+        buffered_ = size;
+    }
+
+    uint64_t digest() const {
+        uint64_t hash;
+        if (total_ >= sizeof(buffer_)) {
+            hash = rotl64(v_[0], 1) + rotl64(v_[1], 7) + rotl64(v_[2], 12) + rotl64(v_[3], 18);
+            for (uint64_t v : v_) {
+                hash = xxh64_merge_round(hash, v);
+            }
+        } else {
+            hash = xxh_prime5;
+        }
+        hash += total_;
+
+        const unsigned char* p = buffer_;
+        const unsigned char* const end = buffer_ + buffered_;
+        for (; p + 8 <= end; p += 8) {
+            hash ^= xxh64_round(0, read64(p));
+            hash = rotl64(hash, 27) * xxh_prime1 + xxh_prime4;
+        }
+        if (p + 4 <= end) {
+            hash ^= static_cast<uint64_t>(read32(p)) * xxh_prime1;
+            hash = rotl64(hash, 23) * xxh_prime2 + xxh_prime3;
+            p += 4;
+        }
+        for (; p < end; ++p) {
+            hash ^= (*p) * xxh_prime5;
+            hash = rotl64(hash, 11) * xxh_prime1;
+        }
+
+        hash ^= hash >> 33;
+        hash *= xxh_prime2;
+        hash ^= hash >> 29;
+        hash *= xxh_prime3;
+        hash ^= hash >> 32;
+        return hash;
+    }
+
+private:
+    void consume(const unsigned char* stripe) {
+        v_[0] = xxh64_round(v_[0], read64(stripe));
+        v_[1] = xxh64_round(v_[1], read64(stripe + 8));
+        v_[2] = xxh64_round(v_[2], read64(stripe + 16));
+        v_[3] = xxh64_round(v_[3], read64(stripe + 24));
+    }
+
+    uint64_t v_[4] = {xxh_prime1 + xxh_prime2, xxh_prime2, 0, 0ULL - xxh_prime1};
+    unsigned char buffer_[32];
+    size_t buffered_ = 0;
+    uint64_t total_ = 0;
+};
+
+
+
+// Function to hash a short key in one go, e.g. a name for the transform cache
+uint64_t xxh64_digest(std::string_view data) {
+    Xxh64 xxh64;
+    xxh64.update(reinterpret_cast<const unsigned char*>(data.data()), data.size());
+    return xxh64.digest();
+}
+
+// SHA-256 (FIPS 180-4)
+
+static constexpr uint32_t sha256_k[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+static inline uint32_t rotr32(uint32_t value, int bits) {
+    return (value >> bits) | (value << (32 - bits));
+}
+
+
+// Streaming SHA-256 state
+class Sha256 {
+public:
+    void update(const unsigned char* data, size_t size) {
+        total_ += size;
+        while (size > 0) {
+            const size_t fill = std::min(size, sizeof(block_) - buffered_);
+            std::memcpy(block_ + buffered_, data, fill);
+            buffered_ += fill;
+            data += fill;
+            size -= fill;
+            if (buffered_ == sizeof(block_)) {
+                compress(block_);
+                buffered_ = 0;
+            }
+        }
+    }
+
+    void digest(unsigned char out[32]) {
+        const uint64_t bits = total_ * 8;
+        const unsigned char pad = 0x80;
+        const unsigned char zero = 0;
+        update(&pad, 1);
+        while (buffered_ != 56) {
+            update(&zero, 1);
+        }
+        unsigned char length[8];
+        for (int i = 0; i < 8; ++i) {
+            length[i] = static_cast<unsigned char>(bits >> (56 - 8 * i));
+        }
+        update(length, 8);
+        for (int i = 0; i < 8; ++i) {
+            for (int j = 0; j < 4; ++j) {
+                out[4 * i + j] = static_cast<unsigned char>(h_[i] >> (24 - 8 * j));
+            }
+        }
+    }
+
+private:
+    void compress(const unsigned char* block) {
+        uint32_t w[64];
+        for (int i = 0; i < 16; ++i) {
+            w[i] = (uint32_t(block[4 * i]) << 24) | (uint32_t(block[4 * i + 1]) << 16) | (uint32_t(block[4 * i + 2]) << 8) | uint32_t(block[4 * i + 3]);
+        }
+        for (int i = 16; i < 64; ++i) {
+            const uint32_t s0 = rotr32(w[i - 15], 7) ^ rotr32(w[i - 15], 18) ^ (w[i - 15] >> 3);
+            const uint32_t s1 = rotr32(w[i - 2], 17) ^ rotr32(w[i - 2], 19) ^ (w[i - 2] >> 10);
+            w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+        }
+        uint32_t a = h_[0], b = h_[1], c = h_[2], d = h_[3], e = h_[4], f = h_[5], g = h_[6], h = h_[7];
+        for (int i = 0; i < 64; ++i) {
+            const uint32_t t1 = h + (rotr32(e, 6) ^ rotr32(e, 11) ^ rotr32(e, 25)) + ((e & f) ^ (~e & g)) + sha256_k[i] + w[i];
+            const uint32_t t2 = (rotr32(a, 2) ^ rotr32(a, 13) ^ rotr32(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+            h = g; g = f; f = e; e = d + t1;
+            d = c; c = b; b = a; a = t1 + t2;
+        }
+        h_[0] += a; h_[1] += b; h_[2] += c; h_[3] += d;
+        h_[4] += e; h_[5] += f; h_[6] += g; h_[7] += h;
+    }
+
+    uint32_t h_[8] = {0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+    unsigned char block_[64];
+    size_t buffered_ = 0;
+    uint64_t total_ = 0;
+};
+
+
+// Function to resolve a hash mode once per run, None for every other mode
+ContentHash content_hash_kind(const std::string& case_input) {
+    if (case_input == "hash") return ContentHash::Xxh64;
+    if (case_input == "hash:sha256") return ContentHash::Sha256;
+    return ContentHash::None;
+}
+
+
+// Function to append bytes as lowercase hex
+static void append_hex(std::string& out, const unsigned char* bytes, size_t size) {
+    static constexpr char digits[] = "0123456789abcdef";
+    for (size_t i = 0; i < size; ++i) {
+        out.push_back(digits[bytes[i] >> 4]);
+        out.push_back(digits[bytes[i] & 0x0f]);
+    }
+}
+
+
+// Function to build the content name of a file: its digest plus the extension of file_name
+// (from the last dot). Reads in large sequential chunks into a per-thread buffer; false when
+// the file cannot be read, which leaves new_name empty.
+bool content_hash_name(const std::string& path, std::string_view file_name, ContentHash kind, std::string& new_name) {
+    new_name.clear();
+    const int fd = vfs->open_read(path.c_str());
+    if (fd < 0) {
+        return false;
+    }
+
+    thread_local std::unique_ptr<unsigned char[]> buffer(new unsigned char[hash_read_size]);
+    Xxh64 xxh64;
+    Sha256 sha256;
+    off_t offset = 0;
+    for (;;) {
+        const ssize_t got = vfs->pread(fd, buffer.get(), hash_read_size, offset);
+        if (got < 0) {
+            if (errno == EINTR) continue;
+            vfs->close_read(fd);
+            return false;
+        }
+        if (got == 0) break;
+        if (kind == ContentHash::Sha256) {
+            sha256.update(buffer.get(), static_cast<size_t>(got));
+        } else {
+            xxh64.update(buffer.get(), static_cast<size_t>(got));
+        }
+        offset += got;
+    }
+    vfs->close_read(fd);
+
+    if (kind == ContentHash::Sha256) {
+        unsigned char digest[32];
+        sha256.digest(digest);
+        append_hex(new_name, digest, sizeof(digest));
+    } else {
+        // Canonical big-endian form, the digits xxhsum prints
+        const uint64_t digest = xxh64.digest();
+        unsigned char bytes[8];
+        for (int i = 0; i < 8; ++i) {
+            bytes[i] = static_cast<unsigned char>(digest >> (56 - 8 * i));
+        }
+        append_hex(new_name, bytes, sizeof(bytes));
+    }
+    const size_t dot = file_name.rfind('.');
+    if (dot != std::string_view::npos && dot > 0) {
+        new_name.append(file_name.substr(dot));
+    }
+    return true;
+}
+
@@ -0,0 +1,104 @@
+// SPDX-License-Identifier: GNU General Public License v3.0 or later
+
+#include "headers.h"
+
+#include <fstream>
+
+
+// Threads a rotational disk gets, more only add seeks between the concurrent renames
+static constexpr unsigned rotational_queue_threads = 2;
+
+// sysfs answers once per device and run
+static std::mutex rotational_mutex;
+static std::unordered_map<dev_t, bool> rotational_devices;
+
+
+// Function to read a sysfs flag file, false when it is missing
+static bool read_sysfs_flag(const std::string& path) {
+    std::ifstream file(path);
+    char flag = '0';
+    return file >> flag && flag == '1';
+}
+
+
+// Function to tell whether a device is a spinning disk. Partitions have no queue of their own,
+// theirs is the one of the whole disk one level up. Network and virtual filesystems (major 0)
+// have no block device and count as fast.
+bool device_rotational(dev_t device) {
+    {
+        std::lock_guard<std::mutex> lock(rotational_mutex);
+        const auto it = rotational_devices.find(device);
+        if (it != rotational_devices.end()) {
+            return it->second;
+        }
+    }
+
+    bool rotational = false;
+    if (major(device) != 0) {
+        const std::string block = "/sys/dev/block/" + std::to_string(major(device)) + ":" + std::to_string(minor(device));
+        std::error_code ec;
+        rotational = fs::exists(block + "/queue/rotational", ec) ? read_sysfs_flag(block + "/queue/rotational")
+                                                                   : read_sysfs_flag(block + "/../queue/rotational");
+    }
+
+    std::lock_guard<std::mutex> lock(rotational_mutex);
+    rotational_devices.emplace(device, rotational);
+    return rotational;
+}
+
+
+// Function to group the input paths by device: a queue per st_dev walks its paths one after
+// another with its own share of the threads, low for spinning disks and the rest split evenly
+// between the fast ones. Paths that cannot be stat'ed go to a queue of their own and fail there.
+std::vector<DeviceQueue> build_device_queues(const std::vector<std::string>& paths) {
+    std::vector<DeviceQueue> queues;
+    std::unordered_map<dev_t, size_t> queue_of_device;
+    for (size_t i = 0; i < paths.size(); ++i) {
+        struct statx stx;
+        if (!statx_path(paths[i].c_str(), STATX_TYPE, true, stx)) {
+            queues.push_back({0, false, 1, {i}});
+            continue;
+        }
+        const dev_t device = statx_dev(stx);
+        const auto [it, inserted] = queue_of_device.emplace(device, queues.size());
+        if (inserted) {
+            queues.push_back({device, device_rotational(device), 1, {}});
+        }
+        queues[it->second].paths.push_back(i);
+    }
+
+    unsigned fast_queues = 0;
+    unsigned threads_left = max_threads;
+    for (DeviceQueue& queue : queues) {
+        if (queue.rotational) {
+            queue.threads = std::min(rotational_queue_threads, max_threads);
+            threads_left -= std::min(threads_left, queue.threads);
+        } else {
+            ++fast_queues;
+        }
+    }
+    for (DeviceQueue& queue : queues) {
+        if (!queue.rotational) {
+            queue.threads = std::max(1u, threads_left / std::max(1u, fast_queues));
+        }
+    }
+    return queues;
+}
+
+
+// Function to allow the per-directory batches a parallel level below several device queues,
+// returns the previous limit for the caller to restore
+int enter_device_queues(size_t queue_count) {
+    const int saved_levels = omp_get_max_active_levels();
+    if (queue_count > 1) {
+        omp_set_max_active_levels(std::max(saved_levels, 2));
+    }
+    return saved_levels;
+}
+
+
+// Function to pick how a directory's listing is keyed: by inode on a spinning disk, so the
+// renames of a directory reach the inode table in disk order instead of in hash order
+ListingKeys directory_listing_keys(dev_t device) {
+    return device_rotational(device) ? ListingKeys::Inode : ListingKeys::None;
+}
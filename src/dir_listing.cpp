@@ -0,0 +1,521 @@
+// SPDX-License-Identifier: GNU General Public License v3.0 or later
+
+#include "headers.h"
+
+
+// Memory budget for directory listings in bytes (0 = unlimited), set with --max-memory
+size_t max_memory = 0;
+
+// Entries seen by list_directory across all threads, sampled by --progress
+ShardedCounter entries_scanned;
+
+// Bytes currently held in memory by all listing spools together
+static std::atomic<size_t> listing_memory_in_use{0};
+
+// Size of the read-ahead/write-behind buffer of a spilled spool and of each merge cursor
+static constexpr size_t spool_io_buffer_size = 64 * 1024;
+
+// Record layout: [u32 key length][u32 name length][u8 type][key bytes][name bytes]
+static constexpr size_t record_header_size = 2 * sizeof(uint32_t) + 1;
+
+
+// Spill file helpers
+
+// Function to open an anonymous spill file in $TMPDIR (or /tmp), it vanishes on close
+static int open_spill_file() {
+    const char* tmpdir = std::getenv("TMPDIR");
+    std::string dir = (tmpdir && *tmpdir) ? tmpdir : "/tmp";
+
+    int fd = open(dir.c_str(), O_TMPFILE | O_RDWR | O_CLOEXEC, 0600);
+    if (fd < 0) {
+        // Filesystems without O_TMPFILE support: create and unlink right away
+        std::string name = dir + "/bulk_rename++-spool-XXXXXX";
+        fd = mkostemp(name.data(), O_CLOEXEC);
+        if (fd >= 0) {
+            unlink(name.c_str());
+        }
+    }
+    if (fd < 0) {
+        throw std::system_error(errno, std::generic_category(), "Cannot create spill file in " + dir);
+    }
+    return fd;
+}
+
+
+// Function to write a whole buffer at the given offset of a spill file
+static void write_all(int fd, const char* data, size_t size, off_t offset) {
+    while (size > 0) {
+        ssize_t written = pwrite(fd, data, size, offset);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            throw std::system_error(errno, std::generic_category(), "Cannot write spill file");
+        }
+        data += written;
+        size -= static_cast<size_t>(written);
+        offset += written;
+    }
+}
+
+
+// Function to append one record to a byte buffer
+static void append_record(std::vector<char>& buffer, std::string_view key, std::string_view name, unsigned char type) {
+    const uint32_t key_size = static_cast<uint32_t>(key.size());
+    const uint32_t name_size = static_cast<uint32_t>(name.size());
+    const size_t offset = buffer.size();
+    buffer.resize(offset + record_header_size + key.size() + name.size());
+    char* out = buffer.data() + offset;
+    std::memcpy(out, &key_size, sizeof(key_size));
+    std::memcpy(out + sizeof(key_size), &name_size, sizeof(name_size));
+    out[2 * sizeof(uint32_t)] = static_cast<char>(type);
+    std::memcpy(out + record_header_size, key.data(), key.size());
+    std::memcpy(out + record_header_size + key.size(), name.data(), name.size());
+}
+
+
+// Function to decode the record starting at data, returns its total size
+static size_t decode_record(const char* data, ListingSpool::Record& record) {
+    uint32_t key_size;
+    uint32_t name_size;
+    std::memcpy(&key_size, data, sizeof(key_size));
+    std::memcpy(&name_size, data + sizeof(key_size), sizeof(name_size));
+    record.type = static_cast<unsigned char>(data[2 * sizeof(uint32_t)]);
+    record.key = std::string_view(data + record_header_size, key_size);
+    record.name = std::string_view(data + record_header_size + key_size, name_size);
+    return record_header_size + key_size + name_size;
+}
+
+
+// Records are ordered by key first and by name to break ties
+static bool record_less(const ListingSpool::Record& a, const ListingSpool::Record& b) {
+    const int cmp = a.key.compare(b.key);
+    return cmp < 0 || (cmp == 0 && a.name < b.name);
+}
+
+
+// Sequential reader over a byte range of a spill file
+class SpillCursor {
+public:
+    SpillCursor(int fd, off_t begin, off_t end) : fd_(fd), offset_(begin), end_(end) {
+        buffer_.resize(spool_io_buffer_size);
+    }
+
+    // Read the next record, string views stay valid until the following call
+    bool next(ListingSpool::Record& record) {
+        if (!ensure(record_header_size)) return false;
+        uint32_t key_size;
+        uint32_t name_size;
+        std::memcpy(&key_size, buffer_.data() + pos_, sizeof(key_size));
+        std::memcpy(&name_size, buffer_.data() + pos_ + sizeof(key_size), sizeof(name_size));
+        if (!ensure(record_header_size + key_size + name_size)) return false;
+        pos_ += decode_record(buffer_.data() + pos_, record);
+        return true;
+    }
+
+private:
+    // Make sure at least need bytes are buffered, refilling from the file when short
+    bool ensure(size_t need) {
+        if (end_pos_ - pos_ >= need) return true;
+        std::memmove(buffer_.data(), buffer_.data() + pos_, end_pos_ - pos_);
+        end_pos_ -= pos_;
+        pos_ = 0;
+        if (buffer_.size() < need) buffer_.resize(need);
+        while (end_pos_ < need && offset_ < end_) {
+            const size_t want = std::min(buffer_.size() - end_pos_, static_cast<size_t>(end_ - offset_));
+            ssize_t got = pread(fd_, buffer_.data() + end_pos_, want, offset_);
+            if (got < 0 && errno == EINTR) continue;
+            if (got <= 0) {
+                throw std::system_error(got < 0 ? errno : EIO, std::generic_category(), "Cannot read spill file");
+            }
+            end_pos_ += static_cast<size_t>(got);
+            offset_ += got;
+        }
+        return end_pos_ - pos_ >= need;
+    }
+
+    int fd_;
+    off_t offset_;
+    off_t end_;
+    std::vector<char> buffer_;
+    size_t pos_ = 0;
+    size_t end_pos_ = 0;
+};
+
+
+// ListingSpool
+
+ListingSpool::ListingSpool() = default;
+
+
+ListingSpool::~ListingSpool() {
+    release_memory();
+    if (fd_ >= 0) close(fd_);
+}
+
+
+// Function to hand the bytes charged by this spool back to the global budget
+void ListingSpool::release_memory() {
+    if (accounted_ > 0) {
+        listing_memory_in_use.fetch_sub(accounted_, std::memory_order_relaxed);
+        accounted_ = 0;
+    }
+}
+
+
+// Function to hand part of the charged bytes back, for buffers that only live during a sort
+void ListingSpool::uncharge_memory(size_t bytes) {
+    accounted_ -= bytes;
+    listing_memory_in_use.fetch_sub(bytes, std::memory_order_relaxed);
+}
+
+
+// Function to charge a capacity increase against --max-memory, false when over budget
+bool ListingSpool::charge_memory(size_t bytes) {
+    if (max_memory == 0) {
+        accounted_ += bytes;
+        listing_memory_in_use.fetch_add(bytes, std::memory_order_relaxed);
+        return true;
+    }
+    size_t in_use = listing_memory_in_use.load(std::memory_order_relaxed);
+    do {
+        if (in_use + bytes > max_memory) return false;
+    } while (!listing_memory_in_use.compare_exchange_weak(in_use, in_use + bytes, std::memory_order_relaxed));
+    accounted_ += bytes;
+    return true;
+}
+
+
+// Function to move the in-memory records to a spill file and continue on disk
+void ListingSpool::spill() {
+    fd_ = open_spill_file();
+    write_all(fd_, memory_.data(), memory_.size(), 0);
+    file_size_ = static_cast<off_t>(memory_.size());
+    std::vector<char>().swap(memory_);
+    release_memory();
+    io_buffer_.reserve(spool_io_buffer_size);
+}
+
+
+// Function to write out buffered records of a spilled spool
+void ListingSpool::flush_writes() {
+    if (fd_ < 0 || io_buffer_.empty()) return;
+    write_all(fd_, io_buffer_.data(), io_buffer_.size(), file_size_);
+    file_size_ += static_cast<off_t>(io_buffer_.size());
+    io_buffer_.clear();
+}
+
+
+// Function to append a record, spilling to disk once the memory budget is exhausted
+void ListingSpool::push(std::string_view key, std::string_view name, unsigned char type) {
+    const size_t record_size = record_header_size + key.size() + name.size();
+
+    if (fd_ < 0) {
+        if (memory_.size() + record_size > memory_.capacity()) {
+            const size_t new_capacity = std::max({memory_.capacity() * 2, memory_.size() + record_size, static_cast<size_t>(4096)});
+            if (charge_memory(new_capacity - memory_.capacity())) {
+                memory_.reserve(new_capacity);
+            } else {
+                spill();
+            }
+        }
+        if (fd_ < 0) {
+            append_record(memory_, key, name, type);
+            ++count_;
+            return;
+        }
+    }
+
+    if (io_buffer_.size() + record_size > spool_io_buffer_size) {
+        flush_writes();
+    }
+    append_record(io_buffer_, key, name, type);
+    ++count_;
+}
+
+
+// Function to order the records by key then name, with an external merge sort when spilled.
+// The index and the sorted copy count against --max-memory too: an in-memory listing the
+// budget cannot sort goes to disk first.
+void ListingSpool::sort() {
+    flush_writes();
+
+    if (fd_ < 0) {
+        const size_t sort_bytes = count_ * sizeof(Record) + memory_.size();
+        if (charge_memory(sort_bytes)) {
+            std::vector<Record> records;
+            records.reserve(count_);
+            for (size_t pos = 0; pos < memory_.size();) {
+                Record record;
+                pos += decode_record(memory_.data() + pos, record);
+                records.push_back(record);
+            }
+            std::sort(records.begin(), records.end(), record_less);
+
+            std::vector<char> sorted;
+            sorted.reserve(memory_.size());
+            for (const auto& record : records) {
+                append_record(sorted, record.key, record.name, record.type);
+            }
+            // The sorted copy takes the place of the charged records, same size or smaller
+            memory_.swap(sorted);
+            uncharge_memory(sort_bytes);
+            return;
+        }
+        spill();
+        flush_writes();
+    }
+
+    // A run holds its records and their index, sized so all threads sorting at once stay
+    // within the budget. When the budget is taken it shrinks down to an I/O buffer's size,
+    // which like the I/O buffers themselves is not charged.
+    size_t run_budget = std::max<size_t>(1 << 20, max_memory / std::max(1u, max_threads));
+    while (run_budget > spool_io_buffer_size && !charge_memory(run_budget)) {
+        run_budget /= 2;
+    }
+    const size_t charged_run = run_budget > spool_io_buffer_size ? run_budget : 0;
+    run_budget = std::max(run_budget, spool_io_buffer_size);
+
+    // Phase 1: cut the spill file into sorted runs stored back to back in one runs file,
+    // written in sorted order straight from the index through an I/O buffer
+    int runs_fd = open_spill_file();
+    std::vector<std::pair<off_t, off_t>> runs;
+    off_t runs_size = 0;
+    {
+        SpillCursor cursor(fd_, 0, file_size_);
+        std::vector<char> run;
+        std::vector<Record> records;
+        std::vector<char> out;
+        out.reserve(spool_io_buffer_size);
+        Record record;
+        bool more = true;
+        while (more) {
+            run.clear();
+            size_t run_records = 0;
+            while ((more = cursor.next(record))) {
+                append_record(run, record.key, record.name, record.type);
+                if (run.size() + ++run_records * sizeof(Record) >= run_budget) break;
+            }
+            if (run.empty()) break;
+
+            records.clear();
+            for (size_t pos = 0; pos < run.size();) {
+                Record r;
+                pos += decode_record(run.data() + pos, r);
+                records.push_back(r);
+            }
+            std::sort(records.begin(), records.end(), record_less);
+
+            const off_t run_begin = runs_size;
+            for (const auto& r : records) {
+                if (out.size() + record_header_size + r.key.size() + r.name.size() > spool_io_buffer_size && !out.empty()) {
+                    write_all(runs_fd, out.data(), out.size(), runs_size);
+                    runs_size += static_cast<off_t>(out.size());
+                    out.clear();
+                }
+                append_record(out, r.key, r.name, r.type);
+            }
+            write_all(runs_fd, out.data(), out.size(), runs_size);
+            runs_size += static_cast<off_t>(out.size());
+            out.clear();
+            runs.emplace_back(run_begin, runs_size);
+        }
+    }
+    if (charged_run > 0) {
+        uncharge_memory(charged_run);
+    }
+
+    // Phase 2: k-way merge of the runs into a fresh spill file
+    struct Head {
+        Record record;
+        size_t run;
+    };
+    auto head_greater = [](const Head& a, const Head& b) { return record_less(b.record, a.record); };
+
+    std::vector<std::unique_ptr<SpillCursor>> cursors;
+    std::priority_queue<Head, std::vector<Head>, decltype(head_greater)> heads(head_greater);
+    for (size_t i = 0; i < runs.size(); ++i) {
+        cursors.emplace_back(std::make_unique<SpillCursor>(runs_fd, runs[i].first, runs[i].second));
+        Head head{{}, i};
+        if (cursors[i]->next(head.record)) heads.push(head);
+    }
+
+    close(fd_);
+    fd_ = open_spill_file();
+    file_size_ = 0;
+    while (!heads.empty()) {
+        Head head = heads.top();
+        heads.pop();
+        if (io_buffer_.size() + record_header_size + head.record.key.size() + head.record.name.size() > spool_io_buffer_size) {
+            flush_writes();
+        }
+        // Copy before advancing the cursor, the views point into its buffer
+        append_record(io_buffer_, head.record.key, head.record.name, head.record.type);
+        if (cursors[head.run]->next(head.record)) heads.push(head);
+    }
+    flush_writes();
+    close(runs_fd);
+}
+
+
+// Function to restart reading from the first record
+void ListingSpool::rewind() {
+    flush_writes();
+    read_pos_ = 0;
+    reader_.reset();
+    if (fd_ >= 0) {
+        reader_ = std::make_unique<SpillCursor>(fd_, 0, file_size_);
+    }
+}
+
+
+// Function to read the next record, string views stay valid until the following call
+bool ListingSpool::next(Record& record) {
+    if (reader_) {
+        return reader_->next(record);
+    }
+    if (read_pos_ >= memory_.size()) return false;
+    read_pos_ += decode_record(memory_.data() + read_pos_, record);
+    return true;
+}
+
+
+// Directory reading
+
+// State of a list_directory call, handed to the Vfs callback
+struct ListingSink {
+    ListingSpool& dirs;
+    ListingSpool& files;
+    ListingKeys keys;
+    std::string key;
+    long listed = 0;
+};
+
+
+// Function to file one listed entry, the type is already resolved through symlinks like
+// directory_entry::is_directory() does (DT_UNKNOWN for dangling links)
+static void push_listed_entry(void* context, std::string_view name, unsigned char type, uint64_t inode) {
+    ListingSink& sink = *static_cast<ListingSink*>(context);
+    ++sink.listed;
+    const bool is_dir = type == DT_DIR;
+
+    if (sink.keys == ListingKeys::Inode) {
+        // Big-endian so the byte order of the keys is the numeric order of the inodes
+        char inode_key[sizeof(uint64_t)];
+        for (size_t i = sizeof(inode_key); i-- > 0; inode >>= 8) {
+            inode_key[i] = static_cast<char>(inode & 0xff);
+        }
+        (is_dir ? sink.dirs : sink.files).push(std::string_view(inode_key, sizeof(inode_key)), name, type);
+    } else if (is_dir) {
+        sink.dirs.push({}, name, type);
+    } else if (sink.keys == ListingKeys::Unnumbered) {
+        sink.key = strip_numbered_prefix(std::string(name));
+        sink.files.push(sink.key, name, type);
+    } else if (sink.keys == ListingKeys::Natural) {
+        natural_sort_key(name, sink.key);
+        sink.files.push(sink.key, name, type);
+    } else {
+        sink.files.push({}, name, type);
+    }
+}
+
+
+// Function to read a directory into folder and file spools through the job's Vfs
+void list_directory(const fs::path& directory_path, ListingSpool& dirs, ListingSpool& files, ListingKeys keys) {
+    ListingSink sink{dirs, files, keys, std::string(), 0};
+    if (!vfs->list(directory_path.c_str(), push_listed_entry, &sink)) {
+        throw fs::filesystem_error("directory listing failed", directory_path, std::error_code(errno, std::generic_category()));
+    }
+
+    // One add per directory keeps the progress counter off the per-entry path
+    entries_scanned.fetch_add(sink.listed);
+}
+
+
+// Function to refill an arena with the parent directory and up to max_items children of the spool
+bool next_arena_chunk(ListingSpool& spool, PathArena& arena, const std::string& parent, std::vector<PathArena::Node>& out, size_t max_items, std::vector<unsigned char>* types) {
+    arena.clear();
+    out.clear();
+    if (types) types->clear();
+    const PathArena::Node root = arena.add(PathArena::no_parent, parent);
+    ListingSpool::Record record;
+    while (out.size() < max_items && spool.next(record)) {
+        out.push_back(arena.add(root, record.name));
+        if (types) types->push_back(record.type);
+    }
+    return !out.empty();
+}
+
+
+// PathArena
+
+// Function to intern a name below parent, returns the new node
+PathArena::Node PathArena::add(Node parent, std::string_view name) {
+    const Entry entry{parent, static_cast<uint32_t>(names_.size()), static_cast<uint32_t>(name.size())};
+    names_.insert(names_.end(), name.begin(), name.end());
+    nodes_.push_back(entry);
+    return static_cast<Node>(nodes_.size() - 1);
+}
+
+
+// A separator is needed unless the node is a root or its parent already ends with one
+bool PathArena::needs_separator(Node node) const {
+    const Node parent = nodes_[node].parent;
+    if (parent == no_parent) return false;
+    const Entry& entry = nodes_[parent];
+    return entry.length == 0 || names_[entry.offset + entry.length - 1] != '/';
+}
+
+
+// Function to materialize the full path of a node into a reusable buffer
+const std::string& PathArena::path(Node node, std::string& out) const {
+    size_t total = 0;
+    for (Node n = node; n != no_parent; n = nodes_[n].parent) {
+        total += nodes_[n].length + (needs_separator(n) ? 1 : 0);
+    }
+
+    out.resize(total);
+    size_t pos = total;
+    for (Node n = node; n != no_parent; n = nodes_[n].parent) {
+        pos -= nodes_[n].length;
+        std::memcpy(out.data() + pos, names_.data() + nodes_[n].offset, nodes_[n].length);
+        if (needs_separator(n)) {
+            out[--pos] = '/';
+        }
+    }
+    return out;
+}
+
+
+// Function to join a directory and a name into a reusable buffer
+const std::string& join_path(std::string& out, std::string_view parent, std::string_view name) {
+    out.assign(parent);
+    if (!out.empty() && out.back() != '/') {
+        out += '/';
+    }
+    out.append(name);
+    return out;
+}
+
+
+// Function to parse a byte size with an optional K, M, G or T suffix (binary multiples)
+bool parse_memory_size(const std::string& value, size_t& bytes) {
+    size_t digits = 0;
+    while (digits < value.size() && std::isdigit(static_cast<unsigned char>(value[digits]))) ++digits;
+    if (digits == 0 || digits + 1 < value.size()) return false;
+
+    size_t multiplier = 1;
+    if (digits < value.size()) {
+        switch (std::toupper(static_cast<unsigned char>(value[digits]))) {
+            case 'K': multiplier = size_t(1) << 10; break;
+            case 'M': multiplier = size_t(1) << 20; break;
+            case 'G': multiplier = size_t(1) << 30; break;
+            case 'T': multiplier = size_t(1) << 40; break;
+            default: return false;
+        }
+    }
+
+    errno = 0;
+    const unsigned long long number = std::strtoull(value.substr(0, digits).c_str(), nullptr, 10);
+    if (errno == ERANGE || number > std::numeric_limits<size_t>::max() / multiplier) return false;
+    bytes = static_cast<size_t>(number) * multiplier;
+    return true;
+}
@@ -0,0 +1,157 @@
+// SPDX-License-Identifier: GNU General Public License v3.0 or later
+
+#include "headers.h"
+#include "renamepp.h"
+
+#include <sys/vfs.h>
+
+
+// --durability: directories whose entries were renamed, synced once when their walk finishes
+// (dirs) or turned into one syncfs per filesystem at the end (fs)
+static RenameDurability durability_level = RenameDurability::None;
+
+struct alignas(64) DirtyShard {
+    std::mutex mutex;
+    std::unordered_set<std::string> directories;
+};
+static constexpr size_t dirty_shard_count = 16;
+static DirtyShard dirty_shards[dirty_shard_count];
+
+// A directory per filesystem for the syncfs calls of --durability=fs
+static std::mutex filesystems_mutex;
+static std::unordered_map<dev_t, std::string> dirty_filesystems;
+
+// Bumped by every run so the per-thread last-directory caches start empty
+static std::atomic<unsigned> durability_generation{0};
+
+static std::atomic<long> directories_synced{0};
+static std::atomic<long> filesystems_synced{0};
+
+
+// Function to key a directory the same way however it was reached: the input paths end in '/',
+// the parent path of an entry does not. The filesystem root keeps its '/'.
+std::string_view directory_key(std::string_view directory) {
+    while (directory.size() > 1 && directory.back() == '/') {
+        directory.remove_suffix(1);
+    }
+    return directory;
+}
+
+
+// Function to pick the shard of a directory
+static DirtyShard& dirty_shard(std::string_view directory) {
+    return dirty_shards[std::hash<std::string_view>{}(directory) % dirty_shard_count];
+}
+
+
+// Function to start tracking for a run
+void begin_durability(RenameDurability level) {
+    durability_level = level;
+    durability_generation.fetch_add(1, std::memory_order_relaxed);
+    for (DirtyShard& shard : dirty_shards) {
+        shard.directories.clear();
+    }
+    dirty_filesystems.clear();
+    directories_synced.store(0);
+    filesystems_synced.store(0);
+}
+
+
+// Function to record that an entry of a directory was renamed. Consecutive renames of a thread
+// mostly share a directory, a per-thread last-directory check skips their locking. A directory
+// is synced only after all of its renames, so the check never hides a later one.
+void note_renamed(std::string_view directory) {
+    if (durability_level == RenameDurability::None) {
+        return;
+    }
+    directory = directory_key(directory);
+    thread_local std::string last_directory;
+    thread_local unsigned last_generation = ~0u;
+    const unsigned generation = durability_generation.load(std::memory_order_relaxed);
+    if (last_generation == generation && last_directory == directory) {
+        return;
+    }
+    last_generation = generation;
+    last_directory.assign(directory);
+
+    DirtyShard& shard = dirty_shard(directory);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    shard.directories.emplace(directory);
+}
+
+
+// Function to take a directory out of the dirty set, false if nothing in it was renamed
+static bool take_dirty(std::string_view directory) {
+    DirtyShard& shard = dirty_shard(directory);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    return shard.directories.erase(std::string(directory)) != 0;
+}
+
+
+// Function to fsync a directory, a failure means its renames may not survive a crash
+static void fsync_directory(const std::string& directory) {
+    if (!vfs->sync_directory(directory.c_str())) {
+        print_error("\033[1;91mError\033[0m: cannot sync directory " + directory + ": " + std::strerror(errno), std::cerr);
+    } else {
+        ++directories_synced;
+    }
+}
+
+
+// Function to remember the filesystem of a dirty directory for the final syncfs
+static void note_filesystem(const std::string& directory) {
+    struct statx stx;
+    if (!statx_path(directory.c_str(), STATX_TYPE, true, stx)) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(filesystems_mutex);
+    dirty_filesystems.emplace(statx_dev(stx), directory);
+}
+
+
+// Function to sync a directory once its walk finished: its files were renamed and its
+// subdirectories renamed themselves. Called before the --resume checkpoint records it.
+void sync_directory(const std::string& directory) {
+    if (durability_level == RenameDurability::None || !take_dirty(directory_key(directory))) {
+        return;
+    }
+    if (durability_level == RenameDurability::Dirs) {
+        fsync_directory(directory);
+    } else {
+        note_filesystem(directory);
+    }
+}
+
+
+// Function to sync what is still dirty at the end of the run (parents of the input paths,
+// interrupted subtrees) and, for --durability=fs, each touched filesystem once
+void end_durability(long& directories, long& filesystems) {
+    if (durability_level != RenameDurability::None) {
+        std::vector<std::string> remaining;
+        for (DirtyShard& shard : dirty_shards) {
+            remaining.insert(remaining.end(), shard.directories.begin(), shard.directories.end());
+            shard.directories.clear();
+        }
+
+        #pragma omp parallel for schedule(dynamic) num_threads(max_threads) if(remaining.size() > 1)
+        for (size_t i = 0; i < remaining.size(); ++i) {
+            if (durability_level == RenameDurability::Dirs) {
+                fsync_directory(remaining[i]);
+            } else {
+                note_filesystem(remaining[i]);
+            }
+        }
+
+        for (const auto& [device, directory] : dirty_filesystems) {
+            if (!vfs->sync_filesystem(directory.c_str())) {
+                print_error("\033[1;91mError\033[0m: cannot sync the filesystem of " + directory + ": " + std::strerror(errno), std::cerr);
+            } else {
+                ++filesystems_synced;
+            }
+        }
+        dirty_filesystems.clear();
+    }
+    directories = directories_synced.load();
+    filesystems = filesystems_synced.load();
+    durability_level = RenameDurability::None;
+}
@@ -0,0 +1,238 @@
+// SPDX-License-Identifier: GNU General Public License v3.0 or later
+
+#include "headers.h"
+
+
+// exif: photos are named after their capture time, YYYYMMDD_HHMMSS.<extension>. Only the
+// header is read: the first read covers the EXIF block of most cameras, offsets past it are
+// read on demand, and nothing beyond exif_read_limit is ever touched.
+
+static constexpr size_t exif_first_read = 16 << 10;
+static constexpr size_t exif_read_limit = 256 << 10;
+
+// TIFF tags holding a timestamp, in the order they are preferred
+static constexpr uint16_t tag_exif_ifd = 0x8769;
+static constexpr uint16_t tag_date_time_original = 0x9003;
+static constexpr uint16_t tag_date_time_digitized = 0x9004;
+static constexpr uint16_t tag_date_time = 0x0132;
+static constexpr uint16_t tiff_type_ascii = 2;
+
+
+// The start of a file, grown with pread as offsets into it are followed
+class HeaderReader {
+public:
+    explicit HeaderReader(int fd) : fd_(fd) {}
+
+    // Function to make [offset, offset + size) available, false past the end or the limit
+    bool ensure(size_t offset, size_t size) {
+        const size_t end = offset + size;
+        if (end < offset || end > exif_read_limit) {
+            return false;
+        }
+        while (data_.size() < end && !eof_) {
+            const size_t want = std::min(exif_read_limit, std::max(end, data_.empty() ? exif_first_read : data_.size() * 2));
+            const size_t have = data_.size();
+            data_.resize(want);
+            const ssize_t got = vfs->pread(fd_, data_.data() + have, want - have, static_cast<off_t>(have));
+            if (got < 0 && errno == EINTR) {
+                data_.resize(have);
+                continue;
+            }
+            data_.resize(have + static_cast<size_t>(std::max<ssize_t>(got, 0)));
+            eof_ = got <= 0 || data_.size() < want;
+        }
+        return data_.size() >= end;
+    }
+
+    const unsigned char* at(size_t offset) const { return data_.data() + offset; }
+    size_t size() const { return data_.size(); }
+
+private:
+    int fd_;
+    bool eof_ = false;
+    std::vector<unsigned char> data_;
+};
+
+
+// Function to read a TIFF integer in the byte order of its header
+static uint32_t tiff_read(const unsigned char* data, size_t bytes, bool big_endian) {
+    uint32_t value = 0;
+    for (size_t i = 0; i < bytes; ++i) {
+        const size_t shift = big_endian ? 8 * (bytes - 1 - i) : 8 * i;
+        value |= static_cast<uint32_t>(data[i]) << shift;
+    }
+    return value;
+}
+
+
+// Function to check for a TIFF header ("II*\0" or "MM\0*") at offset
+static bool tiff_header_at(HeaderReader& reader, size_t offset, bool& big_endian) {
+    if (!reader.ensure(offset, 8)) {
+        return false;
+    }
+    const unsigned char* p = reader.at(offset);
+    if (p[0] == 'I' && p[1] == 'I' && p[2] == 42 && p[3] == 0) {
+        big_endian = false;
+        return true;
+    }
+    if (p[0] == 'M' && p[1] == 'M' && p[2] == 0 && p[3] == 42) {
+        big_endian = true;
+        return true;
+    }
+    return false;
+}
+
+
+// Function to copy "YYYY:MM:DD HH:MM:SS" into stamp as YYYYMMDD_HHMMSS, false for blank or
+// zeroed values cameras write when their clock was never set
+static bool exif_stamp(const unsigned char* value, char (&stamp)[15]) {
+    static constexpr int digit_positions[] = {0, 1, 2, 3, 5, 6, 8, 9, 11, 12, 14, 15, 17, 18};
+    size_t out = 0;
+    bool nonzero = false;
+    for (const int position : digit_positions) {
+        const unsigned char c = value[position];
+        if (c < '0' || c > '9') {
+            return false;
+        }
+        nonzero |= c != '0';
+        stamp[out++] = static_cast<char>(c);
+        if (out == 8) {
+            stamp[out++] = '_';
+        }
+    }
+    return nonzero;
+}
+
+
+// Function to look up the timestamp tags of one IFD, the Exif sub-IFD offset is reported too.
+// Offsets are relative to the TIFF header at base.
+static void scan_ifd(HeaderReader& reader, size_t base, uint32_t ifd, bool big_endian,
+                     char (&stamps)[3][15], bool (&found)[3], uint32_t* exif_ifd) {
+    if (!reader.ensure(base + ifd, 2)) {
+        return;
+    }
+    const uint32_t entries = tiff_read(reader.at(base + ifd), 2, big_endian);
+    if (!reader.ensure(base + ifd + 2, entries * 12)) {
+        return;
+    }
+    for (uint32_t e = 0; e < entries; ++e) {
+        const unsigned char* entry = reader.at(base + ifd + 2 + e * 12);
+        const uint16_t tag = static_cast<uint16_t>(tiff_read(entry, 2, big_endian));
+        const uint32_t value = tiff_read(entry + 8, 4, big_endian);
+        if (tag == tag_exif_ifd && exif_ifd) {
+            *exif_ifd = value;
+            continue;
+        }
+        const int slot = tag == tag_date_time_original ? 0 : tag == tag_date_time_digitized ? 1 : tag == tag_date_time ? 2 : -1;
+        if (slot < 0 || tiff_read(entry + 2, 2, big_endian) != tiff_type_ascii || tiff_read(entry + 4, 4, big_endian) < 20) {
+            continue;
+        }
+        // 20 bytes never fit in the entry, the string is at the offset. entry points into the
+        // reader's buffer, which ensure() may move, so it is not used after this.
+        if (reader.ensure(base + value, 19)) {
+            found[slot] = exif_stamp(reader.at(base + value), stamps[slot]);
+        }
+    }
+}
+
+
+// Function to read the capture time from the TIFF structure at base
+static bool tiff_capture_time(HeaderReader& reader, size_t base, bool big_endian, char (&stamp)[15]) {
+    char stamps[3][15];
+    bool found[3] = {false, false, false};
+    uint32_t exif_ifd = 0;
+    scan_ifd(reader, base, tiff_read(reader.at(base + 4), 4, big_endian), big_endian, stamps, found, &exif_ifd);
+    if (exif_ifd != 0) {
+        scan_ifd(reader, base, exif_ifd, big_endian, stamps, found, nullptr);
+    }
+    for (int slot = 0; slot < 3; ++slot) {
+        if (found[slot]) {
+            std::memcpy(stamp, stamps[slot], sizeof(stamp));
+            return true;
+        }
+    }
+    return false;
+}
+
+
+// Function to find the TIFF header of the EXIF block. JPEG: the APP1 "Exif" segment, walked
+// marker by marker up to the image data. TIFF and raw formats built on it: the file itself.
+// HEIC and other ISO media files: the "Exif\0\0" item payload, found by scanning the header
+// instead of resolving the item location boxes.
+static bool find_tiff_header(HeaderReader& reader, size_t& base, bool& big_endian) {
+    if (!reader.ensure(0, 4)) {
+        return false;
+    }
+    if (tiff_header_at(reader, 0, big_endian)) {
+        base = 0;
+        return true;
+    }
+
+    if (reader.at(0)[0] == 0xFF && reader.at(0)[1] == 0xD8) {
+        size_t offset = 2;
+        while (reader.ensure(offset, 4) && reader.at(offset)[0] == 0xFF) {
+            const unsigned char marker = reader.at(offset)[1];
+            const size_t length = tiff_read(reader.at(offset + 2), 2, true);
+            // Start of scan: the headers are over
+            if (marker == 0xDA || length < 2) {
+                return false;
+            }
+            if (marker == 0xE1 && reader.ensure(offset + 4, 6) && std::memcmp(reader.at(offset + 4), "Exif\0\0", 6) == 0) {
+                base = offset + 10;
+                return tiff_header_at(reader, base, big_endian);
+            }
+            offset += 2 + length;
+        }
+        return false;
+    }
+
+    if (reader.ensure(4, 4) && std::memcmp(reader.at(4), "ftyp", 4) == 0) {
+        for (size_t offset = 0; reader.ensure(offset, 14); ++offset) {
+            if (std::memcmp(reader.at(offset), "Exif\0\0", 6) == 0 && tiff_header_at(reader, offset + 6, big_endian)) {
+                base = offset + 6;
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+
+// Function to build the capture-time name of a photo: YYYYMMDD_HHMMSS plus the extension of
+// file_name, lowercased. DateTimeOriginal is preferred, then DateTimeDigitized, then the
+// DateTime of IFD0. False when the file cannot be read or carries no timestamp.
+bool exif_date_name(const std::string& path, std::string_view file_name, std::string& new_name) {
+    new_name.clear();
+    const int fd = vfs->open_read(path.c_str());
+    if (fd < 0) {
+        return false;
+    }
+
+    HeaderReader reader(fd);
+    size_t base = 0;
+    bool big_endian = false;
+    char stamp[15];
+    const bool dated = find_tiff_header(reader, base, big_endian) && tiff_capture_time(reader, base, big_endian, stamp);
+    vfs->close_read(fd);
+    if (!dated) {
+        errno = ENODATA;
+        return false;
+    }
+
+    new_name.assign(stamp, sizeof(stamp));
+    const size_t dot = file_name.rfind('.');
+    if (dot != std::string_view::npos && dot > 0) {
+        for (const char c : file_name.substr(dot)) {
+            new_name.push_back(static_cast<char>(std::tolower(static_cast<unsigned char>(c))));
+        }
+    }
+    return true;
+}
+
+
+// Function to number a capture-time name for the n-th photo of the same second,
+// 20240215_143210.jpg => 20240215_143210_2.jpg
+std::string exif_numbered_name(const std::string& name, unsigned n) {
+    const size_t stem = std::min(name.size(), size_t{15});
+    return name.substr(0, stem) + "_" + std::to_string(n) + name.substr(stem);
+}
@@ -5,18 +5,29 @@
 
 #include <algorithm>
 #include <atomic>
+#include <charconv>
 #include <chrono>
 #include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
 #include <ctime>
+#include <dirent.h>
+#include <fcntl.h>
 #include <filesystem>
 #include <iomanip>
 #include <iostream>
 #include <limits>
+#include <memory>
 #include <mutex>
 #include <omp.h>
 #include <queue>
 #include <sstream>
 #include <string>
+#include <string_view>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <system_error>
 #include <termios.h>
 #include <unistd.h>
 #include <unordered_set>
@@ -24,17 +35,172 @@
 #include <utility>
 #include <vector>
 
+#include "vfs.h"
+
 
 namespace fs = std::filesystem;
 
 // Global variable for getting the max_threads
 extern unsigned int max_threads;
 
+// One worker per directory for its renames (RenameOptions::directory_affinity)
+extern bool directory_affinity;
+
+// Global memory budget for directory listings (0 = unlimited)
+extern size_t max_memory;
+
+
+// Counters
+
+// Run counter split into cache-line shards, each thread adds to its own shard without
+// contention and readers (the summary, the --progress sampler) sum them
+class ShardedCounter {
+public:
+    static constexpr unsigned shard_count = 32;
+
+    void fetch_add(long value, std::memory_order order = std::memory_order_relaxed) {
+        shards_[shard_index()].value.fetch_add(value, order);
+    }
+    ShardedCounter& operator++() {
+        fetch_add(1);
+        return *this;
+    }
+    long load() const {
+        long total = 0;
+        for (const Shard& shard : shards_) {
+            total += shard.value.load(std::memory_order_relaxed);
+        }
+        return total;
+    }
+    friend std::ostream& operator<<(std::ostream& out, const ShardedCounter& counter) {
+        return out << counter.load();
+    }
+
+private:
+    struct alignas(64) Shard {
+        std::atomic<long> value{0};
+    };
+
+    static unsigned shard_index() {
+        static std::atomic<unsigned> next_shard{0};
+        thread_local const unsigned index = next_shard.fetch_add(1, std::memory_order_relaxed) % shard_count;
+        return index;
+    }
+
+    Shard shards_[shard_count];
+};
+
+// Entries seen by the directory listings, read by --progress
+extern ShardedCounter entries_scanned;
+
+
+// Directory listings
+
+class SpillCursor;
+
+// Sort keys of a listing: none, the name without its sequence number (sequence numbering), the
+// natural order of the name (template numbering) or the inode number (disk order on spinning disks)
+enum class ListingKeys : unsigned char { None, Unnumbered, Natural, Inode };
+
+// Append-only store of directory entries, records stay in memory while the global
+// max_memory budget allows it and spill to an anonymous temp file otherwise
+class ListingSpool {
+public:
+    struct Record {
+        std::string_view key;
+        std::string_view name;
+        unsigned char type = 0;
+    };
+
+    ListingSpool();
+    ~ListingSpool();
+    ListingSpool(const ListingSpool&) = delete;
+    ListingSpool& operator=(const ListingSpool&) = delete;
+
+    void push(std::string_view key, std::string_view name, unsigned char type);
+    void sort();
+    void rewind();
+    bool next(Record& record);
+    size_t size() const { return count_; }
+    bool spilled() const { return fd_ >= 0; }
+
+private:
+    bool charge_memory(size_t bytes);
+    void uncharge_memory(size_t bytes);
+    void release_memory();
+    void spill();
+    void flush_writes();
+
+    std::vector<char> memory_;
+    std::vector<char> io_buffer_;
+    std::unique_ptr<SpillCursor> reader_;
+    size_t accounted_ = 0;
+    size_t read_pos_ = 0;
+    size_t count_ = 0;
+    off_t file_size_ = 0;
+    int fd_ = -1;
+};
+
+
+// In-flight entries as a parent node index plus an interned name slice, full paths are
+// materialized on demand into caller-owned buffers
+class PathArena {
+public:
+    using Node = uint32_t;
+    static constexpr Node no_parent = std::numeric_limits<Node>::max();
+
+    Node add(Node parent, std::string_view name);
+    Node parent(Node node) const { return nodes_[node].parent; }
+    std::string_view name(Node node) const { return std::string_view(names_.data() + nodes_[node].offset, nodes_[node].length); }
+    const std::string& path(Node node, std::string& out) const;
+    size_t size() const { return nodes_.size(); }
+    void clear() { nodes_.clear(); names_.clear(); }
+
+private:
+    struct Entry {
+        Node parent;
+        uint32_t offset;
+        uint32_t length;
+    };
+
+    bool needs_separator(Node node) const;
+
+    std::vector<Entry> nodes_;
+    std::vector<char> names_;
+};
+
+
+
+// Job sockets (--serve, --connect)
+
+// Reads the journal's "K <length> <value>\n" records from a socket, a record may arrive in pieces
+class RecordReader {
+public:
+    explicit RecordReader(int fd) : fd_(fd) {}
+
+    // Function to take the next complete record out of the buffer, false until one has arrived
+    bool next(char& kind, std::string& value);
+    // Function to read what the peer has sent, false on end of stream, errors or a malformed record
+    bool fill();
+
+private:
+    int fd_;
+    bool malformed_ = false;
+    size_t position_ = 0;
+    std::string buffer_;
+};
+
 
 // Function prototypes
 
 // Case modes
 
+// Date stamps
+void format_date_stamp(std::int64_t seconds, char* out);
+void reset_date_stamps();
+const std::string& run_date_stamp();
+unsigned int date_stamp_mask(const std::string& case_input);
+bool stat_date_stamp(const struct statx& stx, unsigned int mask, char* out);
 // General
 std::string sentenceCase(const std::string& string);
 std::string to_pascal(const std::string& string, bool isFile);
@@ -46,37 +212,191 @@ std::string swapr_transform(const std::string& string);
 std::string to_camel_case(const std::string& string, bool isFile);
 std::string from_camel_case(const std::string& string);
 // Files only
+std::string strip_numbered_prefix(const std::string& file_string);
+std::string format_numbered_prefix(size_t position, const std::string& file_string);
 std::string remove_numbered_prefix(const std::string& file_string);
 std::string append_date_seq(const std::string& file_string);
+std::string append_date_seq(const std::string& file_string, std::string_view date_seq);
 std::string remove_date_seq(const std::string& file_string);
 // Mv like style for folders only
-void rename_folders_with_sequential_numbering(const fs::path& base_directory, std::string prefix, std::atomic<int>& dirs_count, std::atomic<int>& skipped_folder_special_count, int depth, bool verbose_enabled = false, bool skipped = false, bool skipped_only = false, bool symlinks = false, size_t batch_size_folders = 100, int num_paths = 1);
+void natural_sort_key(std::string_view name, std::string& key);
+void rename_folders_with_sequential_numbering(const fs::path& base_directory, std::string prefix, ShardedCounter& dirs_count, ShardedCounter& skipped_folder_special_count, int depth, bool verbose_enabled = false, bool skipped = false, bool skipped_only = false, bool symlinks = false, unsigned int thread_budget = 1, bool one_file_system = false, dev_t root_dev = 0);
 // Simplified for folders only
 std::string get_renamed_folder_name_without_numbering(const std::string& folder_name);
 std::string get_renamed_folder_name_without_date(const std::string& folder_name);
 std::string append_date_suffix_to_folder_name(const std::string& folder_name);
+std::string append_date_suffix_to_folder_name(const std::string& folder_name, std::string_view date_stamp);
+// Mode dispatch
+using NameTransform = void (*)(std::string& name, bool isFile);
+NameTransform name_transform(std::string_view case_input);
+bool transform_name(const std::string& case_input, std::string& name, bool isFile);
 
-// main
+// dir_listing
+void list_directory(const fs::path& directory_path, ListingSpool& dirs, ListingSpool& files, ListingKeys keys = ListingKeys::None);
+bool next_arena_chunk(ListingSpool& spool, PathArena& arena, const std::string& parent, std::vector<PathArena::Node>& out, size_t max_items, std::vector<unsigned char>* types = nullptr);
+const std::string& join_path(std::string& out, std::string_view parent, std::string_view name);
+bool parse_memory_size(const std::string& value, size_t& bytes);
 
-// General
+// progress
+void start_progress(const std::vector<std::string>& paths, const ShardedCounter& files_count, const ShardedCounter& dirs_count, const ShardedCounter& skipped_file_count, const ShardedCounter& skipped_folder_count, const ShardedCounter& skipped_folder_special_count);
+void stop_progress();
+
+// checkpoint
+extern std::atomic<bool> interrupt_requested;
+void append_journal_record(std::string& out, char kind, std::string_view value);
+bool resumable_mode(const std::string& case_mode, bool extensions);
+bool open_checkpoint(const std::string& path, const std::string& run_settings, std::string& error);
+bool checkpoint_completed(const std::string& directory);
+void checkpoint_finished(const std::string& directory);
+void close_checkpoint();
+
+// durability
+enum class RenameDurability : unsigned char;
+void begin_durability(RenameDurability level);
+std::string_view directory_key(std::string_view directory);
+void note_renamed(std::string_view directory);
+void sync_directory(const std::string& directory);
+void end_durability(long& directories, long& filesystems);
+
+// device_queues
+struct DeviceQueue {
+    dev_t device;
+    bool rotational;
+    unsigned threads;                     // concurrency limit of the device
+    std::vector<size_t> paths;            // indexes of the input paths on it
+};
+bool device_rotational(dev_t device);
+std::vector<DeviceQueue> build_device_queues(const std::vector<std::string>& paths);
+int enter_device_queues(size_t queue_count);
+ListingKeys directory_listing_keys(dev_t device);
+
+// content_hash
+enum class ContentHash : unsigned char { None, Xxh64, Sha256 };
+extern ShardedCounter content_duplicates;
+ContentHash content_hash_kind(const std::string& case_input);
+bool content_hash_name(const std::string& path, std::string_view file_name, ContentHash kind, std::string& new_name);
+uint64_t xxh64_digest(std::string_view data);
+
+// metadata_filter
+struct RenameFilter;
+struct MetadataFilter {
+    enum Check : unsigned char { Newer = 1, Older = 2, MinSize = 4, MaxSize = 8, Uid = 16, Gid = 32 };
+    unsigned char checks = 0;             // the predicates that are set
+    unsigned int mask = 0;                // statx fields they read, 0 when none is set
+    int64_t newer_than = 0;
+    int64_t older_than = 0;
+    uint64_t min_size = 0;
+    uint64_t max_size = 0;
+    uint32_t uid = 0;
+    uint32_t gid = 0;
+};
+extern MetadataFilter metadata_filter;
+MetadataFilter compile_metadata_filter(const RenameFilter& filter);
+bool metadata_filter_matches(const MetadataFilter& filter, const struct statx& stx);
+bool parse_filter_time(const std::string& value, int64_t& seconds);
+bool parse_filter_owner(const std::string& value, bool group, int64_t& id);
+
+// transform_cache
+void begin_transform_cache();
+void cached_transform(NameTransform transform, std::string& name, bool isFile);
+void end_transform_cache(long& hits, long& lookups, bool& off);
+
+// name_template
+struct NameTemplate {
+    enum class Field : unsigned char { Literal, Name, Stem, Ext, Parent, Seq, Date, Mtime, Btime };
+    struct Op {
+        Field field;
+        unsigned char width;             // {seq:N} zero padding
+        bool leading_dot;                // {ext} after a '.': the dot goes with the extension
+        uint16_t transform_count;        // field transforms, in order from first_transform
+        uint32_t first_transform;
+        uint32_t offset;                 // literal text in the pool
+        uint32_t length;
+    };
+    std::vector<Op> ops;
+    std::string literals;
+    std::vector<NameTransform> transforms;
+    bool uses_sequence = false;
+    unsigned int date_mask = 0;          // statx bits of {mtime} and {btime}
+};
+extern NameTemplate name_template;
+bool compile_name_template(std::string_view text, NameTemplate& program, std::string& error);
+bool render_name_template(const NameTemplate& program, std::string_view file_name, std::string_view parent_name, size_t sequence_position, const struct statx& stx, std::string& out);
+
+// plugins
+struct PluginMode;
+bool load_transform_plugins(const std::string& path, std::string& error);
+const PluginMode* find_plugin_mode(std::string_view mode);
+bool plugin_transform_batch(const PluginMode& mode, const std::vector<std::string_view>& names, bool is_file, std::vector<std::string>& new_names);
+bool plugin_transform(const PluginMode& mode, std::string& name, bool is_file);
+
+// exif_date
+bool exif_date_name(const std::string& path, std::string_view file_name, std::string& new_name);
+std::string exif_numbered_name(const std::string& name, unsigned n);
+
+// batch_control
+void begin_batch_control(size_t files_override, size_t folders_override, unsigned in_flight_override);
+size_t file_batch_size();
+size_t folder_batch_size();
+unsigned batch_in_flight(unsigned num_threads);
+void enter_in_flight();
+void leave_in_flight();
+void record_file_batch(size_t items, unsigned team, std::chrono::steady_clock::duration elapsed);
+void end_batch_control(size_t& files, size_t& folders, unsigned& threads, bool& adaptive);
+
+// archive
+struct RenameOptions;
+struct RenameResult;
+void rename_archive(const std::string& input, const std::string& output, const RenameOptions& options, RenameResult& result);
+
+// vfs
+extern Vfs* vfs;
+Vfs& posix_vfs();
+
+// Function to list a directory of the job's Vfs into a callable taking (name, type, inode)
+template <typename Visitor>
+bool vfs_list(const char* path, Visitor&& visitor) {
+    return vfs->list(path, [](void* context, std::string_view name, unsigned char type, uint64_t inode) {
+        (*static_cast<std::remove_reference_t<Visitor>*>(context))(name, type, inode);
+    }, &visitor);
+}
+
+// main (CLI)
+struct RenameOptions;
+struct RenameResult;
 std::string example_transform(const std::string& mode, std::string word, bool ce_flag);
 void flushStdin();
 void disableInput();
 void restoreInput();
-void print_error(const std::string& error, std::ostream& os = std::cerr);
-void print_verbose_enabled(const std::string& message, std::ostream& os = std::cout);
 void printVersionNumber(const std::string& version);
 void print_help();
 void clearScrollBuffer();
+void print_summary(const RenameResult& result, bool rename_extensions, bool one_file_system, bool verbose_enabled);
+void install_interrupt_handlers();
+
+// serve
+int serve_jobs(const std::string& socket_path);
+RenameResult run_remote_job(const std::string& socket_path, const RenameOptions& options, const std::vector<std::string>& paths);
+
+// rename_engine
+
+// General
+void print_error(const std::string& error, std::ostream& os = std::cerr);
+void print_verbose_enabled(const std::string& message, std::ostream& os = std::cout);
+void print_progress_line(const std::string& line, bool in_place);
+bool statx_path(const char* path, unsigned int mask, bool follow_symlinks, struct statx& stx);
+dev_t statx_dev(const struct statx& stx);
 // For file extension renaming
-void rename_extension(const std::vector<fs::path>& item_paths, const std::string& case_input, bool verbose_enabled, std::atomic<int>& files_count, size_t batch_size, bool symlinks, std::atomic<int>& skipped_file_count, bool skipped, bool skipped_only);
-void batch_rename_extension(const std::vector<std::pair<fs::path, fs::path>>& data, bool verbose_enabled, std::atomic<int>& files_count, bool skipped_only);
-void rename_extension_path(const std::vector<std::string>& paths, const std::string& case_input, bool verbose_enabled, int depth, std::atomic<int>& files_count, size_t batch_size_files, bool symlinks, std::atomic<int>& skipped_file_count, bool skipped, bool skipped_only, bool non_interactive);
+enum class ExtensionMode { None, Lower, Upper, Reverse, Title, Bak, Rbak, Noext, Swap, Swapr };
+ExtensionMode parse_extension_mode(const std::string& case_input);
+void rename_extension_file(const std::string& parent_path, std::string_view file_name, ExtensionMode mode, bool verbose_enabled, ShardedCounter& files_count, bool symlinks, ShardedCounter& skipped_file_count, bool skipped, bool skipped_only);
+void rename_extension_directory(const std::string& directory_path, ExtensionMode mode, bool verbose_enabled, int depth, ShardedCounter& files_count, bool symlinks, ShardedCounter& skipped_file_count, bool skipped, bool skipped_only, unsigned int num_threads, bool one_file_system, dev_t root_dev, ShardedCounter& crossed_mounts_count);
+void rename_extension_path(const std::vector<std::string>& paths, const std::string& case_input, bool verbose_enabled, int depth, ShardedCounter& files_count, bool symlinks, ShardedCounter& skipped_file_count, bool skipped, bool skipped_only, bool one_file_system, ShardedCounter& crossed_mounts_count);
 // For file renaming
-void rename_file(const fs::path& item_path, const std::string& case_input, bool is_directory, bool verbose_enabled, bool transform_dirs, bool transform_files, std::atomic<int>& files_count, std::atomic<int>& dirs_count, size_t batch_size_files, bool symlinks, std::atomic<int>& skipped_file_count, std::atomic<int>& skipped_folder_count, bool skipped, bool skipped_only);
-void rename_batch(const std::vector<std::pair<fs::path, std::string>>& data, bool verbose_enabled, std::atomic<int>& files_count, std::atomic<int>& dirs_count, bool skipped_only);
+void rename_file(const std::string& parent_path, std::string_view file_name, const std::string& case_input, bool verbose_enabled, bool transform_files, ShardedCounter& files_count, bool symlinks, ShardedCounter& skipped_file_count, bool skipped, bool skipped_only, size_t sequence_position = 0, const std::string* content_name = nullptr);
+std::string rename_error_message(const std::string& old_path, const std::string& new_path, int error);
 // For folder renaming
-void rename_directory(const fs::path& directory_path, const std::string& case_input, bool rename_parents, bool verbose_enabled, bool transform_dirs, bool transform_files, std::atomic<int>& files_count, std::atomic<int>& dirs_count, int depth, size_t batch_size_files, size_t batch_size_folders, bool symlinks, std::atomic<int>& skipped_file_count, std::atomic<int>& skipped_folder_count, std::atomic<int>& skipped_folder_special_count, bool skipped, bool skipped_only, std::atomic<bool>& isFirstRun, std::atomic<bool>& special, int num_paths);
-void rename_path(const std::vector<std::string>& paths, const std::string& case_input, bool rename_parents, bool verbose_enabled, bool transform_dirs, bool transform_files, std::atomic<int>& depth, std::atomic<int>& files_count, std::atomic<int>& dirs_count, size_t batch_size_files, size_t batch_size_folders, bool symlinks, std::atomic<int>& skipped_file_count, std::atomic<int>& skipped_folder_count, std::atomic<int>& skipped_folder_special_count, bool skipped, bool skipped_only, std::atomic<bool>& isFirstRun, bool non_interactive, std::atomic<bool>& special);
+void rename_directory(const fs::path& directory_path, const std::string& case_input, bool rename_parents, bool verbose_enabled, bool transform_dirs, bool transform_files, ShardedCounter& files_count, ShardedCounter& dirs_count, int depth, bool symlinks, ShardedCounter& skipped_file_count, ShardedCounter& skipped_folder_count, ShardedCounter& skipped_folder_special_count, bool skipped, bool skipped_only, std::atomic<bool>& isFirstRun, std::atomic<bool>& special, unsigned int thread_budget, bool one_file_system, dev_t root_dev, ShardedCounter& crossed_mounts_count);
+void rename_path(const std::vector<std::string>& paths, const std::string& case_input, bool rename_parents, bool verbose_enabled, bool transform_dirs, bool transform_files, std::atomic<int>& depth, ShardedCounter& files_count, ShardedCounter& dirs_count, bool symlinks, ShardedCounter& skipped_file_count, ShardedCounter& skipped_folder_count, ShardedCounter& skipped_folder_special_count, bool skipped, bool skipped_only, std::atomic<bool>& isFirstRun, std::atomic<bool>& special, bool one_file_system, ShardedCounter& crossed_mounts_count);
 
 #endif // HEADERS_H
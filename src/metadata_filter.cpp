@@ -0,0 +1,135 @@
+// SPDX-License-Identifier: GNU General Public License v3.0 or later
+
+#include "headers.h"
+#include "renamepp.h"
+
+#include <grp.h>
+#include <pwd.h>
+
+
+// The --newer/--older/--min-size/--max-size/--uid/--gid predicates of the running job, set by
+// RenameEngine::run. The scanner adds their statx fields to the one statx it makes per file
+// anyway, no predicate set adds no field and no call.
+MetadataFilter metadata_filter;
+
+
+// Function to turn the options' predicates into the checks and the statx fields they read
+MetadataFilter compile_metadata_filter(const RenameFilter& filter) {
+    MetadataFilter compiled;
+    if (filter.newer_than != INT64_MIN) {
+        compiled.checks |= MetadataFilter::Newer;
+        compiled.newer_than = filter.newer_than;
+    }
+    if (filter.older_than != INT64_MAX) {
+        compiled.checks |= MetadataFilter::Older;
+        compiled.older_than = filter.older_than;
+    }
+    if (filter.min_size > 0) {
+        compiled.checks |= MetadataFilter::MinSize;
+        compiled.min_size = filter.min_size;
+    }
+    if (filter.max_size != UINT64_MAX) {
+        compiled.checks |= MetadataFilter::MaxSize;
+        compiled.max_size = filter.max_size;
+    }
+    if (filter.uid >= 0) {
+        compiled.checks |= MetadataFilter::Uid;
+        compiled.uid = static_cast<uint32_t>(filter.uid);
+    }
+    if (filter.gid >= 0) {
+        compiled.checks |= MetadataFilter::Gid;
+        compiled.gid = static_cast<uint32_t>(filter.gid);
+    }
+
+    if (compiled.checks & (MetadataFilter::Newer | MetadataFilter::Older)) compiled.mask |= STATX_MTIME;
+    if (compiled.checks & (MetadataFilter::MinSize | MetadataFilter::MaxSize)) compiled.mask |= STATX_SIZE;
+    if (compiled.checks & MetadataFilter::Uid) compiled.mask |= STATX_UID;
+    if (compiled.checks & MetadataFilter::Gid) compiled.mask |= STATX_GID;
+    return compiled;
+}
+
+
+// Function to test a file's statx against the checks, a field the filesystem did not fill
+// fails its check
+bool metadata_filter_matches(const MetadataFilter& filter, const struct statx& stx) {
+    if ((stx.stx_mask & filter.mask) != filter.mask) {
+        return false;
+    }
+    const unsigned char checks = filter.checks;
+    if ((checks & MetadataFilter::Newer) && stx.stx_mtime.tv_sec < filter.newer_than) return false;
+    if ((checks & MetadataFilter::Older) && stx.stx_mtime.tv_sec >= filter.older_than) return false;
+    if ((checks & MetadataFilter::MinSize) && stx.stx_size < filter.min_size) return false;
+    if ((checks & MetadataFilter::MaxSize) && stx.stx_size > filter.max_size) return false;
+    if ((checks & MetadataFilter::Uid) && stx.stx_uid != filter.uid) return false;
+    if ((checks & MetadataFilter::Gid) && stx.stx_gid != filter.gid) return false;
+    return true;
+}
+
+
+// Function to parse --newer/--older: an age before now with an s, m, h, d or w unit (30m, 24h,
+// 7d), or a local date with an optional time (2024-01-15, 2024-01-15T08:30). Seconds since
+// the epoch.
+bool parse_filter_time(const std::string& value, int64_t& seconds) {
+    int64_t amount = 0;
+    const auto [end, error] = std::from_chars(value.data(), value.data() + value.size(), amount);
+    if (error == std::errc() && end + 1 == value.data() + value.size() && amount >= 0) {
+        int64_t unit = 0;
+        switch (*end) {
+            case 's': unit = 1; break;
+            case 'm': unit = 60; break;
+            case 'h': unit = 3600; break;
+            case 'd': unit = 86400; break;
+            case 'w': unit = 7 * 86400; break;
+            default: return false;
+        }
+        if (amount > INT64_MAX / unit) {
+            return false;
+        }
+        seconds = static_cast<int64_t>(std::time(nullptr)) - amount * unit;
+        return true;
+    }
+
+    for (const char* format : {"%Y-%m-%d", "%Y-%m-%dT%H:%M", "%Y-%m-%dT%H:%M:%S"}) {
+        struct tm date {};
+        const char* parsed = strptime(value.c_str(), format, &date);
+        if (parsed && *parsed == '\0') {
+            date.tm_isdst = -1;
+            const time_t local = std::mktime(&date);
+            if (local == static_cast<time_t>(-1)) {
+                return false;
+            }
+            seconds = static_cast<int64_t>(local);
+            return true;
+        }
+    }
+    return false;
+}
+
+
+// Function to parse --uid/--gid: a numeric id or a user (group) name
+bool parse_filter_owner(const std::string& value, bool group, int64_t& id) {
+    uint32_t number = 0;
+    const auto [end, error] = std::from_chars(value.data(), value.data() + value.size(), number);
+    if (!value.empty() && error == std::errc() && end == value.data() + value.size()) {
+        id = number;
+        return true;
+    }
+
+    char buffer[16384];
+    if (group) {
+        struct group entry;
+        struct group* found = nullptr;
+        if (getgrnam_r(value.c_str(), &entry, buffer, sizeof(buffer), &found) != 0 || !found) {
+            return false;
+        }
+        id = found->gr_gid;
+    } else {
+        struct passwd entry;
+        struct passwd* found = nullptr;
+        if (getpwnam_r(value.c_str(), &entry, buffer, sizeof(buffer), &found) != 0 || !found) {
+            return false;
+        }
+        id = found->pw_uid;
+    }
+    return true;
+}
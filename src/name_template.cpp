@@ -0,0 +1,207 @@
+// SPDX-License-Identifier: GNU General Public License v3.0 or later
+
+#include "headers.h"
+
+#include <charconv>
+
+
+// -t templates: literal text and {field[:width][|mode]...} placeholders, e.g.
+// {parent}_{seq:04}_{stem|lower}.{ext|lower}. A template is compiled once into a flat list of
+// ops, each entry renders it into a per-thread buffer without parsing anything again.
+
+// Template of the running job, set by RenameEngine::run
+NameTemplate name_template;
+
+// {seq} without a width pads like the sequence mode, 001_Test
+static constexpr unsigned default_sequence_width = 3;
+static constexpr unsigned max_sequence_width = 20;
+
+static const std::pair<std::string_view, NameTemplate::Field> template_fields[] = {
+    {"name", NameTemplate::Field::Name},
+    {"stem", NameTemplate::Field::Stem},
+    {"ext", NameTemplate::Field::Ext},
+    {"parent", NameTemplate::Field::Parent},
+    {"seq", NameTemplate::Field::Seq},
+    {"date", NameTemplate::Field::Date},
+    {"mtime", NameTemplate::Field::Mtime},
+    {"btime", NameTemplate::Field::Btime},
+};
+
+
+// Function to compile a template, false with a message naming the offending part
+bool compile_name_template(std::string_view text, NameTemplate& program, std::string& error) {
+    program = NameTemplate();
+    if (text.empty()) {
+        error = "Template is empty";
+        return false;
+    }
+
+    // Literal runs are appended to the pool, consecutive ones share an op
+    const auto add_literal = [&](char c) {
+        if (program.ops.empty() || program.ops.back().field != NameTemplate::Field::Literal) {
+            program.ops.push_back({NameTemplate::Field::Literal, 0, false, 0, 0, static_cast<uint32_t>(program.literals.size()), 0});
+        }
+        program.literals.push_back(c);
+        ++program.ops.back().length;
+    };
+
+    for (size_t i = 0; i < text.size(); ++i) {
+        const char c = text[i];
+        if ((c == '{' || c == '}') && i + 1 < text.size() && text[i + 1] == c) {
+            add_literal(c);
+            ++i;
+            continue;
+        }
+        if (c == '}') {
+            error = "Unmatched '}' in template, write '}}' for a literal one";
+            return false;
+        }
+        if (c == '/' || c == '\0') {
+            error = "Template cannot contain '/', it names a single entry";
+            return false;
+        }
+        if (c != '{') {
+            add_literal(c);
+            continue;
+        }
+
+        const size_t close = text.find('}', i + 1);
+        if (close == std::string_view::npos) {
+            error = "Unmatched '{' in template, write '{{' for a literal one";
+            return false;
+        }
+        std::string_view placeholder = text.substr(i + 1, close - i - 1);
+        i = close;
+
+        // field[:width] comes first, then the |mode transforms in the order written
+        const size_t bar = placeholder.find('|');
+        std::string_view field = placeholder.substr(0, bar);
+        std::string_view transforms = bar == std::string_view::npos ? std::string_view() : placeholder.substr(bar);
+
+        NameTemplate::Op op{NameTemplate::Field::Literal, 0, false, 0, static_cast<uint32_t>(program.transforms.size()), 0, 0};
+        const size_t colon = field.find(':');
+        const std::string_view field_name = field.substr(0, colon);
+        const auto known = std::find_if(std::begin(template_fields), std::end(template_fields),
+                                        [&](const auto& entry) { return entry.first == field_name; });
+        if (known == std::end(template_fields)) {
+            error = "Unknown template field {" + std::string(field_name) + "}, use name, stem, ext, parent, seq, date, mtime or btime";
+            return false;
+        }
+        op.field = known->second;
+
+        if (op.field == NameTemplate::Field::Seq) {
+            unsigned width = default_sequence_width;
+            if (colon != std::string_view::npos) {
+                const std::string_view digits = field.substr(colon + 1);
+                const auto [end, ec] = std::from_chars(digits.data(), digits.data() + digits.size(), width);
+                if (digits.empty() || ec != std::errc() || end != digits.data() + digits.size() || width > max_sequence_width) {
+                    error = "Invalid {seq} width '" + std::string(digits) + "', e.g. {seq:04}";
+                    return false;
+                }
+            }
+            op.width = static_cast<unsigned char>(width);
+            program.uses_sequence = true;
+        } else if (colon != std::string_view::npos) {
+            error = "Only {seq} takes a width, e.g. {seq:04}";
+            return false;
+        }
+        // {stem}.{ext} of a file without extension is the stem, not "stem."
+        if (op.field == NameTemplate::Field::Ext && !program.ops.empty() && program.ops.back().field == NameTemplate::Field::Literal &&
+            program.literals.back() == '.') {
+            op.leading_dot = true;
+            program.literals.pop_back();
+            if (--program.ops.back().length == 0) {
+                program.ops.pop_back();
+            }
+        }
+        if (op.field == NameTemplate::Field::Mtime) program.date_mask |= STATX_MTIME;
+        if (op.field == NameTemplate::Field::Btime) program.date_mask |= STATX_BTIME;
+
+        while (!transforms.empty()) {
+            transforms.remove_prefix(1);
+            const std::string_view mode = transforms.substr(0, transforms.find('|'));
+            transforms.remove_prefix(mode.size());
+            const NameTransform transform = name_transform(mode);
+            if (!transform) {
+                error = "Unknown transform |" + std::string(mode) + " in template, use a name mode such as lower, upper or snake";
+                return false;
+            }
+            program.transforms.push_back(transform);
+            ++op.transform_count;
+        }
+        program.ops.push_back(op);
+    }
+    return true;
+}
+
+
+// Function to render a compiled template for one file into out. parent_name is the name of the
+// folder holding it, sequence_position its 1-based rank there (when the template numbers) and
+// stx its statx (when the template dates). False when a date is missing or the name comes out
+// empty, "." or "..".
+bool render_name_template(const NameTemplate& program, std::string_view file_name, std::string_view parent_name,
+                          size_t sequence_position, const struct statx& stx, std::string& out) {
+    thread_local std::string field;
+    out.clear();
+
+    const size_t dot = file_name.rfind('.');
+    const bool has_ext = dot != std::string_view::npos && dot > 0;
+    for (const NameTemplate::Op& op : program.ops) {
+        char digits[max_sequence_width + 1];
+        char date_stamp[8];
+        std::string_view value;
+        switch (op.field) {
+            case NameTemplate::Field::Literal:
+                out.append(program.literals, op.offset, op.length);
+                continue;
+            case NameTemplate::Field::Name:
+                value = file_name;
+                break;
+            case NameTemplate::Field::Stem:
+                value = has_ext ? file_name.substr(0, dot) : file_name;
+                break;
+            case NameTemplate::Field::Ext:
+                value = has_ext ? file_name.substr(dot + 1) : std::string_view();
+                break;
+            case NameTemplate::Field::Parent:
+                value = parent_name;
+                break;
+            case NameTemplate::Field::Seq: {
+                const char* end = std::to_chars(digits, digits + sizeof(digits), sequence_position).ptr;
+                const size_t length = static_cast<size_t>(end - digits);
+                const size_t padding = op.width > length ? op.width - length : 0;
+                std::memmove(digits + padding, digits, length);
+                std::memset(digits, '0', padding);
+                value = std::string_view(digits, length + padding);
+                break;
+            }
+            case NameTemplate::Field::Date:
+                value = run_date_stamp();
+                break;
+            case NameTemplate::Field::Mtime:
+            case NameTemplate::Field::Btime:
+                if (!stat_date_stamp(stx, op.field == NameTemplate::Field::Mtime ? STATX_MTIME : STATX_BTIME, date_stamp)) {
+                    return false;
+                }
+                value = std::string_view(date_stamp, sizeof(date_stamp));
+                break;
+        }
+
+        if (op.transform_count == 0) {
+            if (op.leading_dot && !value.empty()) {
+                out.push_back('.');
+            }
+            out.append(value);
+            continue;
+        }
+        field.assign(value);
+        for (uint32_t t = op.first_transform; t < op.first_transform + op.transform_count; ++t) {
+            cached_transform(program.transforms[t], field, true);
+        }
+        if (op.leading_dot && !field.empty()) {
+            out.push_back('.');
+        }
+        out.append(field);
+    }
+    return !out.empty() && out != "." && out != ".." && out.find('/') == std::string::npos;
+}
@@ -0,0 +1,195 @@
+// SPDX-License-Identifier: GNU General Public License v3.0 or later
+
+#include "headers.h"
+#include "renamepp.h"
+#include "renamepp_plugin.h"
+
+#include <deque>
+#include <dlfcn.h>
+
+
+// Transform plugins (--plugin): shared objects exporting renamepp_plugin_v1(), see
+// renamepp_plugin.h. They are loaded before any job runs and never unloaded, so the walkers
+// read the registry without locking.
+
+struct PluginMode {
+    std::string name;
+    const renamepp_plugin* plugin;
+    size_t plugin_index;
+    uint32_t mode;
+};
+
+static std::vector<const renamepp_plugin*> plugins;
+// A deque keeps the modes in place while later plugins are added
+static std::deque<PluginMode> plugin_modes;
+
+// Arena of a batch before the plugin asked for more, enough for most names to double
+static constexpr size_t initial_arena_size = 64 << 10;
+
+
+// Per-thread plugin states, destroyed by the plugins that made them when the thread exits
+struct PluginWorkers {
+    std::vector<void*> states;
+
+    ~PluginWorkers() {
+        for (size_t i = 0; i < states.size(); ++i) {
+            if (states[i] && plugins[i]->worker_destroy) {
+                plugins[i]->worker_destroy(states[i]);
+            }
+        }
+    }
+};
+
+
+// Function to load one shared object and register its modes
+static bool load_plugin_file(const std::string& path, std::string& error) {
+    void* handle = ::dlopen(path.c_str(), RTLD_NOW | RTLD_LOCAL);
+    if (!handle) {
+        error = std::string("Cannot load plugin: ") + ::dlerror();
+        return false;
+    }
+    const auto entry = reinterpret_cast<renamepp_plugin_entry>(::dlsym(handle, RENAMEPP_PLUGIN_ENTRY));
+    const renamepp_plugin* plugin = entry ? entry() : nullptr;
+    if (!plugin || plugin->abi != RENAMEPP_PLUGIN_ABI || !plugin->modes || !plugin->transform) {
+        error = "Not a bulk_rename++ plugin (ABI " + std::to_string(RENAMEPP_PLUGIN_ABI) + "): " + path;
+        ::dlclose(handle);
+        return false;
+    }
+
+    // All modes are checked before any is registered, a rejected plugin leaves nothing behind
+    std::vector<std::string> names;
+    for (const char* const* mode = plugin->modes; *mode; ++mode) {
+        const std::string name(*mode);
+        if (name.empty() || RenameEngine::valid_case_mode(name, RenameScope::Names) || RenameEngine::valid_case_mode(name, RenameScope::Extensions) ||
+            name == "template" || find_plugin_mode(name) || std::find(names.begin(), names.end(), name) != names.end()) {
+            error = "Plugin mode '" + name + "' is empty or already taken: " + path;
+            ::dlclose(handle);
+            return false;
+        }
+        names.push_back(name);
+    }
+    for (size_t i = 0; i < names.size(); ++i) {
+        plugin_modes.push_back({names[i], plugin, plugins.size(), static_cast<uint32_t>(i)});
+    }
+    plugins.push_back(plugin);
+    return true;
+}
+
+
+// Function to load a plugin, or every *.so of a directory in name order. Not thread-safe: it
+// must run before the jobs that use the modes.
+bool load_transform_plugins(const std::string& path, std::string& error) {
+    std::error_code ec;
+    if (!fs::is_directory(path, ec)) {
+        return load_plugin_file(path, error);
+    }
+    std::vector<std::string> files;
+    for (const fs::directory_entry& entry : fs::directory_iterator(path, ec)) {
+        if (entry.path().extension() == ".so") {
+            files.push_back(entry.path().string());
+        }
+    }
+    if (ec) {
+        error = "Cannot read plugin directory " + path + ": " + ec.message();
+        return false;
+    }
+    std::sort(files.begin(), files.end());
+    for (const std::string& file : files) {
+        if (!load_plugin_file(file, error)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+// Function to look up a plugin mode, nullptr when no loaded plugin has it
+const PluginMode* find_plugin_mode(std::string_view mode) {
+    for (const PluginMode& plugin_mode : plugin_modes) {
+        if (plugin_mode.name == mode) {
+            return &plugin_mode;
+        }
+    }
+    return nullptr;
+}
+
+
+// Function to check a name a plugin returned, it must stay a single directory entry
+static bool valid_plugin_name(std::string_view name) {
+    return !name.empty() && name.size() <= NAME_MAX && name != "." && name != ".." &&
+           name.find('/') == std::string_view::npos && name.find('\0') == std::string_view::npos;
+}
+
+
+// Function to run a plugin mode over a batch of names. new_names[i] is left empty for a name
+// the plugin keeps; a failed batch or an invalid name keeps the names and returns false.
+bool plugin_transform_batch(const PluginMode& mode, const std::vector<std::string_view>& names, bool is_file, std::vector<std::string>& new_names) {
+    thread_local PluginWorkers workers;
+    thread_local std::vector<renamepp_slice> in;
+    thread_local std::vector<renamepp_slice> out;
+    thread_local std::vector<char> arena(initial_arena_size);
+
+    new_names.assign(names.size(), std::string());
+    if (names.empty()) {
+        return true;
+    }
+    if (workers.states.size() < plugins.size()) {
+        workers.states.resize(plugins.size(), nullptr);
+    }
+    void*& worker = workers.states[mode.plugin_index];
+    if (!worker && mode.plugin->worker_create) {
+        worker = mode.plugin->worker_create();
+    }
+
+    in.resize(names.size());
+    for (size_t i = 0; i < names.size(); ++i) {
+        in[i] = {names[i].data(), names[i].size()};
+    }
+    out.assign(names.size(), {nullptr, 0});
+
+    int status = RENAMEPP_FAILED;
+    for (int attempt = 0; attempt < 2; ++attempt) {
+        size_t needed = 0;
+        status = mode.plugin->transform(worker, mode.mode, is_file ? 1 : 0, in.data(), in.size(), arena.data(), arena.size(), out.data(), &needed);
+        if (status != RENAMEPP_ARENA_FULL || needed <= arena.size()) {
+            break;
+        }
+        arena.resize(needed);
+    }
+    if (status != RENAMEPP_OK) {
+        print_error("\033[1;91mError\033[0m: plugin mode " + mode.name + " failed on a batch of " + std::to_string(names.size()) + " name(s)", std::cerr);
+        return false;
+    }
+
+    bool all_valid = true;
+    const auto arena_begin = reinterpret_cast<uintptr_t>(arena.data());
+    const auto arena_end = arena_begin + arena.size();
+    for (size_t i = 0; i < names.size(); ++i) {
+        if (!out[i].data) {
+            continue;
+        }
+        const auto begin = reinterpret_cast<uintptr_t>(out[i].data);
+        const bool in_arena = begin >= arena_begin && begin <= arena_end && out[i].size <= arena_end - begin;
+        const std::string_view name = in_arena ? std::string_view(out[i].data, out[i].size) : std::string_view();
+        if (!valid_plugin_name(name)) {
+            print_error("\033[1;91mError\033[0m: plugin mode " + mode.name + " returned an invalid name for " + std::string(names[i]), std::cerr);
+            all_valid = false;
+            continue;
+        }
+        new_names[i].assign(name);
+    }
+    return all_valid;
+}
+
+
+// Function to apply a plugin mode to a single name in place, a batch of one
+bool plugin_transform(const PluginMode& mode, std::string& name, bool is_file) {
+    thread_local std::vector<std::string_view> names(1);
+    thread_local std::vector<std::string> new_names;
+    names[0] = name;
+    const bool transformed = plugin_transform_batch(mode, names, is_file, new_names);
+    if (!new_names[0].empty()) {
+        name = new_names[0];
+    }
+    return transformed;
+}
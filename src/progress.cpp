@@ -0,0 +1,109 @@
+// SPDX-License-Identifier: GNU General Public License v3.0 or later
+
+#include "headers.h"
+
+#include <condition_variable>
+#include <sys/statfs.h>
+#include <thread>
+
+
+// Sampler thread state, workers never touch it: they only bump their counter shards
+static std::thread progress_sampler;
+static std::mutex progress_mutex;
+static std::condition_variable progress_wake;
+static bool progress_stopping = false;
+
+// Refresh interval on a terminal, redirected output gets a plain line less often
+static constexpr std::chrono::milliseconds progress_interval{250};
+static constexpr int progress_log_every = 40;
+
+
+// Function to estimate the entries below the input paths from the used inodes of their filesystems,
+// an upper bound for subtrees and 0 when a filesystem does not report inode counts
+static long estimate_total_entries(const std::vector<std::string>& paths) {
+    std::vector<fsid_t> seen;
+    long total = 0;
+    for (const std::string& path : paths) {
+        struct statfs sfs;
+        if (statfs(path.c_str(), &sfs) != 0 || sfs.f_files == 0) {
+            continue;
+        }
+        const bool counted = std::any_of(seen.begin(), seen.end(), [&](const fsid_t& fsid) {
+            return std::memcmp(&fsid, &sfs.f_fsid, sizeof(fsid_t)) == 0;
+        });
+        if (!counted) {
+            seen.push_back(sfs.f_fsid);
+            total += static_cast<long>(sfs.f_files - sfs.f_ffree);
+        }
+    }
+    return total;
+}
+
+
+// Function to format seconds as H:MM:SS
+static std::string format_duration(double seconds) {
+    const long total = static_cast<long>(seconds + 0.5);
+    char buffer[32];
+    std::snprintf(buffer, sizeof(buffer), "%ld:%02ld:%02ld", total / 3600, (total / 60) % 60, total % 60);
+    return buffer;
+}
+
+
+// Function to start the --progress sampler, it reads the sharded counters a few times per second
+void start_progress(const std::vector<std::string>& paths, const ShardedCounter& files_count, const ShardedCounter& dirs_count, const ShardedCounter& skipped_file_count, const ShardedCounter& skipped_folder_count, const ShardedCounter& skipped_folder_special_count) {
+    progress_stopping = false;
+    progress_sampler = std::thread([&paths, &files_count, &dirs_count, &skipped_file_count, &skipped_folder_count, &skipped_folder_special_count] {
+        const bool in_place = isatty(STDERR_FILENO);
+        const long estimated_total = estimate_total_entries(paths);
+        auto last_time = std::chrono::steady_clock::now();
+        long last_scanned = 0;
+        double rate = 0.0;
+
+        std::unique_lock<std::mutex> lock(progress_mutex);
+        for (int tick = 1; !progress_wake.wait_for(lock, progress_interval, [] { return progress_stopping; }); ++tick) {
+            const auto now = std::chrono::steady_clock::now();
+            const long scanned = entries_scanned.load();
+            const double elapsed = std::chrono::duration<double>(now - last_time).count();
+
+            // Smoothed scan rate, an HDD run stalls and bursts too much for a single interval
+            const double instant_rate = elapsed > 0.0 ? (scanned - last_scanned) / elapsed : 0.0;
+            rate = rate == 0.0 ? instant_rate : 0.7 * rate + 0.3 * instant_rate;
+            last_time = now;
+            last_scanned = scanned;
+
+            if (!in_place && tick % progress_log_every != 0) {
+                continue;
+            }
+
+            std::ostringstream line;
+            line << "Scanned: " << scanned
+                 << " | Renamed: " << files_count << " file(s) && " << dirs_count << " folder(s)"
+                 << " | Skipped: " << skipped_file_count << " file(s) && " << (skipped_folder_count.load() + skipped_folder_special_count.load()) << " folder(s)"
+                 << " | " << static_cast<long>(rate) << " entries/s | ETA: ";
+            if (estimated_total > scanned && rate >= 1.0) {
+                line << format_duration((estimated_total - scanned) / rate);
+            } else {
+                line << "--";
+            }
+            print_progress_line(line.str(), in_place);
+        }
+
+        if (in_place) {
+            print_progress_line("", true);
+        }
+    });
+}
+
+
+// Function to stop the --progress sampler and clear its line, a no-op when it is not running
+void stop_progress() {
+    if (!progress_sampler.joinable()) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(progress_mutex);
+        progress_stopping = true;
+    }
+    progress_wake.notify_one();
+    progress_sampler.join();
+}
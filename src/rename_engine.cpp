@@ -0,0 +1,1115 @@
+// SPDX-License-Identifier: GNU General Public License v3.0 or later
+
+#include "headers.h"
+#include "renamepp.h"
+
+
+// General purpose stuff
+
+// Get the number of available processor cores
+unsigned int max_threads = (omp_get_num_procs() <= 0) ? 2 : static_cast<unsigned int>(omp_get_num_procs());
+
+// One worker renames the entries of a directory, the threads spread over directories instead
+bool directory_affinity = true;
+
+// Set on the threads of a directory walk team, their subdirectories become tasks of that team
+static thread_local bool in_walk_team = false;
+
+// Stat helpers
+
+// Function to query only the requested statx fields of a path, returns false on failure
+// (the device id is always filled in regardless of the mask)
+bool statx_path(const char* path, unsigned int mask, bool follow_symlinks, struct statx& stx) {
+    return vfs->stat(path, mask, follow_symlinks, stx);
+}
+
+
+// Function to build a dev_t out of the split major/minor statx device id
+dev_t statx_dev(const struct statx& stx) {
+    return makedev(stx.stx_dev_major, stx.stx_dev_minor);
+}
+
+
+// Global print functions
+
+// Mutex to prevent interleaved output from concurrent threads
+static std::mutex print_mutex;
+
+// Event callback of the running RenameEngine job, messages go to the streams without one
+static RenameEventCallback event_callback;
+
+
+// Function to turn a verbose or error line into a RenameEvent, dropping the terminal colors
+static RenameEvent make_event(const std::string& message, bool is_error) {
+    RenameEvent event{RenameEvent::Type::Error, std::string()};
+    event.text.reserve(message.size());
+    for (size_t i = 0; i < message.size(); ++i) {
+        if (message[i] == '\033') {
+            // Skip the escape sequence up to its final letter
+            while (i + 1 < message.size() && !std::isalpha(static_cast<unsigned char>(message[i + 1]))) ++i;
+            ++i;
+            continue;
+        }
+        event.text.push_back(message[i]);
+    }
+    const size_t begin = event.text.find_first_not_of(" \n");
+    event.text.erase(0, begin == std::string::npos ? event.text.size() : begin);
+    while (!event.text.empty() && event.text.back() == '\n') event.text.pop_back();
+    if (!is_error) {
+        event.type = event.text.compare(0, 7, "Renamed") == 0 ? RenameEvent::Type::Renamed : RenameEvent::Type::Skipped;
+    }
+    return event;
+}
+
+
+// Print an error message to stderr in a thread-safe manner
+void print_error(const std::string& error, std::ostream& out) {
+    std::lock_guard<std::mutex> lock(print_mutex);
+    if (event_callback) {
+        event_callback(make_event(error, true));
+        return;
+    }
+    out << error << std::endl;
+}
+
+
+// Print a message to stdout in a thread-safe manner (used when verbose mode is enabled)
+void print_verbose_enabled(const std::string& message, std::ostream& out) {
+    std::lock_guard<std::mutex> lock(print_mutex);
+    if (event_callback) {
+        event_callback(make_event(message, false));
+        return;
+    }
+    out << message << std::endl;
+}
+
+
+// Print the --progress status line to stderr, redrawn in place on a terminal
+void print_progress_line(const std::string& line, bool in_place) {
+    std::lock_guard<std::mutex> lock(print_mutex);
+    if (in_place) {
+        std::cerr << "\r\033[K" << line << std::flush;
+    } else {
+        std::cerr << line << std::endl;
+    }
+}
+
+
+// Helper template for a batch of files of one directory. The kernel serializes renames into a
+// parent on its inode lock, so with directory_affinity one worker issues them all and the
+// other threads walk other directories, as many batches at once as the in-flight value allows.
+// File batches feed their latency to the batch controller.
+template<typename Item, typename Func>
+void process_file_batch(const std::vector<Item>& items,
+                        unsigned int num_threads,
+                        Func func) {
+    if (directory_affinity) {
+        enter_in_flight();
+    }
+    const auto start = std::chrono::steady_clock::now();
+    const unsigned int team_limit = directory_affinity ? 1 : batch_in_flight(num_threads);
+    unsigned int team = 1;
+
+    #pragma omp parallel for num_threads(team_limit) schedule(static) if(team_limit > 1)
+    for (size_t i = 0; i < items.size(); ++i) {
+        if (i == 0) {
+            team = static_cast<unsigned int>(omp_get_num_threads());
+        }
+        func(items[i]);
+    }
+
+    const auto elapsed = std::chrono::steady_clock::now() - start;
+    if (directory_affinity) {
+        leave_in_flight();
+    }
+    record_file_batch(items.size(), team, elapsed);
+}
+
+
+// Helper template for a batch of subdirectories, or of files to hash: each one is an OpenMP task,
+// a subdirectory's task owns its subtree's directories. Inside a walk the tasks join the running
+// team, so idle threads pick up directories at any depth; at the top of a device queue a team of
+// its threads is started.
+template<typename Item, typename Func>
+void process_task_batch(const std::vector<Item>& items,
+                             unsigned int num_threads,
+                             Func func) {
+    if (in_walk_team) {
+        for (size_t i = 0; i < items.size(); ++i) {
+            #pragma omp task default(none) shared(items, func) firstprivate(i)
+            func(items[i]);
+        }
+        // The chunk the items point into is reused once the batch returns
+        #pragma omp taskwait
+        return;
+    }
+
+    #pragma omp parallel num_threads(batch_in_flight(num_threads))
+    {
+        in_walk_team = true;
+        #pragma omp single
+        {
+            for (size_t i = 0; i < items.size(); ++i) {
+                #pragma omp task default(none) shared(items, func) firstprivate(i)
+                func(items[i]);
+            }
+        }
+        in_walk_team = false;
+    }
+}
+
+
+// Extension stuff
+
+// Function to resolve an extension case mode once per run
+ExtensionMode parse_extension_mode(const std::string& case_input) {
+    static const std::unordered_map<std::string, ExtensionMode> modes = {
+        {"lower", ExtensionMode::Lower}, {"upper", ExtensionMode::Upper},
+        {"reverse", ExtensionMode::Reverse}, {"title", ExtensionMode::Title},
+        {"bak", ExtensionMode::Bak}, {"rbak", ExtensionMode::Rbak},
+        {"noext", ExtensionMode::Noext}, {"swap", ExtensionMode::Swap},
+        {"swapr", ExtensionMode::Swapr}
+    };
+    const auto it = modes.find(case_input);
+    return it == modes.end() ? ExtensionMode::None : it->second;
+}
+
+
+// Function to rename the extension of a single file
+void rename_extension_file(const std::string& parent_path, std::string_view file_name, ExtensionMode mode, bool verbose_enabled, ShardedCounter& files_count, bool symlinks, ShardedCounter& skipped_file_count, bool skipped, bool skipped_only) {
+    // Per-thread buffers, full paths are only materialized for syscalls and log lines
+    thread_local std::string item_path;
+    thread_local std::string new_path;
+    thread_local std::string new_extension;
+
+    join_path(item_path, parent_path, file_name);
+
+    // One statx for the symlink check and the metadata filter, -sym links are judged by their target
+    const unsigned int stat_mask = STATX_TYPE | metadata_filter.mask;
+    struct statx stx;
+    if (!statx_path(item_path.c_str(), stat_mask, false, stx)) {
+        return;
+    }
+    const bool is_symlink = S_ISLNK(stx.stx_mode);
+    if (is_symlink && !symlinks) {
+        if (verbose_enabled && skipped) {
+            print_verbose_enabled("\033[0m\033[93mSkipped\033[0m \033[95msymlink_file\033[0m " + item_path + " (excluded)", std::cout);
+        }
+        return;
+    }
+    if (is_symlink && !statx_path(item_path.c_str(), stat_mask, true, stx)) {
+        return;
+    }
+    if (!S_ISREG(stx.stx_mode) || mode == ExtensionMode::None) {
+        return;
+    }
+    if (metadata_filter.checks != 0 && !metadata_filter_matches(metadata_filter, stx)) {
+        ++skipped_file_count;
+        if (verbose_enabled && skipped) {
+            print_verbose_enabled("\033[0m\033[93mSkipped\033[0m file " + item_path + " (filtered out)", std::cout);
+        }
+        return;
+    }
+
+    // Same split as fs::path::extension(): a leading dot starts no extension
+    const size_t dot = file_name.rfind('.');
+    const size_t stem_length = (dot == std::string_view::npos || dot == 0) ? file_name.size() : dot;
+    const std::string_view extension = file_name.substr(stem_length);
+    new_extension.assign(extension);
+
+    switch (mode) {
+        case ExtensionMode::Lower:
+            std::transform(new_extension.begin(), new_extension.end(), new_extension.begin(), ::tolower);
+            break;
+        case ExtensionMode::Upper:
+            std::transform(new_extension.begin(), new_extension.end(), new_extension.begin(), ::toupper);
+            break;
+        case ExtensionMode::Reverse:
+            std::transform(new_extension.begin(), new_extension.end(), new_extension.begin(), [](char c) {
+                return std::islower(c) ? std::toupper(c) : std::tolower(c);
+            });
+            break;
+        case ExtensionMode::Title:
+            new_extension = capitalizeFirstLetter(new_extension);
+            break;
+        case ExtensionMode::Bak:
+            if (extension.length() < 4 || extension.substr(extension.length() - 4) != ".bak") {
+                new_extension += ".bak";
+            }
+            break;
+        case ExtensionMode::Rbak:
+            if (extension.length() >= 4 && extension.substr(extension.length() - 4) == ".bak") {
+                new_extension.resize(extension.length() - 4);
+            }
+            break;
+        case ExtensionMode::Noext:
+            new_extension.clear();
+            break;
+        case ExtensionMode::Swap:
+            new_extension = swap_transform(new_extension);
+            break;
+        case ExtensionMode::Swapr:
+            new_extension = swapr_transform(new_extension);
+            break;
+        case ExtensionMode::None:
+            break;
+    }
+
+    if (new_extension == extension) {
+        ++skipped_file_count;
+        // Print skipped messages
+        if (verbose_enabled && skipped) {
+            if (is_symlink) {
+                print_verbose_enabled("\033[0m\033[93mSkipped\033[0m \033[95msymlink_file\033[0m " + item_path + (extension.empty() ? " (no name change)" : " (name unchanged)"), std::cout);
+            }
+            print_verbose_enabled("\033[0m\033[93mSkipped\033[0m file " + item_path + (extension.empty() ? " (no extension)" : " (extension unchanged)"), std::cout);
+        }
+        return;
+    }
+
+    join_path(new_path, parent_path, file_name.substr(0, stem_length));
+    new_path += new_extension;
+
+    if (!vfs->rename(item_path.c_str(), new_path.c_str(), 0)) {
+        if (errno == EACCES && verbose_enabled) {
+            print_error("\033[1;91mError\033[0m: " + rename_error_message(item_path, new_path, errno) + "\n", std::cerr);
+        }
+        return;
+    }
+
+    files_count.fetch_add(1, std::memory_order_relaxed);
+    note_renamed(parent_path);
+
+    if (verbose_enabled && !skipped_only) {
+        if (is_symlink) {
+            print_verbose_enabled("\033[0m\033[92mRenamed\033[0m \033[95msymlink_file\033[0m " + item_path + "\e[1;38;5;214m -> \033[0m" + new_path, std::cout);
+        } else {
+            print_verbose_enabled("\033[0m\033[92mRenamed\033[0m file " + item_path + "\e[1;38;5;214m -> \033[0m" + new_path, std::cout);
+        }
+    }
+}
+
+
+// Function to rename file extensions in a directory and its subdirectories, scheduled like rename_directory
+void rename_extension_directory(const std::string& directory_path, ExtensionMode mode, bool verbose_enabled, int depth, ShardedCounter& files_count, bool symlinks, ShardedCounter& skipped_file_count, bool skipped, bool skipped_only, unsigned int num_threads, bool one_file_system, dev_t root_dev, ShardedCounter& crossed_mounts_count) {
+    // Wind down after SIGINT/SIGTERM, and skip subtrees an earlier --resume run finished
+    if (interrupt_requested.load(std::memory_order_relaxed) || checkpoint_completed(directory_path)) {
+        return;
+    }
+
+    // Single statx for the symlink check and the device id used by --one-file-system
+    struct statx stx;
+    if (!statx_path(directory_path.c_str(), STATX_TYPE, false, stx)) {
+        return;
+    }
+    if (S_ISLNK(stx.stx_mode)) {
+        if (!symlinks) {
+            if (verbose_enabled && skipped) {
+                print_verbose_enabled("\033[0m\033[93mSkipped\033[0m processing \033[95msymlink_folder\033[0m " + directory_path + " (excluded)", std::cout);
+            }
+            return;
+        }
+        if (!statx_path(directory_path.c_str(), STATX_TYPE, true, stx)) {
+            return;
+        }
+    }
+    if (one_file_system && statx_dev(stx) != root_dev) {
+        crossed_mounts_count.fetch_add(1, std::memory_order_relaxed);
+        if (verbose_enabled && skipped) {
+            print_verbose_enabled("\033[0m\033[93mSkipped\033[0m processing \033[94mfolder\033[0m " + directory_path + " (mount point)", std::cout);
+        }
+        return;
+    }
+
+    if (depth == 0) {
+        return;
+    }
+    const int child_depth = (depth > 0) ? depth - 1 : depth;
+
+    ListingSpool dir_listing;
+    ListingSpool file_listing;
+    const ListingKeys keys = directory_listing_keys(statx_dev(stx));
+    try {
+        list_directory(directory_path, dir_listing, file_listing, keys);
+        if (keys == ListingKeys::Inode) {
+            file_listing.sort();
+            dir_listing.sort();
+        }
+    } catch (const std::exception& ex) {
+        if (verbose_enabled) {
+            print_error("\033[1;91mError processing path\033[0m: " + directory_path + " - " + ex.what(), std::cerr);
+        }
+        return;
+    }
+
+    // Files first, in parallel batches of the per-frame arena
+    PathArena chunk;
+    std::vector<PathArena::Node> batch;
+    file_listing.rewind();
+    while (!interrupt_requested.load(std::memory_order_relaxed) && next_arena_chunk(file_listing, chunk, directory_path, batch, file_batch_size())) {
+        process_file_batch(batch, num_threads,
+            [&](PathArena::Node file) {
+                rename_extension_file(directory_path, chunk.name(file), mode, verbose_enabled, files_count,
+                                      symlinks, skipped_file_count, skipped, skipped_only);
+            });
+    }
+
+    // Then the subdirectories, each one walked by its own task of the batch
+    dir_listing.rewind();
+    while (!interrupt_requested.load(std::memory_order_relaxed) && next_arena_chunk(dir_listing, chunk, directory_path, batch, folder_batch_size())) {
+        process_task_batch(batch, num_threads,
+            [&](PathArena::Node dir) {
+                std::string dir_path;
+                rename_extension_directory(chunk.path(dir, dir_path), mode, verbose_enabled, child_depth,
+                                           files_count, symlinks,
+                                           skipped_file_count, skipped, skipped_only, num_threads,
+                                           one_file_system, root_dev, crossed_mounts_count);
+            });
+    }
+
+    sync_directory(directory_path);
+    checkpoint_finished(directory_path);
+}
+
+
+// Function to search subdirs for file extensions recursively for multiple paths in parallel
+void rename_extension_path(const std::vector<std::string>& paths, const std::string& case_input, bool verbose_enabled, int depth, ShardedCounter& files_count, bool symlinks, ShardedCounter& skipped_file_count, bool skipped, bool skipped_only, bool one_file_system, ShardedCounter& crossed_mounts_count) {
+    // The mode is resolved once, not per file
+    const ExtensionMode mode = parse_extension_mode(case_input);
+
+    // A queue per device walks its paths in turn with the device's share of the threads
+    const std::vector<DeviceQueue> queues = build_device_queues(paths);
+    const int saved_levels = enter_device_queues(queues.size());
+
+    #pragma omp parallel for schedule(dynamic) num_threads(std::min<size_t>(max_threads, queues.size()))
+    for (size_t q = 0; q < queues.size(); ++q) {
+        for (const size_t i : queues[q].paths) {
+            const std::string& current_path = paths[i];
+
+            struct statx stx;
+            if (!statx_path(current_path.c_str(), STATX_TYPE, true, stx)) {
+                continue;
+            }
+
+            if (S_ISDIR(stx.stx_mode)) {
+                // The input path's own device is the boundary for --one-file-system
+                rename_extension_directory(current_path, mode, verbose_enabled, depth, files_count,
+                                           symlinks, skipped_file_count, skipped, skipped_only,
+                                           queues[q].threads, one_file_system, statx_dev(stx), crossed_mounts_count);
+            } else if (S_ISREG(stx.stx_mode) && depth != 0) {
+                const fs::path file_path(current_path);
+                rename_extension_file(file_path.parent_path().native(), file_path.filename().native(), mode, verbose_enabled,
+                                      files_count, symlinks, skipped_file_count, skipped, skipped_only);
+            }
+        }
+    }
+    omp_set_max_active_levels(saved_levels);
+}
+
+
+// Rename file&directory stuff
+
+// Function to build the message fs::rename would have thrown for a failed rename
+std::string rename_error_message(const std::string& old_path, const std::string& new_path, int error) {
+    return "filesystem error: cannot rename: " + std::error_code(error, std::generic_category()).message() + " [" + old_path + "] [" + new_path + "]";
+}
+
+
+// exif: photos of one second a burst may hold, each takes the next free _N
+static constexpr unsigned exif_same_second_limit = 1000;
+
+
+// Function to rename files
+void rename_file(const std::string& parent_path, std::string_view file_name, const std::string& case_input, bool verbose_enabled, bool transform_files, ShardedCounter& files_count, bool symlinks, ShardedCounter& skipped_file_count, bool skipped, bool skipped_only, size_t sequence_position, const std::string* content_name) {
+    // Per-thread buffers, full paths are only materialized for syscalls and log lines
+    thread_local std::string item_path;
+    thread_local std::string new_path;
+    thread_local std::string new_name;
+
+    join_path(item_path, parent_path, file_name);
+
+    // One statx replaces the symlink and regular file checks, -sym links need their target too.
+    // date:mtime/date:btime and templates dating by {mtime}/{btime} only add their timestamp bit,
+    // the metadata filter the fields of its predicates.
+    const bool templated = transform_files && case_input == "template";
+    const unsigned int date_mask = transform_files ? (templated ? name_template.date_mask : date_stamp_mask(case_input)) : 0;
+    const unsigned int stat_mask = STATX_TYPE | date_mask | (transform_files ? metadata_filter.mask : 0);
+    struct statx stx;
+    const bool have_stat = statx_path(item_path.c_str(), stat_mask, false, stx);
+    const bool is_symlink = have_stat && S_ISLNK(stx.stx_mode);
+    bool is_regular = have_stat && S_ISREG(stx.stx_mode);
+    if (is_symlink && symlinks) {
+        is_regular = statx_path(item_path.c_str(), stat_mask, true, stx) && S_ISREG(stx.stx_mode);
+    }
+
+    if ((is_symlink && !symlinks) || !is_regular) {
+        // Non-regular, non-directory item (e.g. device file, socket): skip as file
+        ++skipped_file_count;
+        if (verbose_enabled && transform_files && !symlinks && skipped) {
+            print_verbose_enabled("\033[0m\033[93mSkipped\033[0m \033[95msymlink_file\033[0m " + item_path + " (excluded)", std::cout);
+        }
+        return;
+    }
+
+    // Filtered files are left out before any content is read for them
+    if (transform_files && metadata_filter.checks != 0 && !metadata_filter_matches(metadata_filter, stx)) {
+        ++skipped_file_count;
+        if (verbose_enabled && skipped) {
+            print_verbose_enabled("\033[0m\033[93mSkipped\033[0m file " + item_path + " (filtered out)", std::cout);
+        }
+        return;
+    }
+
+    new_name.assign(file_name);
+    const ContentHash hash_kind = transform_files ? content_hash_kind(case_input) : ContentHash::None;
+    const bool exif_dates = transform_files && case_input == "exif";
+    const PluginMode* plugin_mode = transform_files ? find_plugin_mode(case_input) : nullptr;
+
+    // Perform transformations on file names if requested
+    if (transform_files) {
+        if (hash_kind != ContentHash::None) {
+            // Directory walks hash their files on the worker pool beforehand, lone files here
+            const bool hashed = content_name ? !content_name->empty() : content_hash_name(item_path, file_name, hash_kind, new_name);
+            if (!hashed) {
+                print_error("\033[1;91mError\033[0m: cannot read " + item_path + (content_name ? std::string() : std::string(": ") + std::strerror(errno)), std::cerr);
+                ++skipped_file_count;
+                return;
+            }
+            if (content_name) {
+                new_name = *content_name;
+            }
+        } else if (exif_dates) {
+            // Same as the hashes: read on the worker pool during directory walks
+            const bool dated = content_name ? !content_name->empty() : exif_date_name(item_path, file_name, new_name);
+            if (!dated) {
+                ++skipped_file_count;
+                if (verbose_enabled && skipped) {
+                    print_verbose_enabled("\033[0m\033[93mSkipped\033[0m file " + item_path + " (no EXIF date)", std::cout);
+                }
+                return;
+            }
+            if (content_name) {
+                new_name = *content_name;
+            }
+        } else if (templated) {
+            // Directory walks pass the rank from their sorted listing, a lone file is the first
+            std::string_view parent_name(parent_path);
+            while (parent_name.size() > 1 && parent_name.back() == '/') {
+                parent_name.remove_suffix(1);
+            }
+            parent_name.remove_prefix(std::min(parent_name.size(), parent_name.rfind('/') + 1));
+            if (!render_name_template(name_template, file_name, parent_name, std::max<size_t>(sequence_position, 1), stx, new_name)) {
+                ++skipped_file_count;
+                if (verbose_enabled && skipped) {
+                    print_verbose_enabled("\033[0m\033[93mSkipped\033[0m file " + item_path + " (no name from template)", std::cout);
+                }
+                return;
+            }
+        } else if (case_input == "sequence") {
+            // Directory walks pass the rank from their sorted listing, lone files look it up
+            if (sequence_position > 0) {
+                new_name = format_numbered_prefix(sequence_position, strip_numbered_prefix(new_name));
+            } else {
+                new_name = append_numbered_prefix(parent_path, new_name);
+            }
+        } else if (date_mask != 0) {
+            char date_stamp[8];
+            if (!stat_date_stamp(stx, date_mask, date_stamp)) {
+                ++skipped_file_count;
+                if (verbose_enabled && skipped) {
+                    print_verbose_enabled("\033[0m\033[93mSkipped\033[0m file " + item_path + " (no birth time)", std::cout);
+                }
+                return;
+            }
+            new_name = append_date_seq(new_name, std::string_view(date_stamp, sizeof(date_stamp)));
+        } else if (plugin_mode) {
+            // Directory walks hand the plugin a chunk of names in one call beforehand
+            if (!content_name) {
+                plugin_transform(*plugin_mode, new_name, true);
+            } else if (!content_name->empty()) {
+                new_name = *content_name;
+            }
+        } else {
+            cached_transform(name_transform(case_input), new_name, true);
+        }
+    }
+
+    // Check if the name is unchanged and skip if necessary
+    const auto skip_unchanged = [&]() {
+        if (transform_files) {
+            ++skipped_file_count;
+            if (verbose_enabled && skipped) {
+                print_verbose_enabled("\033[0m\033[93mSkipped\033[0m file " + item_path + " (name unchanged)", std::cout);
+            }
+        }
+    };
+    if (new_name == file_name) {
+        skip_unchanged();
+        return;
+    }
+
+    join_path(new_path, parent_path, new_name);
+
+    // Content names never replace a file: the one there has the same digest, the same content.
+    // Duplicates are always reported, finding them is what the mode is used for. Neither do
+    // capture times and templates, several files may well map to one name.
+    const bool no_replace = hash_kind != ContentHash::None || exif_dates || templated;
+    bool renamed = vfs->rename(item_path.c_str(), new_path.c_str(), no_replace ? RENAME_NOREPLACE : 0);
+
+    // Photos of the same second share their capture time, the later ones are numbered _1, _2, ...
+    // A rerun walks the same numbers and stops at the name the photo already has.
+    if (exif_dates && !renamed && errno == EEXIST) {
+        const std::string capture_name = new_name;
+        for (unsigned n = 1; !renamed && errno == EEXIST && n < exif_same_second_limit; ++n) {
+            new_name = exif_numbered_name(capture_name, n);
+            if (new_name == file_name) {
+                skip_unchanged();
+                return;
+            }
+            join_path(new_path, parent_path, new_name);
+            renamed = vfs->rename(item_path.c_str(), new_path.c_str(), RENAME_NOREPLACE);
+        }
+    }
+    if (!renamed && hash_kind != ContentHash::None && errno == EEXIST) {
+        ++skipped_file_count;
+        content_duplicates.fetch_add(1);
+        print_verbose_enabled("\033[0m\033[93mSkipped\033[0m file " + item_path + " (duplicate of " + new_path + ")", std::cout);
+        return;
+    }
+    if (!renamed && templated && errno == EEXIST) {
+        ++skipped_file_count;
+        if (verbose_enabled && skipped) {
+            print_verbose_enabled("\033[0m\033[93mSkipped\033[0m file " + item_path + " (" + new_path + " exists)", std::cout);
+        }
+        return;
+    }
+
+    if (!renamed) {
+        if (errno == EACCES && verbose_enabled) {
+            print_error("\033[1;91mError\033[0m: " + rename_error_message(item_path, new_path, errno) + "\n", std::cerr);
+        }
+        return;
+    }
+
+    if (verbose_enabled && !skipped_only) {
+        if (is_symlink) {
+            print_verbose_enabled("\033[0m\033[92mRenamed\033[0m \033[95msymlink_file\033[0m " + item_path + "\e[1;38;5;214m -> \033[0m" + new_path, std::cout);
+        } else {
+            print_verbose_enabled("\033[0m\033[92mRenamed\033[0m file " + item_path + "\e[1;38;5;214m -> \033[0m" + new_path, std::cout);
+        }
+    }
+
+    files_count.fetch_add(1, std::memory_order_relaxed);
+    note_renamed(parent_path);
+}
+
+
+// Function to rename a directory based on specified transformations
+void rename_directory(const fs::path& directory_path, const std::string& case_input, bool rename_parents, bool verbose_enabled, bool transform_dirs, bool transform_files, ShardedCounter& files_count, ShardedCounter& dirs_count, int depth, bool symlinks, ShardedCounter& skipped_file_count, ShardedCounter& skipped_folder_count, ShardedCounter& skipped_folder_special_count, bool skipped, bool skipped_only, std::atomic<bool>& isFirstRun, std::atomic<bool>& special, unsigned int thread_budget, bool one_file_system, dev_t root_dev, ShardedCounter& crossed_mounts_count) {
+    // Wind down after SIGINT/SIGTERM, and skip subtrees an earlier --resume run finished
+    if (interrupt_requested.load(std::memory_order_relaxed) || checkpoint_completed(directory_path.native())) {
+        return;
+    }
+
+    std::string dirname = directory_path.filename().string();
+    std::string new_dirname = dirname;
+
+    // The threads of the device queue this directory was reached from
+    const unsigned int num_threads = thread_budget;
+
+    // Single statx for the symlink check, the device id used by --one-file-system and the
+    // timestamp of date:mtime/date:btime, a followed symlink is dated by its target
+    const unsigned int date_mask = transform_dirs ? date_stamp_mask(case_input) : 0;
+    struct statx stx;
+    const bool have_stat = statx_path(directory_path.c_str(), STATX_TYPE | date_mask, false, stx);
+    const bool is_symlink = have_stat && S_ISLNK(stx.stx_mode);
+    char date_stamp[8];
+    bool have_date_stamp = false;
+    if (date_mask != 0) {
+        struct statx date_stx;
+        have_date_stamp = is_symlink ? statx_path(directory_path.c_str(), date_mask, true, date_stx) && stat_date_stamp(date_stx, date_mask, date_stamp)
+                                     : have_stat && stat_date_stamp(stx, date_mask, date_stamp);
+    }
+
+    // Early exit if the directory is a symlink and should not be transformed
+    if (is_symlink && !symlinks) {
+        if (transform_dirs) {
+            skipped_folder_count.fetch_add(1, std::memory_order_relaxed);
+        }
+        if (verbose_enabled && skipped) {
+            print_verbose_enabled("\033[0m\033[93mSkipped\033[0m processing \033[95msymlink_folder\033[0m " + directory_path.string() + " (excluded)", std::cout);
+        }
+        return;
+    }
+
+    // Stop at mount boundaries, a followed symlink is judged by the device of its target
+    if (one_file_system && have_stat) {
+        if (is_symlink && !statx_path(directory_path.c_str(), STATX_TYPE, true, stx)) {
+            return;
+        }
+        if (statx_dev(stx) != root_dev) {
+            crossed_mounts_count.fetch_add(1, std::memory_order_relaxed);
+            if (verbose_enabled && skipped) {
+                print_verbose_enabled("\033[0m\033[93mSkipped\033[0m processing \033[94mfolder\033[0m " + directory_path.string() + " (mount point)", std::cout);
+            }
+            return;
+        }
+    }
+
+    // Apply transformations to the directory name if required
+    if (transform_dirs) {
+        if (case_input == "sequence") {
+            special = true;
+            rename_folders_with_sequential_numbering(directory_path, "", dirs_count, skipped_folder_special_count, depth, verbose_enabled, skipped, skipped_only, symlinks, num_threads, one_file_system, root_dev);
+        } else if (date_mask != 0) {
+            // Without a birth time the folder keeps its name
+            if (have_date_stamp) {
+                new_dirname = append_date_suffix_to_folder_name(dirname, std::string_view(date_stamp, sizeof(date_stamp)));
+            }
+        } else if (const PluginMode* plugin_mode = find_plugin_mode(case_input)) {
+            plugin_transform(*plugin_mode, new_dirname, false);
+        } else {
+            cached_transform(name_transform(case_input), new_dirname, false);
+        }
+    }
+
+    fs::path new_path = directory_path.parent_path() / new_dirname;
+
+    if (directory_path == new_path && transform_dirs && !special) {
+        skipped_folder_count.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // Check if renaming is necessary
+    if (directory_path != new_path) {
+        if (!vfs->rename(directory_path.c_str(), new_path.c_str(), 0)) {
+            if (errno == EACCES && verbose_enabled) {
+                print_error("\033[1;91mError\033[0m: Permission denied: " + directory_path.string(), std::cout);
+            }
+            return;
+        }
+        note_renamed(directory_path.parent_path().native());
+        if (verbose_enabled && !skipped_only) {
+            if (is_symlink && symlinks && !special) {
+                print_verbose_enabled("\033[0m\033[92mRenamed \033[95msymlink_folder\033[0m " + directory_path.string() + "\e[1;38;5;214m -> \033[0m" + new_path.string(), std::cout);
+            } else {
+                print_verbose_enabled("\033[0m\033[92mRenamed \033[94mfolder\033[0m " + directory_path.string() + "\e[1;38;5;214m -> \033[0m" + new_path.string(), std::cout);
+            }
+        }
+        dirs_count.fetch_add(1, std::memory_order_relaxed);
+    } else {
+        if (verbose_enabled && is_symlink && !transform_files && skipped && !special) {
+            print_verbose_enabled("\033[0m\033[93mSkipped\033[0m\033[95m symlink_folder\033[0m " + directory_path.string() + " (name unchanged)", std::cout);
+        } else if (verbose_enabled && is_symlink && transform_dirs && transform_files && !special && skipped) {
+            print_verbose_enabled("\033[0m\033[93mSkipped\033[0m\033[95m symlink_folder\033[0m " + directory_path.string() + " (name unchanged)", std::cout);
+        }
+        if (!rename_parents && isFirstRun) {
+            // First-run root path: do not print skipped for the root itself
+        } else {
+            if (verbose_enabled && !transform_files && skipped && !special) {
+                print_verbose_enabled("\033[0m\033[93mSkipped\033[0m\033[94m folder\033[0m " + directory_path.string() + " (name unchanged)", std::cout);
+            } else if (verbose_enabled && transform_dirs && transform_files && !special && skipped) {
+                print_verbose_enabled("\033[0m\033[93mSkipped\033[0m\033[94m folder\033[0m " + directory_path.string() + " (name unchanged)", std::cout);
+            }
+        }
+    }
+
+    if (isFirstRun) {
+        isFirstRun = false;
+    }
+
+    // Process directory contents
+    if (depth != 0) {
+            int child_depth = (depth > 0) ? depth - 1 : depth;
+
+        // Compact listings that spill to disk past --max-memory, full paths only exist per chunk
+        ListingSpool dir_listing;
+        ListingSpool file_listing;
+        const bool template_numbers = transform_files && case_input == "template" && name_template.uses_sequence;
+        const bool sequence_files = (transform_files && case_input == "sequence") || template_numbers;
+        const ListingKeys keys = sequence_files ? (template_numbers ? ListingKeys::Natural : ListingKeys::Unnumbered)
+                                                : (have_stat ? directory_listing_keys(statx_dev(stx)) : ListingKeys::None);
+        // An unreadable folder keeps its rename and is left out of the walk, an exception
+        // would not get out of the worker's task
+        try {
+            list_directory(new_path, dir_listing, file_listing, keys);
+            if (keys == ListingKeys::Inode) {
+                dir_listing.sort();
+            }
+        } catch (const std::exception& ex) {
+            if (verbose_enabled) {
+                print_error("\033[1;91mError processing path\033[0m: " + new_path.string() + " - " + ex.what(), std::cerr);
+            }
+            return;
+        }
+
+        // In-flight children live in a per-frame arena: this directory as the root node plus a
+        // name slice per child, reused across chunks so the walk barely touches the allocator
+        const std::string& parent_path = new_path.native();
+        PathArena chunk;
+        std::vector<PathArena::Node> dir_batch;
+
+        // Parallel directory processing, also for -cp: this directory was renamed above before
+        // it was listed, so every child subtree starts from its final parent path
+        dir_listing.rewind();
+        while (!interrupt_requested.load(std::memory_order_relaxed) && next_arena_chunk(dir_listing, chunk, parent_path, dir_batch, folder_batch_size())) {
+            process_task_batch(dir_batch, num_threads,
+                [&](PathArena::Node dir) {
+                    std::string dir_path;
+                    rename_directory(chunk.path(dir, dir_path), case_input, false, verbose_enabled,
+                                   transform_dirs, transform_files, files_count, dirs_count,
+                                   child_depth, symlinks,
+                                   skipped_file_count, skipped_folder_count,
+                                   skipped_folder_special_count, skipped, skipped_only,
+                                   isFirstRun, special, num_threads, one_file_system, root_dev,
+                                   crossed_mounts_count);
+                });
+        }
+
+        // Sequence numbering ranks the files by their unnumbered name, a spinning disk gets them
+        // in inode order (external sort when spilled)
+        if (keys != ListingKeys::None) {
+            file_listing.sort();
+        }
+
+        // Parallel file processing
+        std::vector<PathArena::Node> file_batch;
+        std::vector<unsigned char> file_types;
+        std::vector<size_t> sequence_positions;
+        std::vector<unsigned char> sequence_kept;
+        size_t sequence_position = 0;
+        const ContentHash hash_kind = transform_files ? content_hash_kind(case_input) : ContentHash::None;
+        const bool exif_dates = transform_files && case_input == "exif";
+        const PluginMode* plugin_mode = transform_files ? find_plugin_mode(case_input) : nullptr;
+        const bool content_mode = hash_kind != ContentHash::None || exif_dates || plugin_mode;
+        std::vector<std::string> content_names;
+        std::vector<PathArena::Node> hash_batch;
+        std::vector<std::string_view> plugin_batch;
+        std::vector<std::string> plugin_names;
+        file_listing.rewind();
+        while (!interrupt_requested.load(std::memory_order_relaxed) && next_arena_chunk(file_listing, chunk, parent_path, file_batch, file_batch_size(), &file_types)) {
+            // Ranks follow the sorted listing order and are indexed by node, only regular files are
+            // numbered. With a metadata filter only the files it keeps are, rename_file skips the
+            // others: their statx is taken on the worker pool first, like the content hashes.
+            if (sequence_files) {
+                sequence_positions.assign(chunk.size(), 0);
+                hash_batch.clear();
+                for (size_t i = 0; i < file_batch.size(); ++i) {
+                    if (file_types[i] == DT_REG) {
+                        hash_batch.push_back(file_batch[i]);
+                    }
+                }
+                const bool filtered = metadata_filter.checks != 0;
+                if (filtered) {
+                    sequence_kept.assign(chunk.size(), 0);
+                    process_task_batch(hash_batch, num_threads,
+                        [&](PathArena::Node file) {
+                            std::string file_path;
+                            chunk.path(file, file_path);
+                            struct statx file_stx;
+                            sequence_kept[file] = statx_path(file_path.c_str(), STATX_TYPE | metadata_filter.mask, symlinks, file_stx) &&
+                                                  S_ISREG(file_stx.stx_mode) && metadata_filter_matches(metadata_filter, file_stx);
+                        });
+                }
+                for (const PathArena::Node file : hash_batch) {
+                    if (!filtered || sequence_kept[file]) {
+                        sequence_positions[file] = ++sequence_position;
+                    }
+                }
+            }
+            // Plugin modes get the chunk's names in one call, the plugin amortizes it over the batch
+            if (plugin_mode) {
+                plugin_batch.clear();
+                for (const PathArena::Node file : file_batch) {
+                    plugin_batch.push_back(chunk.name(file));
+                }
+                plugin_transform_batch(*plugin_mode, plugin_batch, true, plugin_names);
+                content_names.assign(chunk.size(), std::string());
+                for (size_t i = 0; i < file_batch.size(); ++i) {
+                    content_names[file_batch[i]] = std::move(plugin_names[i]);
+                }
+            }
+            // Content names are read and hashed (or their EXIF header parsed) on the worker pool,
+            // the renames stay with this worker
+            if (hash_kind != ContentHash::None || exif_dates) {
+                content_names.assign(chunk.size(), std::string());
+                hash_batch.clear();
+                for (size_t i = 0; i < file_batch.size(); ++i) {
+                    if (file_types[i] == DT_REG) {
+                        hash_batch.push_back(file_batch[i]);
+                    }
+                }
+                process_task_batch(hash_batch, num_threads,
+                    [&](PathArena::Node file) {
+                        std::string file_path;
+                        chunk.path(file, file_path);
+                        // A file the metadata filter leaves out is not worth reading, and neither is a
+                        // symlink without -sym: the listing's type is its target's, which may lie
+                        // outside the tree. rename_file skips both.
+                        const unsigned int stat_mask = metadata_filter.mask | (symlinks ? 0 : STATX_TYPE);
+                        struct statx file_stx;
+                        if (stat_mask != 0 && (!statx_path(file_path.c_str(), stat_mask, symlinks, file_stx) ||
+                                               (!symlinks && S_ISLNK(file_stx.stx_mode)) ||
+                                               (metadata_filter.checks != 0 && !metadata_filter_matches(metadata_filter, file_stx)))) {
+                            return;
+                        }
+                        if (exif_dates) {
+                            exif_date_name(file_path, chunk.name(file), content_names[file]);
+                        } else {
+                            content_hash_name(file_path, chunk.name(file), hash_kind, content_names[file]);
+                        }
+                    });
+            }
+            process_file_batch(file_batch, num_threads,
+                [&](PathArena::Node file) {
+                    rename_file(parent_path, chunk.name(file), case_input, verbose_enabled,
+                              transform_files, files_count, symlinks, skipped_file_count,
+                              skipped, skipped_only, sequence_files ? sequence_positions[file] : 0,
+                              content_mode ? &content_names[file] : nullptr);
+                });
+        }
+
+        sync_directory(parent_path);
+        checkpoint_finished(parent_path);
+        // Under the name it was reached by too, in case its rename did not reach the disk. With
+        // a resumable mode no other folder can take that name: it would have been left as is.
+        if (directory_path != new_path) {
+            checkpoint_finished(directory_path.native());
+        }
+    }
+}
+
+
+// Function to rename paths (directories and files) based on specified transformations
+void rename_path(const std::vector<std::string>& paths, const std::string& case_input, bool rename_parents, bool verbose_enabled, bool transform_dirs, bool transform_files, std::atomic<int>& depth, ShardedCounter& files_count, ShardedCounter& dirs_count, bool symlinks, ShardedCounter& skipped_file_count, ShardedCounter& skipped_folder_count, ShardedCounter& skipped_folder_special_count, bool skipped, bool skipped_only, std::atomic<bool>& isFirstRun, std::atomic<bool>& special, bool one_file_system, ShardedCounter& crossed_mounts_count) {
+    // A queue per device walks its paths in turn with the device's share of the threads: a
+    // spinning disk is not hammered by every thread, several disks are walked side by side.
+    // A single queue is a team of one, not an active parallel level, so its per-directory
+    // batches in rename_directory (-c and -cp) stay parallel.
+    const std::vector<DeviceQueue> queues = build_device_queues(paths);
+    const int saved_levels = enter_device_queues(queues.size());
+
+    #pragma omp parallel for schedule(dynamic) num_threads(std::min<size_t>(max_threads, queues.size())) default(none) \
+        shared(paths, queues, case_input, rename_parents, verbose_enabled, transform_dirs, \
+               transform_files, depth, files_count, dirs_count, symlinks, \
+               skipped_file_count, skipped_folder_count, \
+               skipped_folder_special_count, skipped, skipped_only, isFirstRun, \
+               special, one_file_system, crossed_mounts_count)
+    for (size_t q = 0; q < queues.size(); ++q) {
+        for (const size_t i : queues[q].paths) {
+            // its own independent path, so the final value (false) is correct once
+            // all paths have started. For single-path use this is straightforward.
+            isFirstRun = true;
+
+            fs::path current_path(paths[i]);
+
+            // Record the device of the input path, the walk never leaves it with --one-file-system
+            dev_t root_dev = 0;
+            struct statx root_stx;
+            if (one_file_system && statx_path(current_path.c_str(), STATX_TYPE, true, root_stx)) {
+                root_dev = statx_dev(root_stx);
+            }
+
+            // Followed like fs::is_directory does, a symlinked input path is walked
+            struct statx path_stx;
+            if (statx_path(current_path.c_str(), STATX_TYPE, true, path_stx)) {
+                if (S_ISDIR(path_stx.stx_mode)) {
+                    if (rename_parents) {
+                        fs::path immediate_parent_path = current_path.parent_path();
+                        rename_directory(immediate_parent_path, case_input, rename_parents, verbose_enabled, transform_dirs, transform_files, files_count, dirs_count, depth, symlinks, skipped_file_count, skipped_folder_count, skipped_folder_special_count, skipped, skipped_only, isFirstRun, special, queues[q].threads, one_file_system, root_dev, crossed_mounts_count);
+                    } else {
+                        rename_directory(current_path, case_input, rename_parents, verbose_enabled, transform_dirs, transform_files, files_count, dirs_count, depth, symlinks, skipped_file_count, skipped_folder_count, skipped_folder_special_count, skipped, skipped_only, isFirstRun, special, queues[q].threads, one_file_system, root_dev, crossed_mounts_count);
+                    }
+                } else if (S_ISREG(path_stx.stx_mode)) {
+                    rename_file(current_path.parent_path().native(), current_path.filename().native(), case_input, verbose_enabled, transform_files, files_count, symlinks, skipped_file_count, skipped, skipped_only);
+                }
+            }
+        }
+    }
+    omp_set_max_active_levels(saved_levels);
+}
+
+
+// Library API
+
+RenameEngine::RenameEngine(RenameOptions options) : options_(std::move(options)) {}
+
+
+void RenameEngine::set_event_callback(RenameEventCallback callback) {
+    callback_ = std::move(callback);
+}
+
+
+bool RenameEngine::valid_case_mode(const std::string& case_mode, RenameScope scope) {
+    static const std::unordered_set<std::string> extension_modes = {
+        "lower", "upper", "reverse", "title", "swap", "swapr", "rbak", "bak", "noext"
+    };
+    static const std::unordered_set<std::string> name_modes = {
+        "lower", "upper", "reverse", "title", "date", "date:mtime", "date:btime", "swap", "swapr", "rdate",
+        "pascal", "rpascal", "camel", "sentence", "rcamel", "kebab", "rkebab",
+        "rsnake", "snake", "rnumeric", "rspecial", "rbra", "roperand",
+        "sequence", "rsequence", "hash", "hash:sha256", "exif"
+    };
+    if (scope == RenameScope::Extensions) {
+        return extension_modes.count(case_mode) != 0;
+    }
+    // Lowest-parent runs rename the input folders one by one, sequence needs their siblings
+    return (name_modes.count(case_mode) != 0 || find_plugin_mode(case_mode)) && !(scope == RenameScope::LowestParents && case_mode == "sequence");
+}
+
+
+bool RenameEngine::load_plugin(const std::string& path, std::string& error) {
+    return load_transform_plugins(path, error);
+}
+
+
+void RenameEngine::cancel() {
+    interrupt_requested.store(true);
+}
+
+
+// Jobs are serialized because the walkers share process-wide settings
+static std::mutex run_mutex;
+
+
+// Function to run one job
+RenameResult RenameEngine::run(const std::vector<std::string>& paths) {
+    std::lock_guard<std::mutex> run_lock(run_mutex);
+
+    RenameResult result;
+    result.input_paths = paths.size();
+    // A template replaces the case mode, the walkers dispatch on "template"
+    const bool templated = !options_.name_template.empty();
+    const std::string case_mode = templated ? "template" : options_.case_mode;
+    if (templated) {
+        if (options_.scope == RenameScope::Extensions) {
+            result.error = "Templates rename names, not extensions";
+            return result;
+        }
+        if (!compile_name_template(options_.name_template, name_template, result.error)) {
+            return result;
+        }
+    } else if (!valid_case_mode(options_.case_mode, options_.scope)) {
+        result.error = "Unspecified or invalid case mode - " + options_.case_mode;
+        return result;
+    }
+
+    // Process-wide settings of this job
+    static const unsigned int all_threads = max_threads;
+    max_threads = options_.threads > 0 ? options_.threads : all_threads;
+    max_memory = options_.max_memory;
+    directory_affinity = options_.directory_affinity;
+    vfs = options_.vfs ? options_.vfs : &posix_vfs();
+    reset_date_stamps();
+    metadata_filter = compile_metadata_filter(options_.filter);
+    const long duplicates_before = content_duplicates.load();
+
+    // Checkpoints are bound to the mode, filters and depth of the run that wrote them
+    if (!options_.checkpoint_path.empty()) {
+        if (templated || !resumable_mode(options_.case_mode, options_.scope == RenameScope::Extensions)) {
+            result.error = "--resume cannot take " + std::string(templated ? "a template" : "mode " + options_.case_mode) +
+                           ": a folder the interrupt caught midway is walked again, and its renamed entries would change twice.";
+            vfs = &posix_vfs();
+            return result;
+        }
+        const char* scope_flag = options_.scope == RenameScope::Extensions ? "-ce " : (options_.scope == RenameScope::LowestParents ? "-cp " : "-c ");
+        // --newer/--older are left out, an age like 24h moves with the clock between the runs
+        const RenameFilter& filter = options_.filter;
+        std::string metadata_settings;
+        if (filter.min_size > 0) metadata_settings += " --min-size " + std::to_string(filter.min_size);
+        if (filter.max_size != UINT64_MAX) metadata_settings += " --max-size " + std::to_string(filter.max_size);
+        if (filter.uid >= 0) metadata_settings += " --uid " + std::to_string(filter.uid);
+        if (filter.gid >= 0) metadata_settings += " --gid " + std::to_string(filter.gid);
+        const std::string run_settings = (templated ? "-t " + options_.name_template : scope_flag + options_.case_mode) +
+                                         (options_.rename_folders ? "" : " -fi") + (options_.rename_files ? "" : " -fo") +
+                                         (options_.follow_symlinks ? " -sym" : "") + " -d " + std::to_string(options_.depth) + metadata_settings;
+        if (!open_checkpoint(options_.checkpoint_path, run_settings, result.error)) {
+            vfs = &posix_vfs();
+            return result;
+        }
+    }
+
+    ShardedCounter files_count;
+    ShardedCounter dirs_count;
+    ShardedCounter skipped_file_count;
+    ShardedCounter skipped_folder_count;
+    ShardedCounter skipped_folder_special_count;
+    ShardedCounter crossed_mounts_count;
+    std::atomic<int> depth{options_.depth};
+    std::atomic<bool> isFirstRun{true};
+    std::atomic<bool> special{false};
+
+    const bool verbose_enabled = options_.report_renamed || options_.report_skipped;
+    const bool skipped = options_.report_skipped;
+    const bool skipped_only = options_.report_skipped && !options_.report_renamed;
+    {
+        std::lock_guard<std::mutex> lock(print_mutex);
+        event_callback = callback_;
+    }
+
+    begin_durability(options_.durability);
+    begin_batch_control(options_.batch_size_files, options_.batch_size_folders, options_.in_flight);
+    begin_transform_cache();
+
+    if (options_.progress) {
+        start_progress(paths, files_count, dirs_count, skipped_file_count, skipped_folder_count, skipped_folder_special_count);
+    }
+
+    auto start_time = std::chrono::steady_clock::now();
+    if (options_.scope == RenameScope::Extensions) {
+        rename_extension_path(paths, case_mode, verbose_enabled, options_.depth, files_count, options_.follow_symlinks, skipped_file_count, skipped, skipped_only, options_.one_file_system, crossed_mounts_count);
+    } else {
+        rename_path(paths, case_mode, options_.scope == RenameScope::LowestParents, verbose_enabled, options_.rename_folders, options_.rename_files, depth, files_count, dirs_count, options_.follow_symlinks, skipped_file_count, skipped_folder_count, skipped_folder_special_count, skipped, skipped_only, isFirstRun, special, options_.one_file_system, crossed_mounts_count);
+    }
+    // The renames are made durable before the checkpoint is closed, the sync time counts
+    end_durability(result.directories_synced, result.filesystems_synced);
+    auto end_time = std::chrono::steady_clock::now();
+
+    end_batch_control(result.batch_size_files, result.batch_size_folders, result.in_flight, result.adaptive_batches);
+    end_transform_cache(result.transform_cache_hits, result.transform_cache_lookups, result.transform_cache_off);
+
+    stop_progress();
+    close_checkpoint();
+    // The backend belongs to the caller and may go away with it
+    vfs = &posix_vfs();
+    {
+        std::lock_guard<std::mutex> lock(print_mutex);
+        event_callback = nullptr;
+    }
+
+    result.files_renamed = files_count.load();
+    result.folders_renamed = dirs_count.load();
+    result.files_skipped = skipped_file_count.load();
+    result.folders_skipped = special ? skipped_folder_special_count.load() : skipped_folder_count.load();
+    result.mounts_not_crossed = crossed_mounts_count.load();
+    result.duplicates = content_duplicates.load() - duplicates_before;
+    result.elapsed_seconds = std::chrono::duration<double>(end_time - start_time).count();
+    result.interrupted = interrupt_requested.exchange(false);
+    return result;
+}
+
+
+// Function to run one archive job, it takes the job slot and the event callback like run()
+RenameResult RenameEngine::run_archive(const std::string& input, const std::string& output) {
+    std::lock_guard<std::mutex> run_lock(run_mutex);
+
+    RenameResult result;
+    result.input_paths = 1;
+    reset_date_stamps();
+    {
+        std::lock_guard<std::mutex> lock(print_mutex);
+        event_callback = callback_;
+    }
+
+    begin_transform_cache();
+    const auto start_time = std::chrono::steady_clock::now();
+    rename_archive(input, output, options_, result);
+    end_transform_cache(result.transform_cache_hits, result.transform_cache_lookups, result.transform_cache_off);
+    result.elapsed_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+    result.interrupted = interrupt_requested.exchange(false);
+
+    {
+        std::lock_guard<std::mutex> lock(print_mutex);
+        event_callback = nullptr;
+    }
+    return result;
+}
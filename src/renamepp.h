@@ -0,0 +1,136 @@
+// SPDX-License-Identifier: GNU General Public License v3.0 or later
+
+// librenamepp: the bulk_rename++ engine for in-process use
+
+#ifndef RENAMEPP_H
+#define RENAMEPP_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+class Vfs;
+
+// What a run renames, the CLI's -c, -cp and -ce
+enum class RenameScope {
+    Names,          // files and folders below the input paths (-c)
+    LowestParents,  // like Names, but the input folders themselves too (-cp)
+    Extensions      // file extensions only (-ce)
+};
+
+// How far a run goes to make its renames survive a crash or power loss
+enum class RenameDurability : unsigned char {
+    None,   // leave it to the kernel's writeback
+    Dirs,   // fsync every directory with renamed entries once its walk finished
+    Fs      // syncfs every touched filesystem once at the end
+};
+
+// Metadata predicates of the files a run renames, all that are set must hold. Folders are walked
+// and renamed as without them. The defaults let every file through.
+struct RenameFilter {
+    int64_t newer_than = INT64_MIN;       // --newer: mtime at or after, seconds since the epoch
+    int64_t older_than = INT64_MAX;       // --older: mtime before
+    uint64_t min_size = 0;                // --min-size in bytes
+    uint64_t max_size = UINT64_MAX;       // --max-size in bytes
+    int64_t uid = -1;                     // --uid owner, -1 for any
+    int64_t gid = -1;                     // --gid group, -1 for any
+};
+
+// Settings of a single run, the defaults match a plain CLI invocation
+struct RenameOptions {
+    std::string case_mode;                // lower, upper, sequence, date:mtime, hash, ... (bak, rbak, noext for Extensions)
+    std::string name_template;            // -t, e.g. {parent}_{seq:04}_{stem|lower}.{ext|lower}; replaces case_mode, files only
+    RenameScope scope = RenameScope::Names;
+    bool rename_folders = true;           // false is -fi
+    bool rename_files = true;             // false is -fo
+    int depth = -1;                       // -d, -1 for unlimited
+    bool follow_symlinks = false;         // -sym
+    bool one_file_system = false;         // --one-file-system
+    bool report_renamed = false;          // emit Renamed events (-v)
+    bool report_skipped = false;          // emit Skipped events (-vs)
+    size_t max_memory = 0;                // --max-memory in bytes, 0 for unlimited
+    std::string checkpoint_path;          // --resume journal, empty for none
+    bool progress = false;                // --progress status line on stderr
+    RenameDurability durability = RenameDurability::None;  // --durability
+    unsigned int threads = 0;             // 0 for all processors
+    size_t batch_size_files = 0;          // --batch-files, 0 to adapt to the storage
+    size_t batch_size_folders = 0;        // --batch-folders, 0 to adapt to the storage
+    unsigned int in_flight = 0;           // --in-flight threads per batch, 0 to adapt
+    bool directory_affinity = true;       // false shares a directory's renames between threads
+    Vfs* vfs = nullptr;                   // filesystem of the walk (vfs.h), nullptr for the real one
+    RenameFilter filter;                  // --newer, --older, --min-size, --max-size, --uid, --gid
+};
+
+// Counts of a finished (or interrupted) run
+struct RenameResult {
+    long files_renamed = 0;
+    long folders_renamed = 0;
+    long files_skipped = 0;
+    long folders_skipped = 0;
+    long mounts_not_crossed = 0;
+    long duplicates = 0;                  // hash modes: files whose content name was taken
+    size_t input_paths = 0;
+    long directories_synced = 0;          // fsyncs of --durability=dirs
+    long filesystems_synced = 0;          // syncfs calls of --durability=fs
+    long transform_cache_hits = 0;        // names the transform cache answered, of its lookups
+    long transform_cache_lookups = 0;
+    bool transform_cache_off = false;     // its hit rate was too low, the run went on without it
+    size_t batch_size_files = 0;          // batch sizes and in-flight threads the run ended with
+    size_t batch_size_folders = 0;
+    unsigned int in_flight = 0;
+    bool adaptive_batches = false;        // false when all three were set by the options
+    double elapsed_seconds = 0.0;
+    bool interrupted = false;
+    std::string error;                    // set when the run could not start, nothing was renamed
+};
+
+// Per-entry report, the text is the CLI's verbose line without terminal colors
+struct RenameEvent {
+    enum class Type { Renamed, Skipped, Error };
+    Type type;
+    std::string text;
+};
+
+using RenameEventCallback = std::function<void(const RenameEvent&)>;
+
+
+// Runs rename jobs in-process. Jobs share the process-wide OpenMP thread pool and run one at a
+// time, concurrent run() calls from several threads are queued.
+class RenameEngine {
+public:
+    explicit RenameEngine(RenameOptions options);
+
+    // Events are delivered from worker threads, one at a time. Without a callback the
+    // enabled reports are printed to stdout/stderr like the CLI does.
+    void set_event_callback(RenameEventCallback callback);
+
+    RenameResult run(const std::vector<std::string>& paths);
+
+    // Rename the members of a tar or zip archive into a new archive at output, the data is
+    // copied as it is. Takes the name modes of -c (case_mode, rename_folders, rename_files,
+    // follow_symlinks for symlink members and the reports); a failed or cancelled job leaves
+    // no output behind.
+    RenameResult run_archive(const std::string& input, const std::string& output);
+
+    // Function to check a case mode against a scope before running, plugin modes included
+    static bool valid_case_mode(const std::string& case_mode, RenameScope scope);
+
+    // Function to load a transform plugin (renamepp_plugin.h), or every *.so of a directory.
+    // Its modes become valid case modes for Names and LowestParents. Load plugins before
+    // running jobs, not while one runs.
+    static bool load_plugin(const std::string& path, std::string& error);
+
+    // Ask the running job to finish its current batches and return (async-signal-safe). A cancel
+    // that comes before a job starts stops that job at once, the job that took it clears it.
+    static void cancel();
+
+    const RenameOptions& options() const { return options_; }
+
+private:
+    RenameOptions options_;
+    RenameEventCallback callback_;
+};
+
+#endif // RENAMEPP_H
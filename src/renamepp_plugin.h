@@ -0,0 +1,66 @@
+/* SPDX-License-Identifier: GNU General Public License v3.0 or later */
+
+/* renamepp_plugin.h: the C ABI of bulk_rename++ transform plugins
+ *
+ * A plugin is a shared object loaded with --plugin. It exports one function,
+ * renamepp_plugin_v1(), returning a static description of its modes. The engine hands a mode
+ * whole batches of names (the files of a directory chunk, or a single folder name) and the
+ * plugin writes the new names into an arena owned by the engine, so the per-call overhead is
+ * paid once per batch and the plugin is free to vectorize over the names.
+ *
+ * Threads: transform() is called concurrently from the worker threads, each passing its own
+ * worker state. Everything a plugin keeps between calls belongs in that state.
+ */
+
+#ifndef RENAMEPP_PLUGIN_H
+#define RENAMEPP_PLUGIN_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define RENAMEPP_PLUGIN_ABI 1
+#define RENAMEPP_PLUGIN_ENTRY "renamepp_plugin_v1"
+
+/* A name, not NUL-terminated */
+typedef struct renamepp_slice {
+    const char* data;
+    size_t size;
+} renamepp_slice;
+
+/* Results of transform() */
+enum {
+    RENAMEPP_OK = 0,          /* out[] is filled */
+    RENAMEPP_ARENA_FULL = 1,  /* *arena_needed is set, the engine grows the arena and calls again */
+    RENAMEPP_FAILED = -1      /* the batch keeps its names */
+};
+
+typedef struct renamepp_plugin {
+    uint32_t abi;                 /* RENAMEPP_PLUGIN_ABI */
+    const char* const* modes;     /* mode names, NULL-terminated; they must not shadow built-in modes */
+
+    /* Optional, NULL for stateless plugins: per worker-thread state, created on the thread's
+     * first batch and destroyed when the thread exits */
+    void* (*worker_create)(void);
+    void (*worker_destroy)(void* worker);
+
+    /* Transform names[0..count) with modes[mode]. is_file tells file names (with extension)
+     * from folder names. out[i] is either a slice inside [arena, arena + arena_size) or
+     * {NULL, 0} to keep names[i]. Called again for the same batch after RENAMEPP_ARENA_FULL. */
+    int (*transform)(void* worker, uint32_t mode, int is_file,
+                     const renamepp_slice* names, size_t count,
+                     char* arena, size_t arena_size,
+                     renamepp_slice* out, size_t* arena_needed);
+} renamepp_plugin;
+
+/* The exported entry point */
+typedef const renamepp_plugin* (*renamepp_plugin_entry)(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* RENAMEPP_PLUGIN_H */
@@ -0,0 +1,559 @@
+// SPDX-License-Identifier: GNU General Public License v3.0 or later
+
+#include "headers.h"
+#include "renamepp.h"
+
+#include <condition_variable>
+#include <csignal>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <thread>
+
+
+// Job protocol of --serve and --connect, the --resume journal's records in both directions:
+//   client -> daemon: O "name=value" per option, P absolute path, G to start, C to cancel the job
+//   daemon -> client: R/S/E per event (renamed, skipped, error), X when the job could not run,
+//                     Z with the counts of the finished job, then the daemon closes the connection
+
+// Event records are sent in chunks of this size, or when the oldest one waited this long
+static constexpr size_t event_flush_bytes = 16 * 1024;
+static constexpr std::chrono::milliseconds event_flush_interval{100};
+// Events a client has not taken yet, past this the job is cancelled rather than held up by it
+static constexpr size_t event_backlog_bytes = 16 * 1024 * 1024;
+
+// Jobs run one at a time on the daemon's shared OpenMP pool, running_job is the job id of the
+// job inside RenameEngine::run() so a cancel never reaches a job queued behind it
+static std::mutex job_mutex;
+static std::mutex cancel_mutex;
+static std::uint64_t running_job = 0;
+
+// Set by SIGINT/SIGTERM, the daemon stops accepting, finishes the running job and exits
+static std::atomic<bool> stop_serving{false};
+static std::mutex connections_mutex;
+static std::condition_variable connections_done;
+static unsigned int open_connections = 0;
+
+
+// Function to take the next complete record out of the buffer, false until one has arrived
+bool RecordReader::next(char& kind, std::string& value) {
+    const size_t header_end = buffer_.find(' ', position_ + 2);
+    if (buffer_.size() < position_ + 2 || header_end == std::string::npos) {
+        return false;
+    }
+    size_t length = 0;
+    const auto [end, error] = std::from_chars(buffer_.data() + position_ + 2, buffer_.data() + header_end, length);
+    if (buffer_[position_ + 1] != ' ' || error != std::errc() || end != buffer_.data() + header_end) {
+        malformed_ = true;
+        return false;
+    }
+    if (buffer_.size() < header_end + 1 + length + 1) {
+        return false;
+    }
+    if (buffer_[header_end + 1 + length] != '\n') {
+        malformed_ = true;
+        return false;
+    }
+    kind = buffer_[position_];
+    value.assign(buffer_, header_end + 1, length);
+    position_ = header_end + 1 + length + 1;
+    return true;
+}
+
+
+// Function to read what the peer has sent, false on end of stream, errors or a malformed record
+bool RecordReader::fill() {
+    if (malformed_) {
+        return false;
+    }
+    buffer_.erase(0, position_);
+    position_ = 0;
+
+    char chunk[64 * 1024];
+    ssize_t received;
+    do {
+        received = ::recv(fd_, chunk, sizeof(chunk), 0);
+    } while (received < 0 && errno == EINTR);
+    if (received <= 0) {
+        return false;
+    }
+    buffer_.append(chunk, static_cast<size_t>(received));
+    return true;
+}
+
+
+// Function to send a whole buffer, false once the peer is gone
+static bool send_all(int fd, const std::string& data) {
+    size_t sent = 0;
+    while (sent < data.size()) {
+        const ssize_t result = ::send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+        if (result < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        sent += static_cast<size_t>(result);
+    }
+    return true;
+}
+
+
+// Function to fill in the address of a socket path, false if it is too long for sun_path
+static bool socket_address(const std::string& socket_path, sockaddr_un& address) {
+    address = sockaddr_un{};
+    address.sun_family = AF_UNIX;
+    if (socket_path.empty() || socket_path.size() >= sizeof(address.sun_path)) {
+        return false;
+    }
+    std::memcpy(address.sun_path, socket_path.c_str(), socket_path.size() + 1);
+    return true;
+}
+
+
+// Function to apply one "name=value" job option, false for an unknown name or a bad value
+static bool apply_job_option(RenameOptions& options, const std::string& option) {
+    const size_t equals = option.find('=');
+    if (equals == std::string::npos) {
+        return false;
+    }
+    const std::string name = option.substr(0, equals);
+    const std::string value = option.substr(equals + 1);
+    const bool flag = value == "1";
+
+    if (name == "mode") {
+        options.case_mode = value;
+    } else if (name == "template") {
+        options.name_template = value;
+    } else if (name == "scope") {
+        if (value == "c") options.scope = RenameScope::Names;
+        else if (value == "cp") options.scope = RenameScope::LowestParents;
+        else if (value == "ce") options.scope = RenameScope::Extensions;
+        else return false;
+    } else if (name == "folders") {
+        options.rename_folders = flag;
+    } else if (name == "files") {
+        options.rename_files = flag;
+    } else if (name == "symlinks") {
+        options.follow_symlinks = flag;
+    } else if (name == "one_file_system") {
+        options.one_file_system = flag;
+    } else if (name == "renamed") {
+        options.report_renamed = flag;
+    } else if (name == "skipped") {
+        options.report_skipped = flag;
+    } else if (name == "durability") {
+        if (value == "none") options.durability = RenameDurability::None;
+        else if (value == "dirs") options.durability = RenameDurability::Dirs;
+        else if (value == "fs") options.durability = RenameDurability::Fs;
+        else return false;
+    } else if (name == "resume") {
+        options.checkpoint_path = value;
+    } else if (name == "depth" || name == "max_memory" || name == "batch_files" || name == "batch_folders" || name == "in_flight") {
+        long long number = 0;
+        const auto [end, error] = std::from_chars(value.data(), value.data() + value.size(), number);
+        if (error != std::errc() || end != value.data() + value.size() || number < -1) {
+            return false;
+        }
+        if (name == "depth") options.depth = static_cast<int>(number);
+        else if (name == "max_memory") options.max_memory = static_cast<size_t>(std::max(0LL, number));
+        else if (name == "batch_files") options.batch_size_files = static_cast<size_t>(std::max(0LL, number));
+        else if (name == "batch_folders") options.batch_size_folders = static_cast<size_t>(std::max(0LL, number));
+        else options.in_flight = static_cast<unsigned int>(std::clamp(number, 0LL, 1000000LL));
+    } else if (name == "newer" || name == "older" || name == "uid" || name == "gid") {
+        int64_t number = 0;
+        const auto [end, error] = std::from_chars(value.data(), value.data() + value.size(), number);
+        if (error != std::errc() || end != value.data() + value.size()) {
+            return false;
+        }
+        if (name == "newer") options.filter.newer_than = number;
+        else if (name == "older") options.filter.older_than = number;
+        else if (name == "uid") options.filter.uid = std::max<int64_t>(-1, number);
+        else options.filter.gid = std::max<int64_t>(-1, number);
+    } else if (name == "min_size" || name == "max_size") {
+        uint64_t number = 0;
+        const auto [end, error] = std::from_chars(value.data(), value.data() + value.size(), number);
+        if (error != std::errc() || end != value.data() + value.size()) {
+            return false;
+        }
+        (name == "min_size" ? options.filter.min_size : options.filter.max_size) = number;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+
+// Function to stop a job of this connection: a queued job is skipped, the running one winds down
+static void cancel_job(std::uint64_t job_id, std::atomic<bool>& cancelled) {
+    cancelled.store(true);
+    std::lock_guard<std::mutex> lock(cancel_mutex);
+    if (running_job == job_id) {
+        RenameEngine::cancel();
+    }
+}
+
+
+// Function to run the job of one client connection and stream its events back
+static void serve_connection(int fd, std::uint64_t job_id) {
+    RecordReader reader(fd);
+    RenameOptions options;
+    std::vector<std::string> paths;
+    std::string job_error;
+    bool start = false;
+    char kind;
+    std::string value;
+
+    for (;;) {
+        while (!start && reader.next(kind, value)) {
+            if (kind == 'O') {
+                if (!apply_job_option(options, value) && job_error.empty()) {
+                    job_error = "Invalid job option - " + value;
+                }
+            } else if (kind == 'P') {
+                paths.push_back(value);
+            } else if (kind == 'G') {
+                start = true;
+            }
+        }
+        if (start) {
+            break;
+        }
+        // An idle connection does not hold up a shutdown
+        pollfd waiting{fd, POLLIN, 0};
+        const int ready = ::poll(&waiting, 1, 250);
+        if (stop_serving.load() || (ready > 0 && !reader.fill())) {
+            ::close(fd);
+            return;
+        }
+    }
+
+    // Paths are resolved by the client, the daemon's working directory is not the client's
+    for (const std::string& path : paths) {
+        if (job_error.empty() && (path.empty() || path.front() != '/' || !fs::exists(path))) {
+            job_error = "Path does not exist or not absolute - " + path;
+        }
+    }
+
+    std::string out;
+    RenameResult result;
+    if (job_error.empty() && !stop_serving.load()) {
+        std::atomic<bool> cancelled{false};
+        std::atomic<bool> finished{false};
+        std::atomic<bool> client_gone{false};
+        std::atomic<bool> client_behind{false};
+
+        // Events arrive one at a time under the engine's print lock, which every walker thread
+        // waits on: the callback only appends them here, the watcher sends them
+        std::mutex events_mutex;
+        std::string events;
+        RenameEngine engine(options);
+        engine.set_event_callback([&](const RenameEvent& event) {
+            if (client_gone.load(std::memory_order_relaxed) || client_behind.load(std::memory_order_relaxed)) {
+                return;
+            }
+            const char event_kind = event.type == RenameEvent::Type::Renamed ? 'R' : (event.type == RenameEvent::Type::Skipped ? 'S' : 'E');
+            std::lock_guard<std::mutex> lock(events_mutex);
+            append_journal_record(events, event_kind, event.text);
+            if (events.size() > event_backlog_bytes) {
+                client_behind.store(true);
+                cancel_job(job_id, cancelled);
+            }
+        });
+
+        // The watcher sends the pending events in chunks, and a cancel record or a hang-up from
+        // the client ends the job early
+        std::thread watcher([&] {
+            char watched_kind;
+            std::string watched_value;
+            std::string sending;
+            auto last_flush = std::chrono::steady_clock::now();
+            while (!finished.load()) {
+                pollfd watched{fd, POLLIN, 0};
+                const int ready = ::poll(&watched, 1, static_cast<int>(event_flush_interval.count()));
+
+                if (!client_gone.load()) {
+                    {
+                        std::lock_guard<std::mutex> lock(events_mutex);
+                        if (events.size() >= event_flush_bytes || (!events.empty() && std::chrono::steady_clock::now() - last_flush >= event_flush_interval)) {
+                            sending.swap(events);
+                        }
+                    }
+                    if (!sending.empty()) {
+                        if (!send_all(fd, sending)) {
+                            client_gone.store(true);
+                            cancel_job(job_id, cancelled);
+                        }
+                        sending.clear();
+                        last_flush = std::chrono::steady_clock::now();
+                    }
+                }
+
+                if (ready <= 0) {
+                    continue;
+                }
+                if (!reader.fill()) {
+                    client_gone.store(true);
+                    cancel_job(job_id, cancelled);
+                    return;
+                }
+                while (reader.next(watched_kind, watched_value)) {
+                    if (watched_kind == 'C') {
+                        cancel_job(job_id, cancelled);
+                    }
+                }
+            }
+        });
+
+        {
+            std::lock_guard<std::mutex> job_lock(job_mutex);
+            // A cancel that reached the job before this one after it returned is dropped, then a
+            // shutdown requested while this one waited is honored: the signal sets stop_serving
+            // before it cancels, so one that comes later still reaches the run
+            {
+                std::lock_guard<std::mutex> lock(cancel_mutex);
+                interrupt_requested.store(false);
+                running_job = cancelled.load() || stop_serving.load() ? 0 : job_id;
+            }
+            if (running_job == job_id) {
+                result = engine.run(paths);
+            } else if (stop_serving.load()) {
+                job_error = "The daemon is shutting down";
+            } else {
+                result.interrupted = true;
+                result.input_paths = paths.size();
+            }
+            std::lock_guard<std::mutex> lock(cancel_mutex);
+            running_job = 0;
+        }
+
+        finished.store(true);
+        watcher.join();
+        out = std::move(events);
+        if (client_behind.load()) {
+            result.error = "The client fell more than " + std::to_string(event_backlog_bytes >> 20) + " MiB of events behind, the job was cancelled";
+        }
+    } else if (job_error.empty()) {
+        job_error = "The daemon is shutting down";
+    }
+
+    if (!job_error.empty()) {
+        result.error = job_error;
+    }
+    if (!result.error.empty()) {
+        append_journal_record(out, 'X', result.error);
+    } else {
+        std::ostringstream counts;
+        counts << result.files_renamed << ' ' << result.folders_renamed << ' ' << result.files_skipped << ' ' << result.folders_skipped << ' '
+               << result.mounts_not_crossed << ' ' << result.input_paths << ' ' << result.elapsed_seconds << ' ' << (result.interrupted ? 1 : 0) << ' '
+               << result.batch_size_files << ' ' << result.batch_size_folders << ' ' << result.in_flight << ' ' << (result.adaptive_batches ? 1 : 0) << ' ' << result.duplicates
+               << ' ' << result.transform_cache_hits << ' ' << result.transform_cache_lookups << ' ' << (result.transform_cache_off ? 1 : 0);
+        append_journal_record(out, 'Z', counts.str());
+    }
+    send_all(fd, out);
+    ::close(fd);
+}
+
+
+// Function to stop accepting on the first SIGINT/SIGTERM, a second one exits at once
+static void handle_serve_signal(int signal_number) {
+    if (stop_serving.exchange(true)) {
+        _exit(128 + signal_number);
+    }
+    RenameEngine::cancel();
+}
+
+
+// Function to serve rename jobs on a Unix socket until SIGINT/SIGTERM
+int serve_jobs(const std::string& socket_path) {
+    sockaddr_un address;
+    if (!socket_address(socket_path, address)) {
+        print_error("\n\033[1;91mError: Socket path is empty or too long - " + socket_path + "\033[0m\n");
+        return 1;
+    }
+
+    const int listen_fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listen_fd < 0) {
+        print_error("\n\033[1;91mError: Cannot create socket: " + std::string(std::strerror(errno)) + "\033[0m\n");
+        return 1;
+    }
+
+    // A socket left behind by a daemon that died is replaced, a live one is not
+    struct stat socket_stat;
+    if (::lstat(socket_path.c_str(), &socket_stat) == 0) {
+        if (!S_ISSOCK(socket_stat.st_mode)) {
+            print_error("\n\033[1;91mError: Not a socket - " + socket_path + "\033[0m\n");
+            ::close(listen_fd);
+            return 1;
+        }
+        const int probe_fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        const bool live = probe_fd >= 0 && ::connect(probe_fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) == 0;
+        if (probe_fd >= 0) ::close(probe_fd);
+        if (live) {
+            print_error("\n\033[1;91mError: A daemon is already serving on " + socket_path + "\033[0m\n");
+            ::close(listen_fd);
+            return 1;
+        }
+        ::unlink(socket_path.c_str());
+    }
+
+    // Only the owner may submit jobs, the daemon renames with the owner's rights
+    const mode_t old_umask = ::umask(0177);
+    const bool bound = ::bind(listen_fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) == 0;
+    ::umask(old_umask);
+    if (!bound || ::listen(listen_fd, SOMAXCONN) != 0) {
+        print_error("\n\033[1;91mError: Cannot listen on " + socket_path + ": " + std::strerror(errno) + "\033[0m\n");
+        ::close(listen_fd);
+        return 1;
+    }
+
+    struct sigaction action{};
+    action.sa_handler = handle_serve_signal;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGINT, &action, nullptr);
+    sigaction(SIGTERM, &action, nullptr);
+
+    // Start the worker pool now, so the first job does not pay for it
+    #pragma omp parallel num_threads(max_threads)
+    {
+    }
+
+    std::cout << "\033[0;1mServing rename jobs on \033[1;94m" << socket_path << "\033[0;1m, stop with Ctrl+C\033[0m" << std::endl;
+
+    std::uint64_t next_job_id = 0;
+    while (!stop_serving.load()) {
+        pollfd listening{listen_fd, POLLIN, 0};
+        if (::poll(&listening, 1, 250) <= 0) {
+            continue;
+        }
+        const int fd = ::accept4(listen_fd, nullptr, nullptr, SOCK_CLOEXEC);
+        if (fd < 0) {
+            continue;
+        }
+        {
+            std::lock_guard<std::mutex> lock(connections_mutex);
+            ++open_connections;
+        }
+        std::thread([fd, job_id = ++next_job_id] {
+            serve_connection(fd, job_id);
+            std::lock_guard<std::mutex> lock(connections_mutex);
+            if (--open_connections == 0) {
+                connections_done.notify_all();
+            }
+        }).detach();
+    }
+
+    ::close(listen_fd);
+    ::unlink(socket_path.c_str());
+
+    // Queued jobs are turned away, the running one was cancelled by the signal
+    std::unique_lock<std::mutex> lock(connections_mutex);
+    connections_done.wait(lock, [] { return open_connections == 0; });
+    std::cout << "\033[0;1mStopped serving on \033[1;94m" << socket_path << "\033[0m" << std::endl;
+    return 0;
+}
+
+
+// Function to run a job on a --serve daemon, events are printed like a local run prints them
+RenameResult run_remote_job(const std::string& socket_path, const RenameOptions& options, const std::vector<std::string>& paths) {
+    RenameResult result;
+    result.input_paths = paths.size();
+
+    sockaddr_un address;
+    if (!socket_address(socket_path, address)) {
+        result.error = "Socket path is empty or too long - " + socket_path;
+        return result;
+    }
+    const int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0 || ::connect(fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0) {
+        result.error = "Cannot connect to " + socket_path + ": " + std::strerror(errno);
+        if (fd >= 0) ::close(fd);
+        return result;
+    }
+
+    const char* scope = options.scope == RenameScope::Extensions ? "ce" : (options.scope == RenameScope::LowestParents ? "cp" : "c");
+    std::string request;
+    append_journal_record(request, 'O', "mode=" + options.case_mode);
+    if (!options.name_template.empty()) {
+        append_journal_record(request, 'O', "template=" + options.name_template);
+    }
+    append_journal_record(request, 'O', std::string("scope=") + scope);
+    append_journal_record(request, 'O', std::string("folders=") + (options.rename_folders ? "1" : "0"));
+    append_journal_record(request, 'O', std::string("files=") + (options.rename_files ? "1" : "0"));
+    append_journal_record(request, 'O', std::string("symlinks=") + (options.follow_symlinks ? "1" : "0"));
+    append_journal_record(request, 'O', std::string("one_file_system=") + (options.one_file_system ? "1" : "0"));
+    append_journal_record(request, 'O', std::string("renamed=") + (options.report_renamed ? "1" : "0"));
+    append_journal_record(request, 'O', std::string("skipped=") + (options.report_skipped ? "1" : "0"));
+    append_journal_record(request, 'O', "depth=" + std::to_string(options.depth));
+    append_journal_record(request, 'O', "max_memory=" + std::to_string(options.max_memory));
+    append_journal_record(request, 'O', "batch_files=" + std::to_string(options.batch_size_files));
+    append_journal_record(request, 'O', "batch_folders=" + std::to_string(options.batch_size_folders));
+    append_journal_record(request, 'O', "in_flight=" + std::to_string(options.in_flight));
+    append_journal_record(request, 'O', std::string("durability=") + (options.durability == RenameDurability::Dirs ? "dirs" : (options.durability == RenameDurability::Fs ? "fs" : "none")));
+    const RenameFilter& filter = options.filter;
+    if (filter.newer_than != INT64_MIN) append_journal_record(request, 'O', "newer=" + std::to_string(filter.newer_than));
+    if (filter.older_than != INT64_MAX) append_journal_record(request, 'O', "older=" + std::to_string(filter.older_than));
+    if (filter.min_size > 0) append_journal_record(request, 'O', "min_size=" + std::to_string(filter.min_size));
+    if (filter.max_size != UINT64_MAX) append_journal_record(request, 'O', "max_size=" + std::to_string(filter.max_size));
+    if (filter.uid >= 0) append_journal_record(request, 'O', "uid=" + std::to_string(filter.uid));
+    if (filter.gid >= 0) append_journal_record(request, 'O', "gid=" + std::to_string(filter.gid));
+    if (!options.checkpoint_path.empty()) {
+        append_journal_record(request, 'O', "resume=" + fs::absolute(options.checkpoint_path).native());
+    }
+    // The daemon runs in its own working directory
+    for (const std::string& path : paths) {
+        append_journal_record(request, 'P', fs::absolute(path).native());
+    }
+    append_journal_record(request, 'G', "");
+
+    if (!send_all(fd, request)) {
+        result.error = "Lost the connection to " + socket_path;
+        ::close(fd);
+        return result;
+    }
+
+    RecordReader reader(fd);
+    bool cancel_sent = false;
+    bool finished = false;
+    char kind;
+    std::string value;
+    while (!finished) {
+        if (!cancel_sent && interrupt_requested.load()) {
+            std::string cancel;
+            append_journal_record(cancel, 'C', "");
+            send_all(fd, cancel);
+            cancel_sent = true;
+        }
+        pollfd connection{fd, POLLIN, 0};
+        if (::poll(&connection, 1, 250) <= 0) {
+            continue;
+        }
+        if (!reader.fill()) {
+            result.error = "The daemon on " + socket_path + " closed the connection";
+            break;
+        }
+        while (reader.next(kind, value)) {
+            if (kind == 'R' || kind == 'S') {
+                print_verbose_enabled(value);
+            } else if (kind == 'E') {
+                print_error(value);
+            } else if (kind == 'X') {
+                result.error = value;
+                finished = true;
+            } else if (kind == 'Z') {
+                int interrupted = 0;
+                int adaptive = 0;
+                int cache_off = 0;
+                std::istringstream counts(value);
+                counts >> result.files_renamed >> result.folders_renamed >> result.files_skipped >> result.folders_skipped
+                       >> result.mounts_not_crossed >> result.input_paths >> result.elapsed_seconds >> interrupted
+                       >> result.batch_size_files >> result.batch_size_folders >> result.in_flight >> adaptive >> result.duplicates
+                       >> result.transform_cache_hits >> result.transform_cache_lookups >> cache_off;
+                result.adaptive_batches = adaptive != 0;
+                result.transform_cache_off = cache_off != 0;
+                result.interrupted = interrupted != 0 || cancel_sent;
+                finished = true;
+            }
+        }
+    }
+    ::close(fd);
+    return result;
+}
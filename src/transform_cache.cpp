@@ -0,0 +1,182 @@
+// SPDX-License-Identifier: GNU General Public License v3.0 or later
+
+#include "headers.h"
+
+
+// Big trees repeat their names: index.html, README.md, IMG_0001.JPG in every camera folder, the
+// parent of a thousand files in a {parent|sentence} template. The modes that rebuild the name
+// word by word take several hundred ns per name; a lookup here is a hash and a compare. Modes
+// that are a single pass over the bytes are faster than the hash and are not cached.
+//
+// Direct-mapped slots in shards, bounded at cache_shards * slots_per_shard names. Writers take
+// the lock of their shard, readers take none: they check the slot's sequence number before and
+// after copying it out (a seqlock) and count a torn read as a miss. A slot keeps the name next
+// to its result, so a hash collision is a miss too, never a wrong name. Entries are pure
+// functions of name and mode and stay valid across runs.
+
+static constexpr size_t cache_shards = 16;
+static constexpr size_t slots_per_shard = 512;
+// Name and result share the slot, longer pairs go uncached
+static constexpr size_t slot_bytes = 240;
+// Lookups of a run before its hit rate is judged, and the rate the cache needs to stay on
+static constexpr long sample_lookups = 4096;
+static constexpr long min_hit_percent = 10;
+
+static constexpr uint32_t slot_stored = 1u << 16;
+static constexpr uint32_t slot_unchanged = 1u << 17;
+
+struct alignas(64) CacheSlot {
+    std::atomic<uint32_t> sequence{0};    // odd while a writer is in the slot
+    std::atomic<uint32_t> shape{0};       // name length, result length << 8, slot_* flags
+    std::atomic<uint64_t> key{0};
+    std::atomic<uint64_t> words[slot_bytes / 8]{};
+};
+
+struct alignas(64) CacheShard {
+    std::mutex write_mutex;
+    CacheSlot slots[slots_per_shard];
+};
+
+static CacheShard shards[cache_shards];
+
+static std::atomic<bool> cache_enabled{true};
+static std::atomic<long> sample_left{0};
+static ShardedCounter cache_hits;
+static ShardedCounter cache_lookups;
+static long hits_before = 0;
+static long lookups_before = 0;
+
+
+// Function to find the cache's index of a mode, -1 for the modes it leaves alone
+static int cached_mode_index(NameTransform transform) {
+    static const std::array<NameTransform, 8> cached_modes = {
+        name_transform("title"), name_transform("camel"), name_transform("rcamel"), name_transform("pascal"),
+        name_transform("rpascal"), name_transform("sentence"), name_transform("swap"), name_transform("swapr")
+    };
+    for (size_t i = 0; i < cached_modes.size(); ++i) {
+        if (cached_modes[i] == transform) {
+            return static_cast<int>(i);
+        }
+    }
+    return -1;
+}
+
+
+// Function to copy the result for name out of a slot, false on a miss or a torn read
+static bool read_slot(const CacheSlot& slot, uint64_t key, std::string& name) {
+    const uint32_t sequence = slot.sequence.load(std::memory_order_acquire);
+    if (sequence & 1) {
+        return false;
+    }
+    const uint32_t shape = slot.shape.load(std::memory_order_relaxed);
+    if (!(shape & slot_stored) || slot.key.load(std::memory_order_relaxed) != key || (shape & 0xff) != name.size()) {
+        return false;
+    }
+    const size_t name_length = shape & 0xff;
+    const size_t result_length = (shape & slot_unchanged) ? 0 : (shape >> 8) & 0xff;
+    uint64_t words[slot_bytes / 8];
+    for (size_t i = 0; i < (name_length + result_length + 7) / 8; ++i) {
+        words[i] = slot.words[i].load(std::memory_order_relaxed);
+    }
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (slot.sequence.load(std::memory_order_relaxed) != sequence) {
+        return false;
+    }
+
+    const char* bytes = reinterpret_cast<const char*>(words);
+    if (std::memcmp(bytes, name.data(), name_length) != 0) {
+        return false;
+    }
+    if (!(shape & slot_unchanged)) {
+        name.assign(bytes + name_length, result_length);
+    }
+    return true;
+}
+
+
+// Function to store a name and its result in a slot, result empty when the mode left it unchanged
+static void write_slot(CacheShard& shard, CacheSlot& slot, uint64_t key, std::string_view name, std::string_view result, bool unchanged) {
+    uint64_t words[slot_bytes / 8];
+    char* bytes = reinterpret_cast<char*>(words);
+    std::memcpy(bytes, name.data(), name.size());
+    std::memcpy(bytes + name.size(), result.data(), result.size());
+    const size_t word_count = (name.size() + result.size() + 7) / 8;
+
+    std::lock_guard<std::mutex> lock(shard.write_mutex);
+    const uint32_t sequence = slot.sequence.load(std::memory_order_relaxed);
+    slot.sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    slot.key.store(key, std::memory_order_relaxed);
+    slot.shape.store(static_cast<uint32_t>(name.size() | result.size() << 8) | slot_stored | (unchanged ? slot_unchanged : 0),
+                     std::memory_order_relaxed);
+    for (size_t i = 0; i < word_count; ++i) {
+        slot.words[i].store(words[i], std::memory_order_relaxed);
+    }
+    slot.sequence.store(sequence + 2, std::memory_order_release);
+}
+
+
+// Function to judge the hit rate once the run's sample is in, a cache that mostly misses only
+// adds its hashing to every name
+static void count_lookup(bool hit) {
+    ++cache_lookups;
+    if (hit) {
+        ++cache_hits;
+    }
+    if (sample_left.load(std::memory_order_relaxed) > 0 && sample_left.fetch_sub(1, std::memory_order_relaxed) == 1) {
+        const long hits = cache_hits.load() - hits_before;
+        const long lookups = cache_lookups.load() - lookups_before;
+        if (hits * 100 < lookups * min_hit_percent) {
+            cache_enabled.store(false, std::memory_order_relaxed);
+        }
+    }
+}
+
+
+// Function to start a run with the cache on and its counts at zero
+void begin_transform_cache() {
+    hits_before = cache_hits.load();
+    lookups_before = cache_lookups.load();
+    sample_left.store(sample_lookups);
+    cache_enabled.store(true);
+}
+
+
+// Function to apply a name transform through the cache, in place like the transform itself.
+// Modes without one (hash, exif, ... on folders) leave the name as it is, like transform_name().
+void cached_transform(NameTransform transform, std::string& name, bool isFile) {
+    if (!transform) {
+        return;
+    }
+    const int mode = cached_mode_index(transform);
+    if (mode < 0 || name.size() > slot_bytes || !cache_enabled.load(std::memory_order_relaxed)) {
+        transform(name, isFile);
+        return;
+    }
+
+    // The mode and the file/folder flag salt the name's hash, the high half picks the shard
+    const uint64_t key = xxh64_digest(name) ^ (static_cast<uint64_t>(mode * 2 + (isFile ? 1 : 0) + 1) * 0x9E3779B185EBCA87ULL);
+    CacheShard& shard = shards[(key >> 32) % cache_shards];
+    CacheSlot& slot = shard.slots[key % slots_per_shard];
+    if (read_slot(slot, key, name)) {
+        count_lookup(true);
+        return;
+    }
+
+    thread_local std::string original;
+    original.assign(name);
+    transform(name, isFile);
+    const bool unchanged = name == original;
+    if (original.size() + (unchanged ? 0 : name.size()) <= slot_bytes) {
+        write_slot(shard, slot, key, original, unchanged ? std::string_view() : std::string_view(name), unchanged);
+    }
+    count_lookup(false);
+}
+
+
+// Function to end a run: its hits and lookups, and whether the cache switched itself off
+void end_transform_cache(long& hits, long& lookups, bool& off) {
+    hits = cache_hits.load() - hits_before;
+    lookups = cache_lookups.load() - lookups_before;
+    off = !cache_enabled.load();
+}
@@ -0,0 +1,104 @@
+// SPDX-License-Identifier: GNU General Public License v3.0 or later
+
+// Vfs: every filesystem call the rename engine makes on the trees it walks. RenameOptions::vfs
+// picks the backend of a run, the real filesystem by default. MemoryVfs is an in-memory tree
+// with per-operation latency, fault injection and call counts, for deterministic checks of the
+// engine's syscalls and for benchmarks that leave the storage out.
+
+#ifndef RENAMEPP_VFS_H
+#define RENAMEPP_VFS_H
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <map>
+#include <memory>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+
+// The calls, for counts, latencies and faults
+enum class VfsOp : unsigned char { Stat, Rename, List, Open, Read, SyncDirectory, SyncFilesystem, Count };
+
+// Called once per listed entry: the name, its type (DT_DIR, DT_REG, ..., symlinks resolved to
+// the type of their target, DT_UNKNOWN when that fails) and its inode number
+using VfsListCallback = void (*)(void* context, std::string_view name, unsigned char type, uint64_t inode);
+
+// Failures return false (or -1) and set errno, as the system calls they stand for
+class Vfs {
+public:
+    virtual ~Vfs() = default;
+
+    // statx of a path, the requested fields and the device id at least
+    virtual bool stat(const char* path, unsigned int mask, bool follow_symlinks, struct statx& stx) = 0;
+    // rename, flags 0 or RENAME_NOREPLACE (<cstdio>) (EEXIST when the target exists)
+    virtual bool rename(const char* old_path, const char* new_path, unsigned int flags) = 0;
+    // All entries of a directory but . and .., in no particular order
+    virtual bool list(const char* path, VfsListCallback callback, void* context) = 0;
+    // A regular file for reading front to back once, -1 for anything else (EINVAL)
+    virtual int open_read(const char* path) = 0;
+    virtual ssize_t pread(int handle, void* buffer, size_t size, off_t offset) = 0;
+    virtual void close_read(int handle) = 0;
+    // fsync of a directory, syncfs of the filesystem holding a path
+    virtual bool sync_directory(const char* path) = 0;
+    virtual bool sync_filesystem(const char* path) = 0;
+};
+
+
+// In-memory tree rooted at "/", relative paths start there too. Safe to use from the engine's
+// worker threads; the tree is built with the create_* calls before a run.
+class MemoryVfs : public Vfs {
+public:
+    MemoryVfs();
+    ~MemoryVfs() override;
+
+    bool create_directories(const std::string& path);
+    bool create_file(const std::string& path, std::string content = std::string(), std::int64_t mtime = 0);
+    bool create_symlink(const std::string& target, const std::string& path);
+
+    // Time each call of an operation takes, spent outside the tree lock so calls overlap like
+    // requests to a device do
+    void set_latency(VfsOp op, std::chrono::nanoseconds latency);
+    // Returns the errno a call fails with, 0 to let it through; called before every operation
+    void set_fault(std::function<int(VfsOp op, std::string_view path)> fault);
+    long count(VfsOp op) const;
+    void reset_counts();
+
+    bool stat(const char* path, unsigned int mask, bool follow_symlinks, struct statx& stx) override;
+    bool rename(const char* old_path, const char* new_path, unsigned int flags) override;
+    bool list(const char* path, VfsListCallback callback, void* context) override;
+    int open_read(const char* path) override;
+    ssize_t pread(int handle, void* buffer, size_t size, off_t offset) override;
+    void close_read(int handle) override;
+    bool sync_directory(const char* path) override;
+    bool sync_filesystem(const char* path) override;
+
+private:
+    struct Node;
+
+    bool begin(VfsOp op, std::string_view path);
+    Node* resolve(std::string_view path, bool follow_last, int& error, Node** parent = nullptr, std::string* leaf = nullptr);
+    Node* add(const std::string& path, unsigned char type, int& error);
+
+    std::unique_ptr<Node> root_;
+    mutable std::shared_mutex mutex_;
+    uint64_t next_inode_ = 2;
+    unsigned int device_minor_;
+    std::array<std::atomic<long>, static_cast<size_t>(VfsOp::Count)> counts_{};
+    std::array<std::chrono::nanoseconds, static_cast<size_t>(VfsOp::Count)> latency_{};
+    std::function<int(VfsOp, std::string_view)> fault_;
+    std::unordered_map<int, std::shared_ptr<const std::string>> open_files_;
+    int next_handle_ = 3;
+};
+
+#endif // RENAMEPP_VFS_H
@@ -0,0 +1,447 @@
+// SPDX-License-Identifier: GNU General Public License v3.0 or later
+
+#include "headers.h"
+
+#include <thread>
+
+
+// Same limit as the kernel's before ELOOP
+static constexpr int max_symlink_hops = 40;
+
+// Every MemoryVfs is a device of its own, so device_queues keeps their jobs apart
+static std::atomic<unsigned int> next_device_minor{1};
+
+
+struct MemoryVfs::Node {
+    Node(unsigned char node_type, uint64_t node_inode) : type(node_type), inode(node_inode) {}
+
+    unsigned char type;
+    uint64_t inode;
+    std::int64_t mtime = 0;
+    std::shared_ptr<const std::string> content;
+    std::string target;
+    Node* parent = nullptr;
+    std::map<std::string, std::unique_ptr<Node>, std::less<>> children;
+};
+
+
+MemoryVfs::MemoryVfs() : root_(new Node(DT_DIR, 1)), device_minor_(next_device_minor++) {
+}
+
+
+MemoryVfs::~MemoryVfs() = default;
+
+
+// Function to split the next component off a path, skipping repeated slashes
+static std::string_view next_component(std::string_view& path) {
+    while (!path.empty() && path.front() == '/') path.remove_prefix(1);
+    const size_t end = std::min(path.find('/'), path.size());
+    const std::string_view component = path.substr(0, end);
+    path.remove_prefix(end);
+    return component;
+}
+
+
+// Function to walk a path from the root. The parent and the leaf name are those of the last
+// component, set even when it does not exist so add() and rename() can create it.
+MemoryVfs::Node* MemoryVfs::resolve(std::string_view path, bool follow_last, int& error, Node** parent, std::string* leaf) {
+    // Directories walked so far, ".." pops them
+    std::vector<Node*> stack{root_.get()};
+    std::string pending(path);
+    std::string_view rest = pending;
+    int hops = 0;
+
+    if (parent) *parent = nullptr;
+    if (leaf) leaf->clear();
+    if (path.empty()) {
+        error = ENOENT;
+        return nullptr;
+    }
+
+    while (true) {
+        const std::string_view component = next_component(rest);
+        if (component.empty()) {
+            return stack.back();
+        }
+        while (!rest.empty() && rest.front() == '/') rest.remove_prefix(1);
+        const bool last = rest.empty();
+        Node* directory = stack.back();
+        if (directory->type != DT_DIR) {
+            error = ENOTDIR;
+            return nullptr;
+        }
+        if (component == "." || component == "..") {
+            if (component == ".." && stack.size() > 1) stack.pop_back();
+            if (last) return stack.back();
+            continue;
+        }
+        if (last) {
+            if (parent) *parent = directory;
+            if (leaf) leaf->assign(component);
+        }
+
+        const auto child = directory->children.find(component);
+        if (child == directory->children.end()) {
+            error = ENOENT;
+            return nullptr;
+        }
+        Node* node = child->second.get();
+        if (node->type == DT_LNK && (!last || follow_last)) {
+            if (++hops > max_symlink_hops) {
+                error = ELOOP;
+                return nullptr;
+            }
+            // Continue with the target, then what is left of the path
+            std::string expanded = node->target;
+            if (!last) {
+                expanded += '/';
+                expanded += rest;
+            }
+            if (!node->target.empty() && node->target.front() == '/') {
+                stack.resize(1);
+            }
+            pending = std::move(expanded);
+            rest = pending;
+            if (rest.find_first_not_of('/') == std::string_view::npos) {
+                if (parent) *parent = nullptr;
+                return stack.back();
+            }
+            continue;
+        }
+        if (last) {
+            return node;
+        }
+        stack.push_back(node);
+    }
+}
+
+
+// Function to create a missing entry, under the exclusive lock
+MemoryVfs::Node* MemoryVfs::add(const std::string& path, unsigned char type, int& error) {
+    Node* parent = nullptr;
+    std::string leaf;
+    if (resolve(path, false, error, &parent, &leaf)) {
+        error = EEXIST;
+        return nullptr;
+    }
+    if (error != ENOENT || !parent) {
+        return nullptr;
+    }
+    std::unique_ptr<Node>& node = parent->children[leaf];
+    node.reset(new Node(type, next_inode_++));
+    node->parent = parent;
+    return node.get();
+}
+
+
+bool MemoryVfs::create_directories(const std::string& path) {
+    std::unique_lock lock(mutex_);
+    std::string prefix;
+    std::string_view rest = path;
+    if (!rest.empty() && rest.front() == '/') prefix = "/";
+    while (true) {
+        const std::string_view component = next_component(rest);
+        if (component.empty()) {
+            return true;
+        }
+        prefix += component;
+        int error = 0;
+        const Node* node = resolve(prefix, true, error);
+        if (!node && !add(prefix, DT_DIR, error)) {
+            errno = error;
+            return false;
+        }
+        if (node && node->type != DT_DIR) {
+            errno = ENOTDIR;
+            return false;
+        }
+        prefix += '/';
+    }
+}
+
+
+bool MemoryVfs::create_file(const std::string& path, std::string content, std::int64_t mtime) {
+    std::unique_lock lock(mutex_);
+    int error = 0;
+    Node* node = add(path, DT_REG, error);
+    if (!node) {
+        errno = error;
+        return false;
+    }
+    node->content = std::make_shared<const std::string>(std::move(content));
+    node->mtime = mtime;
+    return true;
+}
+
+
+bool MemoryVfs::create_symlink(const std::string& target, const std::string& path) {
+    std::unique_lock lock(mutex_);
+    int error = 0;
+    Node* node = add(path, DT_LNK, error);
+    if (!node) {
+        errno = error;
+        return false;
+    }
+    node->target = target;
+    return true;
+}
+
+
+void MemoryVfs::set_latency(VfsOp op, std::chrono::nanoseconds latency) {
+    latency_[static_cast<size_t>(op)] = latency;
+}
+
+
+void MemoryVfs::set_fault(std::function<int(VfsOp op, std::string_view path)> fault) {
+    fault_ = std::move(fault);
+}
+
+
+long MemoryVfs::count(VfsOp op) const {
+    return counts_[static_cast<size_t>(op)].load(std::memory_order_relaxed);
+}
+
+
+void MemoryVfs::reset_counts() {
+    for (std::atomic<long>& count : counts_) {
+        count.store(0, std::memory_order_relaxed);
+    }
+}
+
+
+// Function to account for a call: count it, wait out its latency and ask the fault hook.
+// Returns false with errno set when the call is to fail.
+bool MemoryVfs::begin(VfsOp op, std::string_view path) {
+    const size_t index = static_cast<size_t>(op);
+    counts_[index].fetch_add(1, std::memory_order_relaxed);
+    if (latency_[index].count() > 0) {
+        std::this_thread::sleep_for(latency_[index]);
+    }
+    if (fault_) {
+        if (const int error = fault_(op, path)) {
+            errno = error;
+            return false;
+        }
+    }
+    return true;
+}
+
+
+bool MemoryVfs::stat(const char* path, unsigned int mask, bool follow_symlinks, struct statx& stx) {
+    (void)mask;
+    if (!begin(VfsOp::Stat, path)) {
+        return false;
+    }
+    std::shared_lock lock(mutex_);
+    int error = 0;
+    const Node* node = resolve(path, follow_symlinks, error);
+    if (!node) {
+        errno = error;
+        return false;
+    }
+
+    stx = {};
+    stx.stx_mask = STATX_BASIC_STATS | STATX_BTIME;
+    stx.stx_ino = node->inode;
+    stx.stx_nlink = 1;
+    stx.stx_blksize = 4096;
+    stx.stx_dev_major = 0;
+    stx.stx_dev_minor = device_minor_;
+    switch (node->type) {
+        case DT_DIR:
+            stx.stx_mode = S_IFDIR | 0755;
+            stx.stx_size = 4096;
+            break;
+        case DT_LNK:
+            stx.stx_mode = S_IFLNK | 0777;
+            stx.stx_size = node->target.size();
+            break;
+        default:
+            stx.stx_mode = S_IFREG | 0644;
+            stx.stx_size = node->content ? node->content->size() : 0;
+            break;
+    }
+    stx.stx_blocks = (stx.stx_size + 511) / 512;
+    stx.stx_mtime.tv_sec = node->mtime;
+    stx.stx_ctime.tv_sec = node->mtime;
+    stx.stx_btime.tv_sec = node->mtime;
+    return true;
+}
+
+
+bool MemoryVfs::rename(const char* old_path, const char* new_path, unsigned int flags) {
+    if (!begin(VfsOp::Rename, old_path)) {
+        return false;
+    }
+    if (flags & ~static_cast<unsigned int>(RENAME_NOREPLACE)) {
+        errno = EINVAL;
+        return false;
+    }
+    std::unique_lock lock(mutex_);
+    int error = 0;
+    Node* old_parent = nullptr;
+    std::string old_leaf;
+    Node* node = resolve(old_path, false, error, &old_parent, &old_leaf);
+    if (!node || !old_parent) {
+        errno = node ? EBUSY : error;
+        return false;
+    }
+    Node* new_parent = nullptr;
+    std::string new_leaf;
+    Node* existing = resolve(new_path, false, error, &new_parent, &new_leaf);
+    if (!new_parent) {
+        errno = existing ? EBUSY : error;
+        return false;
+    }
+    if (existing == node) {
+        return true;
+    }
+
+    if (existing) {
+        if (flags & RENAME_NOREPLACE) {
+            errno = EEXIST;
+            return false;
+        }
+        if (existing->type == DT_DIR && node->type != DT_DIR) {
+            errno = EISDIR;
+            return false;
+        }
+        if (existing->type != DT_DIR && node->type == DT_DIR) {
+            errno = ENOTDIR;
+            return false;
+        }
+        if (existing->type == DT_DIR && !existing->children.empty()) {
+            errno = ENOTEMPTY;
+            return false;
+        }
+    }
+
+    // A directory cannot move into its own subtree
+    for (const Node* ancestor = new_parent; ancestor; ancestor = ancestor->parent) {
+        if (ancestor == node) {
+            errno = EINVAL;
+            return false;
+        }
+    }
+
+    const auto old_entry = old_parent->children.find(old_leaf);
+    std::unique_ptr<Node> moved = std::move(old_entry->second);
+    old_parent->children.erase(old_entry);
+    moved->parent = new_parent;
+    new_parent->children[new_leaf] = std::move(moved);
+    return true;
+}
+
+
+bool MemoryVfs::list(const char* path, VfsListCallback callback, void* context) {
+    if (!begin(VfsOp::List, path)) {
+        return false;
+    }
+
+    // Entries are copied out so the callback runs without the lock, it may call back in
+    struct Entry {
+        std::string name;
+        unsigned char type;
+        uint64_t inode;
+    };
+    std::vector<Entry> entries;
+    {
+        std::shared_lock lock(mutex_);
+        int error = 0;
+        const Node* directory = resolve(path, true, error);
+        if (!directory || directory->type != DT_DIR) {
+            errno = directory ? ENOTDIR : error;
+            return false;
+        }
+        entries.reserve(directory->children.size());
+        const std::string prefix = std::string(path) + '/';
+        for (const auto& [name, child] : directory->children) {
+            unsigned char type = child->type;
+            if (type == DT_LNK) {
+                const Node* target = resolve(prefix + name, true, error);
+                type = target ? target->type : static_cast<unsigned char>(DT_UNKNOWN);
+            }
+            entries.push_back({name, type, child->inode});
+        }
+    }
+    for (const Entry& entry : entries) {
+        callback(context, entry.name, entry.type, entry.inode);
+    }
+    return true;
+}
+
+
+int MemoryVfs::open_read(const char* path) {
+    if (!begin(VfsOp::Open, path)) {
+        return -1;
+    }
+    std::unique_lock lock(mutex_);
+    int error = 0;
+    const Node* node = resolve(path, true, error);
+    if (!node || node->type != DT_REG) {
+        errno = node ? EINVAL : error;
+        return -1;
+    }
+    // The handle keeps the content it opened, like an fd keeps an unlinked inode
+    const int handle = next_handle_++;
+    open_files_[handle] = node->content ? node->content : std::make_shared<const std::string>();
+    return handle;
+}
+
+
+ssize_t MemoryVfs::pread(int handle, void* buffer, size_t size, off_t offset) {
+    if (!begin(VfsOp::Read, std::string_view())) {
+        return -1;
+    }
+    std::shared_ptr<const std::string> content;
+    {
+        std::shared_lock lock(mutex_);
+        const auto file = open_files_.find(handle);
+        if (file == open_files_.end() || offset < 0) {
+            errno = file == open_files_.end() ? EBADF : EINVAL;
+            return -1;
+        }
+        content = file->second;
+    }
+    if (static_cast<size_t>(offset) >= content->size()) {
+        return 0;
+    }
+    const size_t length = std::min(size, content->size() - static_cast<size_t>(offset));
+    std::memcpy(buffer, content->data() + offset, length);
+    return static_cast<ssize_t>(length);
+}
+
+
+void MemoryVfs::close_read(int handle) {
+    std::unique_lock lock(mutex_);
+    open_files_.erase(handle);
+}
+
+
+bool MemoryVfs::sync_directory(const char* path) {
+    if (!begin(VfsOp::SyncDirectory, path)) {
+        return false;
+    }
+    std::shared_lock lock(mutex_);
+    int error = 0;
+    const Node* node = resolve(path, true, error);
+    if (!node || node->type != DT_DIR) {
+        errno = node ? ENOTDIR : error;
+        return false;
+    }
+    return true;
+}
+
+
+bool MemoryVfs::sync_filesystem(const char* path) {
+    if (!begin(VfsOp::SyncFilesystem, path)) {
+        return false;
+    }
+    std::shared_lock lock(mutex_);
+    int error = 0;
+    if (!resolve(path, true, error)) {
+        errno = error;
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,121 @@
+// SPDX-License-Identifier: GNU General Public License v3.0 or later
+
+#include "headers.h"
+
+
+// The real filesystem: each call is the system call it stands for
+class PosixVfs : public Vfs {
+public:
+    bool stat(const char* path, unsigned int mask, bool follow_symlinks, struct statx& stx) override {
+        const int flags = AT_STATX_SYNC_AS_STAT | (follow_symlinks ? 0 : AT_SYMLINK_NOFOLLOW);
+        return ::statx(AT_FDCWD, path, flags, mask, &stx) == 0;
+    }
+
+    // Falls back to a check before the rename where the filesystem has no RENAME_NOREPLACE;
+    // with directory_affinity a folder's renames come from one worker, nothing of this run races it
+    bool rename(const char* old_path, const char* new_path, unsigned int flags) override {
+        if (flags == 0) {
+            return ::rename(old_path, new_path) == 0;
+        }
+        if (::renameat2(AT_FDCWD, old_path, AT_FDCWD, new_path, flags) == 0) {
+            return true;
+        }
+        if (errno != EINVAL && errno != ENOSYS) {
+            return false;
+        }
+        struct statx stx;
+        if (stat(new_path, STATX_TYPE, false, stx)) {
+            errno = EEXIST;
+            return false;
+        }
+        return ::rename(old_path, new_path) == 0;
+    }
+
+    // readdir's d_type spares a stat per entry; only symlinks and filesystems reporting
+    // DT_UNKNOWN need one to classify, relative to the open directory
+    bool list(const char* path, VfsListCallback callback, void* context) override {
+        DIR* dir = ::opendir(path);
+        if (!dir) {
+            return false;
+        }
+        while (struct dirent* entry = ::readdir(dir)) {
+            const char* name = entry->d_name;
+            if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) continue;
+
+            // Symlinks are classified by their target like directory_entry::is_directory() does
+            unsigned char type = entry->d_type;
+            if (type == DT_LNK || type == DT_UNKNOWN) {
+                struct statx stx;
+                type = DT_UNKNOWN;
+                if (::statx(dirfd(dir), name, AT_STATX_SYNC_AS_STAT, STATX_TYPE, &stx) == 0) {
+                    type = S_ISDIR(stx.stx_mode) ? DT_DIR : (S_ISREG(stx.stx_mode) ? DT_REG : DT_UNKNOWN);
+                }
+            }
+            callback(context, name, type, entry->d_ino);
+        }
+        ::closedir(dir);
+        return true;
+    }
+
+    int open_read(const char* path) override {
+        // O_NONBLOCK: a FIFO swapped in since the listing must not hang the worker
+        const int fd = ::open(path, O_RDONLY | O_CLOEXEC | O_NOCTTY | O_NONBLOCK);
+        if (fd < 0) {
+            return -1;
+        }
+        struct stat st;
+        if (::fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+            ::close(fd);
+            errno = EINVAL;
+            return -1;
+        }
+        ::posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+        return fd;
+    }
+
+    ssize_t pread(int handle, void* buffer, size_t size, off_t offset) override {
+        return ::pread(handle, buffer, size, offset);
+    }
+
+    // The pages were read once, do not let a large tree push everything else out of the cache
+    void close_read(int handle) override {
+        const int error = errno;
+        ::posix_fadvise(handle, 0, 0, POSIX_FADV_DONTNEED);
+        ::close(handle);
+        errno = error;
+    }
+
+    bool sync_directory(const char* path) override {
+        return sync_with(path, ::fsync);
+    }
+
+    bool sync_filesystem(const char* path) override {
+        return sync_with(path, ::syncfs);
+    }
+
+private:
+    static bool sync_with(const char* path, int (*sync)(int)) {
+        const int fd = ::open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (fd < 0) {
+            return false;
+        }
+        const bool synced = sync(fd) == 0;
+        const int error = errno;
+        ::close(fd);
+        errno = error;
+        return synced;
+    }
+};
+
+
+static PosixVfs posix_backend;
+
+// Backend of the running job, RenameEngine::run points it at RenameOptions::vfs. Constant
+// initialized, the address is usable before any constructor ran.
+Vfs* vfs = &posix_backend;
+
+
+// Function to get the real filesystem backend
+Vfs& posix_vfs() {
+    return posix_backend;
+}